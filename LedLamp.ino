@@ -11,20 +11,20 @@
 
 #define STATE      "/cfg/state"
 #define FAVS       "/cfg/favs"
+#define STRIPS     "/cfg/strips"
 
 #define FRONT_PIN       4
 #define BACK_PIN        5
 
 #define LED_COUNT               60
+#define MAX_LED_COUNT           2048
 #define LED_TYPE                WS2812B
 #define COLOR_ORDER             GRB
 #define BRIGHTNESS              96
 #define FRAMES_PER_SECOND       60
 
-CRGB frontLeds[LED_COUNT];
-CRGB backLeds[LED_COUNT];
-
 typedef struct StripRec Strip;
+typedef struct OutputStageRec OutputStage;
 
 // Pattern renderer function type.
 typedef void (*Renderer)(Strip *);
@@ -37,6 +37,7 @@ typedef struct Pattern {
     int32_t renderPause;
     boolean soundReactive;
     boolean favorite;
+    uint16_t cost;          // average render time in us, as measured on this lamp
 } Pattern;
 
 typedef enum {
@@ -49,6 +50,23 @@ typedef enum {
 
 uint8_t favCount = 0;
 
+typedef enum {
+    LINEAR_GEOMETRY,
+    MATRIX_GEOMETRY,
+    RING_GEOMETRY,
+    POINTS_GEOMETRY
+} GeometryKind;
+
+// Physical layout of a strip, compiled into per-pixel coordinate tables.
+// All coordinates are scaled to 0..255; y grows upward and angle runs counter-clockwise.
+typedef struct {
+    GeometryKind kind;
+    uint16_t width, height;
+    uint8_t *x, *y;
+    uint8_t *angle, *radius;
+    uint16_t *grid;
+} Geometry;
+
 struct StripRec {
     const char *name;
     bool on;
@@ -57,7 +75,7 @@ struct StripRec {
     CRGB *leds;
     Pattern *pattern;
     uint8_t hue;
-    uint8_t count;
+    uint16_t count;
     CLEDController *ctl;
     CRGBPalette16 currentPalette;
     CRGBPalette16 targetPalette;
@@ -65,26 +83,155 @@ struct StripRec {
     RandomMode randomMode;
     uint32_t th, tb, tp, t0, t1, t2, t3, t4;
     byte *data;
+    Geometry *geometry;
+    OutputStage *output;
+    uint32_t tr;            // time of the last render
+    uint16_t dt;            // ms elapsed between the last two renders
+    uint16_t drift;         // fraction of a frame carried over by frameSteps, 8.8 fixed point
+    uint16_t offset;        // position of the first pixel in the virtual strip, see span.h
+    uint16_t span;          // length of the virtual strip; 0 until laid out
 };
 
-byte frontData[LED_COUNT];
-byte backData[LED_COUNT];
+// Requested changes to a strip's properties; empty fields are left alone.
+typedef struct {
+    char on[8];
+    char rgb[24];
+    char brightness[8];
+    char effect[32];
+} StripUpdate;
+
+// Strip settings handed from the network side to the render side.
+typedef struct {
+    bool on;
+    CRGB color;
+    uint8_t brightness;
+    Pattern *pattern;
+    bool setPalette;
+    CRGBPalette16 targetPalette;
+    bool setHue;
+    uint8_t hue;
+    uint16_t offset;
+    uint16_t span;
+} RenderCommand;
+
+// Render side state reported back to the network side after each shown frame. The
+// palette is only included when a pattern picked a new one during the frame.
+typedef struct {
+    uint8_t strip;
+    uint8_t hue;
+    bool setPalette;
+    CRGBPalette16 targetPalette;
+} FrameReport;
+
+// Strip property addressed by the last segment of an MQTT/WebSocket topic.
+typedef enum {
+    POWER_PROPERTY,
+    RGB_PROPERTY,
+    BRIGHTNESS_PROPERTY,
+    EFFECT_PROPERTY,
+    FAV_PROPERTY,
+    JSON_PROPERTY,
+    PEER_PATTERN_PROPERTY,
+    PEER_COLORS_PROPERTY,
+    SCENE_PROPERTY,         // scene commands apply to both strips and are queued without one
+    SAVE_SCENE_PROPERTY,
+    PEER_SCENE_PROPERTY,
+    ALL_POWER_PROPERTY      // the all topic, which only saves and does not sync
+} StripProperty;
+
+// On, hue, brightness, color and 16 palette entries, as synced between lamps. The sleep
+// dimmer goes in byte 32, over the blue of palette entry 8, where older lamps read it;
+// envelope records, which only current lamps send, repeat that blue in a last byte.
+#define COLOR_SETTINGS_SIZE 55
+#define COLOR_SETTINGS_DIMMER 32
+#define COLOR_SETTINGS_BLUE8 54
+
+// Queued strip mutation; pending commands for the same strip and property collapse into one,
+// except as noted at queueCommand().
+typedef struct {
+    Strip *strip;
+    StripProperty property;
+    union {
+        char text[32];
+        Pattern *pattern;
+        uint8_t colors[COLOR_SETTINGS_SIZE];
+        struct {
+            uint8_t id;
+            uint16_t crc;
+        } scene;
+    };
+} StripCommand;
+
+// Target addressed by the first segment of an MQTT/WebSocket topic.
+typedef enum {
+    ALL_TOPIC,
+    STRIP_TOPIC,
+    SLEEP_TOPIC,
+    SYNC_TOPIC,
+    SCENE_TOPIC
+} TopicKind;
+
+typedef struct {
+    const char *name;
+    TopicKind kind;
+    Strip *strip;
+} TopicRoute;
+
+typedef struct {
+    const char *name;
+    StripProperty property;
+} PropertyRoute;
+
+Geometry frontGeometry = {.kind = LINEAR_GEOMETRY};
+Geometry backGeometry = {.kind = LINEAR_GEOMETRY};
 
 Strip front = {
         .name = "front", .on = true, .color = CRGB::Orange, .brightness = BRIGHTNESS,
-        .leds = &frontLeds[0], .pattern = NULL, .hue = 0, .count = LED_COUNT, .ctl = NULL,
+        .leds = NULL, .pattern = NULL, .hue = 0, .count = LED_COUNT, .ctl = NULL,
         .currentPalette = CRGBPalette16(PartyColors_p), .targetPalette = CRGBPalette16(PartyColors_p),
         .currentBlending = LINEARBLEND, .randomMode = FAVORITES,
-        .th = 0, .tb = 0, .tp = 0, .t0 = 0, .t1 = 0, .t2 = 0, .t3 = 0, .t4 = 0, .data = frontData
+        .th = 0, .tb = 0, .tp = 0, .t0 = 0, .t1 = 0, .t2 = 0, .t3 = 0, .t4 = 0, .data = NULL,
+        .geometry = &frontGeometry, .output = NULL
 };
 Strip back = {
         .name = "back", .on = true, .color = CRGB::Red, .brightness = BRIGHTNESS,
-        .leds = &backLeds[0], .pattern = NULL, .hue = 0, .count = LED_COUNT, .ctl = NULL,
+        .leds = NULL, .pattern = NULL, .hue = 0, .count = LED_COUNT, .ctl = NULL,
         .currentPalette = CRGBPalette16(PartyColors_p), .targetPalette = CRGBPalette16(PartyColors_p),
         .currentBlending = LINEARBLEND, .randomMode = NOT_RANDOM,
-        .th = 0, .tb = 0, .tp = 0, .t0 = 0, .t1 = 0, .t2 = 0, .t3 = 0, .t4 = 0, .data = backData
+        .th = 0, .tb = 0, .tp = 0, .t0 = 0, .t1 = 0, .t2 = 0, .t3 = 0, .t4 = 0, .data = NULL,
+        .geometry = &backGeometry, .output = NULL
 };
 
+// Topic routing tables; topics are "[<host>]/<route>[/<property>]".
+TopicRoute topicRoutes[] = {
+        {.name = "all", .kind = ALL_TOPIC, .strip = NULL},
+        {.name = "front", .kind = STRIP_TOPIC, .strip = &front},
+        {.name = "back", .kind = STRIP_TOPIC, .strip = &back},
+        {.name = "sleep", .kind = SLEEP_TOPIC, .strip = NULL},
+        {.name = "sync", .kind = SYNC_TOPIC, .strip = NULL},
+        {.name = "scene", .kind = SCENE_TOPIC, .strip = NULL}
+};
+
+PropertyRoute propertyRoutes[] = {
+        {.name = "rgb", .property = RGB_PROPERTY},
+        {.name = "brightness", .property = BRIGHTNESS_PROPERTY},
+        {.name = "effect", .property = EFFECT_PROPERTY},
+        {.name = "fav", .property = FAV_PROPERTY},
+        {.name = "json", .property = JSON_PROPERTY}
+};
+
+// Strip mutations from MQTT, WebSocket, HTTP and peers, applied once per loop pass.
+#define MAX_STRIP_COMMANDS  16
+StripCommand stripCommands[MAX_STRIP_COMMANDS];
+uint8_t stripCommandCount = 0;
+uint8_t stripCommandDepth = 0;      // commands applied by the last pass
+uint8_t stripCommandPeak = 0;
+uint32_t stripCommandsQueued = 0;
+uint32_t stripCommandsCollapsed = 0;
+bool fullStateRequested = false;
+bool saveRequested = false;
+bool sceneRecalled = false;
+
 static WebSocketsServer wsServer(81);
 
 // Sample average, max and peak detection
@@ -96,25 +243,33 @@ uint16_t oldsample = 0;
 uint32_t lastSample = 0;
 
 #define SLEEP_TIMEOUT   30*60000
+#define SLEEP_FADE_DURATION 60000
 uint32_t sleepTime = 0;
 uint32_t sleepDimmer = 100;
 
 #define ALONE_TIMEOUT  5*60000
 uint32_t homeAlone = 0;
 
-uint8_t peerCount = 0;
-
 #define DIAGNOSTICS "/diagnostics"
 bool diagnosticsOn = true;
 
 #define ALWAYS_PAIRED "/alwaysPaired"
 bool alwaysPaired = false;
 
+// When on, strip state is published as a single Home Assistant style JSON
+// message per strip instead of one retained message per property.
+#define MQTT_JSON "/mqttJson"
+bool mqttJson = false;
+uint8_t pendingJsonState = 0;
+
 #define STARTUP_MILLIS  20000
 #define EVERY_X_MILLIS(T, N)  if (T < millis()) { T = millis() + N;
+#define ARRAY_SIZE(A) (sizeof(A) / sizeof((A)[0]))
 
 // LED Patterns
+#include "pixelops.h"
 #include "simple.h"
+#include "noisefield.h"
 #include "fire.h"
 #include "noise.h"
 #include "plasma.h"
@@ -136,60 +291,221 @@ bool alwaysPaired = false;
 #include "twinklefox.h"
 #include "fireworks.h"
 #include "murica.h"
-
+#include "geometry.h"
+#include "patterns2d.h"
+
+#include "json.h"
+#include "spsc.h"
+#include "members.h"
+#include "span.h"
+#include "envelope.h"
+#include "scene.h"
+#include "recovery.h"
+#include "boot.h"
+#include "assets.h"
+#include "program.h"
+#include "output.h"
+#include "governor.h"
+
+// The render side runs inline at the end of every loop() pass. It only ever runs
+// between network passes, so globals such as sampleavg, sleepDimmer and the WiFi
+// status need no handoff; a render task on another core would have to pass them
+// through the queues below as well.
+
+// Render side copies of front and back; they share the pixel and data buffers.
+Strip renderStrips[2];
+RenderCommand lastCommand[2];
+SpscQueue<RenderCommand, 4> renderCommands[2];
+SpscQueue<FrameReport, 16> frameReports;
+
+// Next deferred boot step to run from loop().
+uint8_t bootStep = 0;
+bool lastStateLoaded = false;
+bool wifiTimed = false;
+
+// Pixel counts that could not be allocated, front and back. setupLED() runs before gizmo
+// is up to log them, so they are reported from setupGizmo().
+uint16_t unallocatedCounts[2] = {0, 0};
+
+// Shows the last state as soon as the LEDs are up; the rest of setup runs from loop(), see boot.h.
 void setup() {
+    bootPhase("reset");
+    SPIFFS.begin();
+    bootPhase("flash");
+    setupLED();
+    bootPhase("leds");
+    lastStateLoaded = loadLastState();
+    startRenderer();
+    bootPhase("state");
+    renderFrame();
+    bootPhase("light");
+}
+
+// WiFi, MQTT and the web server all start inside beginSetup(); ESPGizmo offers no way to
+// bring them up separately, so this remains the one long step of the deferred boot.
+void setupGizmo() {
     gizmo.beginSetup(LED_LIGHTS, SW_VERSION, "gizmo123");
+    for (uint8_t i = 0; i < 2; i++) {
+        if (unallocatedCounts[i]) {
+            gizmo.debug("Unable to allocate %d pixels for %s", unallocatedCounts[i], i ? back.name : front.name);
+        }
+    }
+}
+
+void setupUpdates() {
     gizmo.setUpdateURL(SW_UPDATE_URL, onUpdate);
+}
 
+void setupRoutes() {
     gizmo.httpServer()->on("/on", HTTP_OPTIONS, handleOn);
     gizmo.httpServer()->on("/on", HTTP_GET, handleOn);
     gizmo.httpServer()->on("/off", HTTP_OPTIONS, handleOff);
     gizmo.httpServer()->on("/off", HTTP_GET, handleOff);
     gizmo.httpServer()->on("/power", HTTP_OPTIONS, handlePowerState);
     gizmo.httpServer()->on("/power", HTTP_GET, handlePowerState);
+    gizmo.httpServer()->on("/api/state", HTTP_OPTIONS, handleOptions);
+    gizmo.httpServer()->on("/api/state", HTTP_GET, handleApiState);
+    gizmo.httpServer()->on("/api/state", HTTP_POST, handleApiState);
+    gizmo.httpServer()->on("/api/program", HTTP_OPTIONS, handleOptions);
+    gizmo.httpServer()->on("/api/program", HTTP_GET, handleProgram);
+    gizmo.httpServer()->on("/api/program", HTTP_POST, handleProgram);
+    gizmo.httpServer()->on("/api/scene", HTTP_OPTIONS, handleOptions);
+    gizmo.httpServer()->on("/api/scene", HTTP_POST, handleScene);
     gizmo.httpServer()->on("/channel", handleChannel);
     gizmo.httpServer()->on("/diagnostics", handleDiagnostics);
     gizmo.httpServer()->on("/alwaysPaired", handleAlwaysPaired);
+    gizmo.httpServer()->on("/mqttJson", handleMqttJson);
+    gizmo.httpServer()->on("/span", handleSpan);
+    gizmo.httpServer()->on("/api/boot", HTTP_GET, handleBoot);
+    setupAssets();
     gizmo.setupWebRoot();
     setupWebSocket();
+}
 
+void setupTopics() {
     gizmo.setCallback(mqttCallback);
     gizmo.addTopic("%s/sync");
     gizmo.addTopic("%s/all");
+    gizmo.addTopic("%s/scene");
 
     gizmo.addTopic("%s/front");
     gizmo.addTopic("%s/front/rgb");
     gizmo.addTopic("%s/front/brightness");
     gizmo.addTopic("%s/front/effect");
+    gizmo.addTopic("%s/front/json");
 
     gizmo.addTopic("%s/back");
     gizmo.addTopic("%s/back/rgb");
     gizmo.addTopic("%s/back/brightness");
     gizmo.addTopic("%s/back/effect");
+    gizmo.addTopic("%s/back/json");
+}
 
-    setupLED();
-
+// The text state is only needed when there is no binary record yet, e.g. after an update.
+void setupConfig() {
+    if (!lastStateLoaded) {
+        loadState();
+    }
+    loadFavorites();
     diagnosticsOn = SPIFFS.exists(DIAGNOSTICS);
     alwaysPaired = SPIFFS.exists(ALWAYS_PAIRED);
+    mqttJson = SPIFFS.exists(MQTT_JSON);
+    loadReboots();
+}
+
+void endSetup() {
     gizmo.endSetup();
 }
 
+BootStep bootSteps[] = {
+        {.name = "gizmo", .run = setupGizmo},
+        {.name = "updates", .run = setupUpdates},
+        {.name = "routes", .run = setupRoutes},
+        {.name = "topics", .run = setupTopics},
+        {.name = "config", .run = setupConfig},
+        {.name = "ready", .run = endSetup}
+};
+
+// Runs the next deferred boot step; returns false once they have all run.
+bool continueBoot() {
+    if (bootStep == ARRAY_SIZE(bootSteps)) {
+        return false;
+    }
+    bootSteps[bootStep].run();
+    bootPhase(bootSteps[bootStep].name);
+    bootStep++;
+    return true;
+}
+
+void handleBoot() {
+    ESP8266WebServer *server = gizmo.httpServer();
+    sendCorsHeaders();
+    JsonWriter w;
+    server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server->send(200, "application/json", "");
+    jsonBegin(&w, httpChunkSink, true);
+    writeBootPhases(&w);
+    jsonEnd(&w);
+    server->sendContent("");
+}
+
 void setupLED() {
     FastLED.setMaxPowerInVoltsAndMilliamps(5, 2400);
 
-    front.ctl = &FastLED.addLeds<LED_TYPE, FRONT_PIN, COLOR_ORDER>(frontLeds, front.count).setCorrection(
-            TypicalLEDStrip);
-    fadeToBlackBy(frontLeds, front.count, 255);
-    front.ctl->showLeds(front.brightness);
+    loadStripCounts();
+    allocStrip(&front);
+    allocStrip(&back);
+    setupGamma();
+
+    // Color correction is applied by the output stage, see output.h.
+    front.ctl = &FastLED.addLeds<LED_TYPE, FRONT_PIN, COLOR_ORDER>(front.output->out, front.count);
+    front.ctl->showLeds(255);
     front.pattern = findPattern("gradient");
 
-    back.ctl = &FastLED.addLeds<LED_TYPE, BACK_PIN, COLOR_ORDER>(backLeds, back.count).setCorrection(TypicalLEDStrip);
-    fadeToBlackBy(backLeds, back.count, 255);
-    back.ctl->showLeds(back.brightness);
+    back.ctl = &FastLED.addLeds<LED_TYPE, BACK_PIN, COLOR_ORDER>(back.output->out, back.count);
+    back.ctl->showLeds(255);
     back.pattern = findPattern("cycle");
 
-    loadState();
-    loadFavorites();
+    loadGeometry(&front);
+    loadGeometry(&back);
+    loadPrograms();
+    loadSpan();
+    layoutSpan(&front);
+}
+
+// Reads the pixel count of each strip, one line per strip (front, then back).
+void loadStripCounts() {
+    File f = SPIFFS.open(STRIPS, "r");
+    if (f) {
+        loadStripCount(f, &front);
+        loadStripCount(f, &back);
+        f.close();
+    }
+}
+
+void loadStripCount(File f, Strip *s) {
+    char field[8];
+    int l = f.readBytesUntil('\n', field, sizeof(field) - 1);
+    field[l] = '\0';
+    int count = atoi(field);
+    if (count > 0) {
+        s->count = min(count, MAX_LED_COUNT);
+    }
+}
+
+// Allocates the pixel and pattern data buffers of a strip, falling back to the default length.
+void allocStrip(Strip *s) {
+    s->leds = (CRGB *) calloc(s->count, sizeof(CRGB));
+    s->data = (byte *) calloc(s->count, sizeof(byte));
+    bool output = allocOutput(s);
+    if ((!s->leds || !s->data || !output) && s->count > LED_COUNT) {
+        unallocatedCounts[s == &front ? 0 : 1] = s->count;
+        free(s->leds);
+        free(s->data);
+        freeOutput(s);
+        s->count = LED_COUNT;
+        allocStrip(s);
+    }
 }
 
 void setupWebSocket() {
@@ -201,7 +517,7 @@ void setupWebSocket() {
 // Common CORS headers
 void sendCorsHeaders() {
     gizmo.httpServer()->sendHeader("Access-Control-Allow-Origin", "*"); // Adjust for production
-    gizmo.httpServer()->sendHeader("Access-Control-Allow-Methods", "GET, OPTIONS");
+    gizmo.httpServer()->sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
     gizmo.httpServer()->sendHeader("Access-Control-Allow-Headers", "Content-Type");
     gizmo.httpServer()->sendHeader("Access-Control-Max-Age", "86400");
 }
@@ -237,6 +553,21 @@ void handleDiagnostics() {
     server->send(200, "text/plain", diagnosticsOn ? "on\n" : "off\n");
 }
 
+// Sets this lamp's position in a row of lamps sharing one virtual strip, e.g. /span?position=2;
+// any other position leaves the span.
+void handleSpan() {
+    ESP8266WebServer *server = gizmo.httpServer();
+    if (server->hasArg("position")) {
+        String position = server->arg("position");
+        saveSpan(position.length() && isdigit(position[0]) ? position.toInt() : -1);
+        layoutSpan(&front);
+    }
+    char status[48];
+    snprintf(status, sizeof(status), spanPosition ? "position %d, pixels %d-%d of %d\n" : "off\n",
+             spanPosition - 1, front.offset, front.offset + front.count - 1, front.span);
+    server->send(200, "text/plain", status);
+}
+
 void handleAlwaysPaired() {
     ESP8266WebServer *server = gizmo.httpServer();
     alwaysPaired = !alwaysPaired;
@@ -244,15 +575,217 @@ void handleAlwaysPaired() {
     server->send(200, "text/plain", alwaysPaired ? "on\n" : "off\n");
 }
 
+// GET returns the program in a slot as hex; POST validates and installs the hex
+// program in the body, e.g. /api/program?slot=1 with body "0118...".
+void handleProgram() {
+    ESP8266WebServer *server = gizmo.httpServer();
+    sendCorsHeaders();
+    int slot = server->arg("slot").toInt() - 1;
+    if (slot < 0 || slot >= PROGRAMS) {
+        server->send(400, "text/plain", "slot must be 1-4\n");
+        return;
+    }
+
+    static const char hex[] = "0123456789abcdef";
+    if (server->method() == HTTP_GET) {
+        char text[PROGRAM_SIZE * 2 + 2] = {0};
+        ProgramCode *p = activeProgram(slot);
+        for (uint8_t i = 0; p && i < p->len; i++) {
+            text[2 * i] = hex[p->code[i] >> 4];
+            text[2 * i + 1] = hex[p->code[i] & 0xF];
+        }
+        strcat(text, "\n");
+        server->send(200, "text/plain", text);
+        return;
+    }
+
+    String plain = server->arg("plain");
+    uint8_t code[PROGRAM_SIZE];
+    int len = 0;
+    const char *error = NULL;
+    for (const char *p = plain.c_str(); *p && !error; p++) {
+        const char *d = strchr(hex, tolower(*p));
+        if (isspace(*p)) {
+            continue;
+        } else if (!d) {
+            error = "program must be hex";
+        } else if (len == 2 * PROGRAM_SIZE) {
+            error = "program too long";
+        } else {
+            code[len / 2] = len & 1 ? code[len / 2] << 4 | (d - hex) : d - hex;
+            len++;
+        }
+    }
+    if (!error && len & 1) {
+        error = "odd number of hex digits";
+    }
+    if (!error) {
+        error = installProgram(slot, code, len / 2, true);
+    }
+    if (error) {
+        server->send(error == programBusy ? 503 : 400, "text/plain", String(error) + "\n");
+    } else {
+        server->send(200, "text/plain", "ok\n");
+    }
+}
+
+void httpChunkSink(const char *json, size_t length) {
+    gizmo.httpServer()->sendContent(json, length);
+}
+
+// Collects the requested properties for a strip either from "<strip>.<property>" form/query
+// arguments or from the "<strip>" object of a JSON body.
+void readStripUpdate(StripUpdate *u, Strip *s, const char *body) {
+    memset(u, 0, sizeof(StripUpdate));
+    if (body) {
+        const char *obj = jsonMember(body, jsonSkipValue(body), s->name);
+        const char *end = obj && *obj == '{' ? jsonSkipValue(obj) : NULL;
+        if (end) {
+            jsonScalar(jsonMember(obj, end, "on"), u->on, sizeof(u->on));
+            jsonScalar(jsonMember(obj, end, "rgb"), u->rgb, sizeof(u->rgb));
+            jsonScalar(jsonMember(obj, end, "brightness"), u->brightness, sizeof(u->brightness));
+            jsonScalar(jsonMember(obj, end, "effect"), u->effect, sizeof(u->effect));
+        }
+    } else {
+        ESP8266WebServer *server = gizmo.httpServer();
+        char arg[32];
+        snprintf(arg, sizeof(arg), "%s.on", s->name);
+        strncat(u->on, server->arg(arg).c_str(), sizeof(u->on) - 1);
+        snprintf(arg, sizeof(arg), "%s.rgb", s->name);
+        strncat(u->rgb, server->arg(arg).c_str(), sizeof(u->rgb) - 1);
+        snprintf(arg, sizeof(arg), "%s.brightness", s->name);
+        strncat(u->brightness, server->arg(arg).c_str(), sizeof(u->brightness) - 1);
+        snprintf(arg, sizeof(arg), "%s.effect", s->name);
+        strncat(u->effect, server->arg(arg).c_str(), sizeof(u->effect) - 1);
+    }
+}
+
+bool isStripUpdateValid(StripUpdate *u) {
+    if (u->on[0] && strcmp(u->on, "on") && strcmp(u->on, "off") &&
+        strcmp(u->on, "true") && strcmp(u->on, "false")) {
+        return false;
+    }
+    if (u->brightness[0] && (strspn(u->brightness, "0123456789") != strlen(u->brightness) || atoi(u->brightness) > 255)) {
+        return false;
+    }
+    if (u->rgb[0] == '#' && (strlen(u->rgb) != 7 || strspn(u->rgb + 1, "0123456789abcdefABCDEF") != 6)) {
+        return false;
+    }
+    if (u->effect[0] && randomMode(u->effect) == NOT_RANDOM &&
+        strcmp(findPattern(u->effect)->name, u->effect)) {
+        return false;
+    }
+    return true;
+}
+
+// Queues all requested properties of a strip; an explicit on/off request is queued
+// last so that it takes precedence over the implicit one from brightness.
+void queueStripUpdate(StripUpdate *u, Strip *s) {
+    if (u->rgb[0]) {
+        queueStripCommand(s, RGB_PROPERTY, u->rgb);
+    }
+    if (u->brightness[0]) {
+        queueStripCommand(s, BRIGHTNESS_PROPERTY, u->brightness);
+    }
+    if (u->effect[0]) {
+        queueStripCommand(s, EFFECT_PROPERTY, u->effect);
+    }
+    if (u->on[0]) {
+        queueStripCommand(s, POWER_PROPERTY, !strcmp(u->on, "on") || !strcmp(u->on, "true") ? "on" : "off");
+    }
+}
+
+// Batched state API: applies any subset of properties for both strips as a single
+// transition, with one save, sync and broadcast, and responds with the resulting state.
+void handleApiState() {
+    ESP8266WebServer *server = gizmo.httpServer();
+    sendCorsHeaders();
+
+    String plain = server->arg("plain");
+    const char *body = NULL;
+    if (plain[0] == '{') {
+        body = plain.c_str();
+        if (!jsonSkipValue(body)) {
+            server->send(400, "text/plain", "malformed JSON\n");
+            return;
+        }
+    }
+
+    StripUpdate fu, bu;
+    readStripUpdate(&fu, &front, body);
+    readStripUpdate(&bu, &back, body);
+    if (!isStripUpdateValid(&fu) || !isStripUpdateValid(&bu)) {
+        server->send(400, "text/plain", "invalid value\n");
+        return;
+    }
+
+    queueStripUpdate(&fu, &front);
+    queueStripUpdate(&bu, &back);
+    applyStripCommands();
+
+    JsonWriter w;
+    server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server->send(200, "application/json", "");
+    jsonBegin(&w, httpChunkSink, true);
+    writeState(&w, false);
+    jsonEnd(&w);
+    server->sendContent("");
+}
+
+void handleMqttJson() {
+    ESP8266WebServer *server = gizmo.httpServer();
+    mqttJson = !mqttJson;
+    saveFlag(mqttJson, MQTT_JSON);
+    pendingJsonState = mqttJson ? 0x3 : 0;
+    server->send(200, "text/plain", mqttJson ? "on\n" : "off\n");
+}
+
+uint8_t stripBit(Strip *strip) {
+    return strip == &front ? 0x1 : 0x2;
+}
+
 void publishState(const char *topic, const char *value, Strip *strip) {
+    if (mqttJson) {
+        pendingJsonState |= stripBit(strip);
+        return;
+    }
     char stateTopic[64];
     snprintf(stateTopic, 64, "%%s/%s%s", strip->name, topic);
     gizmo.publish(stateTopic, (char *) value, true);
 }
 
+// Publishes the retained JSON state of any strips changed since the last call.
+void publishJsonState() {
+    Strip *strips[] = {&front, &back};
+    for (Strip *strip : strips) {
+        if (!(pendingJsonState & stripBit(strip))) {
+            continue;
+        }
+        JsonWriter w;
+        jsonBegin(&w, NULL, false);
+        jsonObjectBegin(&w, NULL);
+        jsonString(&w, "state", strip->on ? "ON" : "OFF");
+        jsonUInt(&w, "brightness", strip->brightness);
+        jsonString(&w, "color_mode", "rgb");
+        jsonObjectBegin(&w, "color");
+        jsonUInt(&w, "r", strip->color.red);
+        jsonUInt(&w, "g", strip->color.green);
+        jsonUInt(&w, "b", strip->color.blue);
+        jsonObjectEnd(&w);
+        jsonString(&w, "effect", effect(strip));
+        jsonObjectEnd(&w);
+        if (jsonEnd(&w)) {
+            char stateTopic[64];
+            snprintf(stateTopic, 64, "%%s/%s/json/state", strip->name);
+            gizmo.publish(stateTopic, jsonBuf, true);
+        }
+    }
+    pendingJsonState = 0;
+}
+
 void onOff(bool on) {
-    processCallback("/power", on ? "on" : "off", &front);
-    processCallback("/power", on ? "on" : "off", &back);
+    processCallback(POWER_PROPERTY, on ? "on" : "off", &front);
+    processCallback(POWER_PROPERTY, on ? "on" : "off", &back);
 }
 
 // Command processors
@@ -330,64 +863,243 @@ void processEffect(const char *value, Strip *strip, boolean turnOn) {
     publishState("/effect/state", strip->pattern->name, strip);
 }
 
-void processCallback(const char *topic, const char *value, Strip *strip) {
-    if (strstr(topic, "/rgb")) {
-        processColor(value, strip, strip->on);
-    } else if (strstr(topic, "/brightness")) {
-        processBrightness(value, strip);
-    } else if (strstr(topic, "/effect")) {
-        processEffect(value, strip, strip->on);
-    } else if (strstr(topic, "/fav")) {
-        strip->pattern->favorite = !strip->pattern->favorite;
-        saveFavorites();
-        if (!strip->pattern->favorite) {
-            strip->pattern = randomPattern(strip);
-        }
+// Applies a Home Assistant JSON schema command, e.g.
+// {"state": "ON", "brightness": 128, "color": {"r": 255, "g": 128, "b": 0}, "effect": "fire"}
+void processJson(const char *value, Strip *strip) {
+    const char *end = value[0] == '{' ? jsonSkipValue(value) : NULL;
+    if (!end) {
+        gizmo.debug("Malformed JSON command for %s", strip->name);
+        return;
+    }
+
+    StripUpdate u;
+    memset(&u, 0, sizeof(u));
+    if (jsonScalar(jsonMember(value, end, "state"), u.on, sizeof(u.on))) {
+        strcpy(u.on, !strcmp(u.on, "ON") ? "on" : "off");
+    }
+    jsonScalar(jsonMember(value, end, "brightness"), u.brightness, sizeof(u.brightness));
+    jsonScalar(jsonMember(value, end, "effect"), u.effect, sizeof(u.effect));
+
+    const char *color = jsonMember(value, end, "color");
+    const char *colorEnd = color && *color == '{' ? jsonSkipValue(color) : NULL;
+    if (colorEnd) {
+        char r[4] = "0", g[4] = "0", b[4] = "0";
+        jsonScalar(jsonMember(color, colorEnd, "r"), r, sizeof(r));
+        jsonScalar(jsonMember(color, colorEnd, "g"), g, sizeof(g));
+        jsonScalar(jsonMember(color, colorEnd, "b"), b, sizeof(b));
+        snprintf(u.rgb, sizeof(u.rgb), "%s,%s,%s", r, g, b);
+    }
+
+    if (isStripUpdateValid(&u)) {
+        queueStripUpdate(&u, strip);
+    }
+}
 
+void processCallback(StripProperty property, const char *value, Strip *strip) {
+    if (property == JSON_PROPERTY) {
+        processJson(value, strip);
     } else {
-        processOnOff(value, strip);
+        queueStripCommand(strip, property, value);
     }
-    saveState();
-    syncPattern(strip);
-    syncColorSettings(strip);
-    requestSamples();
-    broadcastState(false);
+}
+
+// Queues a strip mutation. A pending command for the same strip and property is
+// replaced and moves to the tail, so that it still runs after everything queued
+// before it. Favorite toggles and scene commands do not collapse: each toggle
+// counts, and scene commands for different IDs share the NULL strip.
+StripCommand *queueCommand(Strip *strip, StripProperty property) {
+    stripCommandsQueued++;
+    if (property != FAV_PROPERTY && property != SCENE_PROPERTY && property != SAVE_SCENE_PROPERTY &&
+        property != PEER_SCENE_PROPERTY) {
+        for (uint8_t i = 0; i < stripCommandCount; i++) {
+            if (stripCommands[i].strip == strip && stripCommands[i].property == property) {
+                stripCommandsCollapsed++;
+                memmove(&stripCommands[i], &stripCommands[i + 1], (stripCommandCount - i - 1) * sizeof(StripCommand));
+                StripCommand *cmd = &stripCommands[stripCommandCount - 1];
+                cmd->strip = strip;
+                cmd->property = property;
+                return cmd;
+            }
+        }
+    }
+    if (stripCommandCount == MAX_STRIP_COMMANDS) {
+        applyStripCommands();
+    }
+    StripCommand *cmd = &stripCommands[stripCommandCount++];
+    stripCommandPeak = max(stripCommandPeak, stripCommandCount);
+    cmd->strip = strip;
+    cmd->property = property;
+    return cmd;
+}
+
+void queueStripCommand(Strip *strip, StripProperty property, const char *value) {
+    StripCommand *cmd = queueCommand(strip, property);
+    cmd->text[0] = '\0';
+    strncat(cmd->text, value, sizeof(cmd->text) - 1);
+}
+
+// Applies a single queued command; returns true if it was a local change that needs saving and syncing.
+bool applyStripCommand(StripCommand *cmd) {
+    Strip *strip = cmd->strip;
+    switch (cmd->property) {
+        case RGB_PROPERTY:
+            processColor(cmd->text, strip, strip->on);
+            break;
+        case BRIGHTNESS_PROPERTY:
+            processBrightness(cmd->text, strip);
+            break;
+        case EFFECT_PROPERTY:
+            processEffect(cmd->text, strip, strip->on);
+            break;
+        case FAV_PROPERTY:
+            strip->pattern->favorite = !strip->pattern->favorite;
+            saveFavorites();
+            if (!strip->pattern->favorite) {
+                strip->pattern = randomPattern(strip);
+            }
+            fullStateRequested = true;
+            break;
+        case PEER_PATTERN_PROPERTY:
+            strip->pattern = cmd->pattern;
+            return false;
+        case PEER_COLORS_PROPERTY:
+            copyStripColorSettings(strip, cmd->colors);
+            return false;
+        case SCENE_PROPERTY:
+            if (recallScene(cmd->scene.id)) {
+                sceneRecalled = true;
+            }
+            return false;
+        case SAVE_SCENE_PROPERTY:
+            saveScene(cmd->scene.id);
+            return false;
+        case PEER_SCENE_PROPERTY:
+            copyScene(cmd->scene.id, cmd->scene.crc);
+            return false;
+        case ALL_POWER_PROPERTY:
+            strip->on = !strcmp(cmd->text, "on");
+            saveRequested = true;
+            return false;
+        default:
+            processOnOff(cmd->text, strip);
+            break;
+    }
+    return true;
+}
+
+// Applies all queued strip mutations in order, then saves, syncs and broadcasts once.
+void applyStripCommands() {
+    bool changed[2] = {false, false};
+    uint8_t n = stripCommandCount;
+    stripCommandCount = 0;
+    stripCommandDepth = n;
+    for (uint8_t i = 0; i < n; i++) {
+        if (applyStripCommand(&stripCommands[i])) {
+            changed[stripCommands[i].strip == &front ? 0 : 1] = true;
+        }
+    }
+
+    // A recalled scene has already been sent to peers as a single SCENE op. Legacy peers
+    // don't know that op, so they get both strips as well.
+    bool syncRecall = sceneRecalled && legacyMembers;
+    if (changed[0] || changed[1] || sceneRecalled) {
+        saveState();
+        syncStrips(changed[0] || syncRecall, changed[1] || syncRecall);
+        requestSamples();
+    } else if (saveRequested) {
+        saveState();
+    }
+    if (changed[0] || changed[1] || sceneRecalled || saveRequested || fullStateRequested) {
+        broadcastState(fullStateRequested);
+        fullStateRequested = false;
+        saveRequested = false;
+        sceneRecalled = false;
+    }
+}
+
+// Recalls a scene by ID ("3"), or saves the current state as one ("save 3").
+bool processScene(const char *value) {
+    bool save = !strncmp(value, "save ", 5);
+    int id = atoi(save ? value + 5 : value);
+    if (!isSceneId(id)) {
+        gizmo.debug("No such scene: %s", value);
+        return false;
+    }
+    StripCommand *cmd = queueCommand(NULL, save ? SAVE_SCENE_PROPERTY : SCENE_PROPERTY);
+    cmd->scene.id = id;
+    return true;
 }
 
 void processSync(const char *value) {
     syncWithMaster = !strcmp(value, "on");
     saveState();
-    determineMaster();
+    updateMaster();
     if (syncWithMaster) {
         requestSync();
     }
 }
 
+// Finds the route for the topic segment of the given length, or NULL.
+TopicRoute *findTopicRoute(const char *segment, size_t len) {
+    for (size_t i = 0; i < ARRAY_SIZE(topicRoutes); i++) {
+        if (!strncmp(segment, topicRoutes[i].name, len) && !topicRoutes[i].name[len]) {
+            return &topicRoutes[i];
+        }
+    }
+    return NULL;
+}
+
+// Finds the strip property for the trailing topic segment; anything unknown is on/off.
+StripProperty findProperty(const char *segment) {
+    for (size_t i = 0; i < ARRAY_SIZE(propertyRoutes); i++) {
+        if (!strcmp(segment, propertyRoutes[i].name)) {
+            return propertyRoutes[i].property;
+        }
+    }
+    return POWER_PROPERTY;
+}
+
 void mqttCallback(char *topic, uint8_t *payload, unsigned int length) {
-    char value[64];
+    char value[128];
     value[0] = '\0';
-    strncat(value, (char *) payload, length);
+    strncat(value, (char *) payload, length < sizeof(value) ? length : sizeof(value) - 1);
 
     Serial.printf("%s: %s\n", topic, value);
 
-    if (strstr(topic, "/all")) {
-        front.on = back.on = !strcmp(value, "on");
-        gizmo.schedulePublish("%s/all/state", front.on ? "on" : "off");
-        saveState();
-
-    } else if (strstr(topic, "/front")) {
-        processCallback(topic, value, &front);
-    } else if (strstr(topic, "/back")) {
-        processCallback(topic, value, &back);
-
-    } else if (strstr(topic, "/sleep")) {
-        sleepTime = !strcmp(value, "on") ? (millis() + SLEEP_TIMEOUT) : 0;
-
-    } else if (strstr(topic, "/sync")) {
-        processSync(value);
+    // Topics come in as "<host>/<route>[/<property>]" from MQTT and "/<route>[/<property>]" from the web UI.
+    const char *segment = topic[0] == '/' ? topic : strchr(topic, '/');
+    TopicRoute *route = NULL;
+    const char *property = "";
+    if (segment) {
+        segment++;
+        const char *slash = strchr(segment, '/');
+        route = findTopicRoute(segment, slash ? slash - segment : strlen(segment));
+        property = slash ? slash + 1 : "";
+    }
 
-    } else {
+    if (!route) {
         gizmo.handleMQTTMessage(topic, value);
+        return;
+    }
+
+    switch (route->kind) {
+        case ALL_TOPIC:
+            queueStripCommand(&front, ALL_POWER_PROPERTY, !strcmp(value, "on") ? "on" : "off");
+            queueStripCommand(&back, ALL_POWER_PROPERTY, !strcmp(value, "on") ? "on" : "off");
+            gizmo.schedulePublish("%s/all/state", !strcmp(value, "on") ? "on" : "off");
+            break;
+        case STRIP_TOPIC:
+            processCallback(findProperty(property), value, route->strip);
+            break;
+        case SLEEP_TOPIC:
+            sleepTime = !strcmp(value, "on") ? (millis() + SLEEP_TIMEOUT) : 0;
+            break;
+        case SYNC_TOPIC:
+            processSync(value);
+            break;
+        case SCENE_TOPIC:
+            processScene(value);
+            break;
     }
 }
 
@@ -415,36 +1127,111 @@ void webSocketEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t length)
 void handleWsCommand(char *cmd) {
     char *t = strtok(cmd, "&");
     char *m = strtok(NULL, "&");
+    if (!t) {
+        return;
+    }
 
+    // Anything but "get" needs a value; a bare "get" asks for the state without favorites.
     if (strcmp(t, "get")) {
+        if (!m) {
+            return;
+        }
         mqttCallback(t, (uint8_t *) m, strlen(m));
     }
-    broadcastState(!strcmp(m, "all") || strstr(t, "/fav"));
-}
+    bool all = m && !strcmp(m, "all");
 
-#define STATUS \
-    "{%s,%s,\"master\": \"%s\",\"masterIp\": \"%s\",\"isMaster\": %s,\"hasPotentialMaster\": %s," \
-    "\"syncWithMaster\": %s,\"buddyAvailable\": %s,\"buddySilent\": %s,\"name\": \"%s\",%s" \
-    "\"sleep\": %lu,\"version\":\"" SW_VERSION "\"}"
+    // Strip changes are broadcast once they have been applied.
+    if (stripCommandCount) {
+        fullStateRequested |= all;
+    } else {
+        broadcastState(all);
+    }
+}
 
-void broadcastState(boolean all) {
-    char state[1024], f[128], b[128], favs[512];
-    state[0] = '\0';
-    favs[0] = '\0';
+void wsBroadcastSink(const char *json, size_t length) {
+    wsServer.broadcastTXT(json, length);
+}
 
+void writeState(JsonWriter *w, boolean all) {
+    jsonObjectBegin(w, NULL);
+    stripStatus(w, &front);
+    stripStatus(w, &back);
+    jsonString(w, "master", masterName());
+    jsonIp(w, "masterIp", masterIp);
+    jsonBool(w, "isMaster", isGroupMaster(WiFi.localIP()));
+    jsonBool(w, "hasPotentialMaster", hasOtherMaster());
+    jsonBool(w, "syncWithMaster", syncWithMaster);
+    jsonBool(w, "buddyAvailable", buddyAvailable);
+    jsonBool(w, "buddySilent", buddySilent);
+    jsonString(w, "name", peers[0].name);
     if (all) {
-        favorites(favs);
+        favorites(w);
     }
+    jsonObjectBegin(w, "peers");
+    jsonUInt(w, "members", memberCount);
+    jsonUInt(w, "packets", peerStats.rxPackets);
+    jsonUInt(w, "ops", peerStats.rxOps);
+    jsonUInt(w, "rejected", peerStats.rxRejected);
+    jsonUInt(w, "sent", peerStats.txPackets);
+    jsonUInt(w, "usPerPacket", peerStats.rxPackets ? peerStats.rxMicros / peerStats.rxPackets : 0);
+    jsonObjectEnd(w);
+    jsonObjectBegin(w, "span");
+    jsonUInt(w, "position", spanPosition);
+    jsonUInt(w, "offset", front.offset);
+    jsonUInt(w, "length", virtualLength(&front));
+    jsonInt(w, "clockOffset", clockOffset);
+    jsonObjectEnd(w);
+    jsonObjectBegin(w, "scenes");
+    jsonUInt(w, "recalls", sceneStats.recalls);
+    jsonUInt(w, "peerRecalls", sceneStats.peerRecalls);
+    jsonUInt(w, "misses", sceneStats.misses);
+    jsonUInt(w, "saves", sceneStats.saves);
+    jsonUInt(w, "received", sceneStats.received);
+    jsonUInt(w, "applyMicros", sceneStats.applyMicros);
+    jsonObjectEnd(w);
+    jsonObjectBegin(w, "recovery");
+    jsonString(w, "stage", recoveryStages[recovery.stage]);
+    jsonUInt(w, "recoveries", recovery.recoveries);
+    jsonString(w, "lastStage", recoveryStages[recovery.lastStage]);
+    jsonUInt(w, "lastMillis", recovery.lastMillis);
+    jsonUInt(w, "rejoins", recovery.attempts[RECOVERY_REJOIN]);
+    jsonUInt(w, "rebinds", recovery.attempts[RECOVERY_REBIND]);
+    jsonUInt(w, "wifiCycles", recovery.attempts[RECOVERY_WIFI]);
+    jsonUInt(w, "reboots", recovery.reboots);
+    jsonObjectEnd(w);
+    jsonObjectBegin(w, "assets");
+    jsonUInt(w, "requests", assetStats.requests);
+    jsonUInt(w, "notModified", assetStats.notModified);
+    jsonUInt(w, "bytes", assetStats.bytes);
+    jsonUInt(w, "maxMicros", assetStats.maxMicros);
+    jsonObjectEnd(w);
+    jsonObjectBegin(w, "governor");
+    jsonString(w, "level", governorLevels[governor.level]);
+    jsonString(w, "cause", governor.cause);
+    jsonUInt(w, "load", governor.load);
+    jsonUInt(w, "renderLoad", governor.renderLoad);
+    jsonUInt(w, "netPeak", governor.netPeak);
+    jsonUInt(w, "overBudget", overBudgetPatterns());
+    jsonUInt(w, "changes", governor.changes);
+    jsonObjectEnd(w);
+    jsonObjectBegin(w, "commands");
+    jsonUInt(w, "depth", stripCommandDepth);
+    jsonUInt(w, "peak", stripCommandPeak);
+    jsonUInt(w, "queued", stripCommandsQueued);
+    jsonUInt(w, "collapsed", stripCommandsCollapsed);
+    jsonObjectEnd(w);
+    jsonUInt(w, "sleep", sleepTime ? (sleepTime - millis()) / 1000 : 0);
+    jsonString(w, "version", SW_VERSION);
+    jsonObjectEnd(w);
+}
 
-    snprintf(state, 1023, STATUS, stripStatus(f, &front), stripStatus(b, &back),
-             peers[master].name, IPAddress(peers[master].ip).toString().c_str(),
-             isMaster(WiFi.localIP()) ? "true" : "false",
-             hasPotentialMaster() ? "true" : "false",
-             syncWithMaster ? "true" : "false",
-             buddyAvailable ? "true" : "false",
-             buddySilent ? "true" : "false",
-             peers[0].name, favs, sleepTime ? (sleepTime - millis()) / 1000 : 0);
-    wsServer.broadcastTXT(state);
+void broadcastState(boolean all) {
+    JsonWriter w;
+    jsonBegin(&w, wsBroadcastSink, false);
+    writeState(&w, all);
+    if (!jsonEnd(&w)) {
+        gizmo.debug("State exceeds %d bytes; not sent", JSON_BUF_SIZE);
+    }
 }
 
 void onUpdate() {
@@ -466,71 +1253,113 @@ void requestSamples() {
 
 void sayHello() {
     Command cmd = {.src = peers[0].ip, .ctx = GROUP_MASK, .op = CHOP(HELLO), .data = {[0] = 0}};
-    strncat((char *) cmd.data, peers[0].name, MAX_CMD_DATA);
+    strncat((char *) cmd.data, peers[0].name, MAX_CMD_DATA - 2);
+    // Advertise our HELLO interval and span after the name; older lamps ignore them.
+    size_t n = strlen((char *) cmd.data);
+    cmd.data[n + 1] = helloInterval / 1000;
+    if (n + 2 + SPAN_HELLO_SIZE <= MAX_CMD_DATA) {
+        writeSpanHello(cmd.data + n + 2, &front);
+    }
     broadcast(cmd);
 }
 
-void syncPattern(Strip *s) {
-    uint16_t ctx = s == &front ? FRONT_CTX : BACK_CTX;
-    Command cmd = {.src = (uint32_t) WiFi.localIP(), .ctx = ctx, .op = CHOP(PATTERN), .data = {[0] = 0}};
-    strncat((char *) cmd.data, s->pattern->name, MAX_CMD_DATA);
-    broadcast(cmd);
+// Sends an envelope to the sync group as one datagram of its own length.
+void multicastSink(const uint8_t *packet, size_t len) {
+    group.beginPacketMulticast(IPAddress(groupIp), group.localPort(), WiFi.localIP());
+    group.write(packet, len);
+    group.endPacket();
 }
 
-void syncColorSettings(Strip *s) {
-    uint16_t ctx = s == &front ? FRONT_CTX : BACK_CTX;
-    Command cmd = {.src = (uint32_t) WiFi.localIP(), .ctx = ctx, .op = CHOP(COLORS), .data = {[0] = 0}};
-    cmd.data[0] = s->on;
-    cmd.data[1] = s->hue;
-    cmd.data[2] = s->brightness;
-    cmd.data[3] = s->color.raw[0];
-    cmd.data[4] = s->color.raw[1];
-    cmd.data[5] = s->color.raw[2];
+// Envelopes are only understood by lamps that advertise their HELLO interval, and
+// can only be addressed once the group has been heard from.
+void beginSync(Envelope *e) {
+    envelopeBegin(e, (uint32_t) WiFi.localIP(), !legacyMembers && groupIp ? multicastSink : NULL);
+}
+
+void addPattern(Envelope *e, Strip *s) {
+    envelopeAdd(e, s == &front ? FRONT_CTX : BACK_CTX, PATTERN,
+                (const uint8_t *) s->pattern->name, strlen(s->pattern->name) + 1);
+}
+
+void addColorSettings(Envelope *e, Strip *s) {
+    uint8_t data[COLOR_SETTINGS_SIZE];
+    data[0] = s->on;
+    data[1] = s->hue;
+    data[2] = s->brightness;
+    data[3] = s->color.raw[0];
+    data[4] = s->color.raw[1];
+    data[5] = s->color.raw[2];
 
     for (int i = 0, di = 6; i < 16; i++, di += 3) {
-        cmd.data[di + 0] = s->targetPalette.entries[i].raw[0];
-        cmd.data[di + 1] = s->targetPalette.entries[i].raw[1];
-        cmd.data[di + 2] = s->targetPalette.entries[i].raw[2];
+        data[di + 0] = s->targetPalette.entries[i].raw[0];
+        data[di + 1] = s->targetPalette.entries[i].raw[1];
+        data[di + 2] = s->targetPalette.entries[i].raw[2];
     }
 
-    cmd.data[32] = (uint8_t) sleepDimmer;
+    data[COLOR_SETTINGS_DIMMER] = (uint8_t) sleepDimmer;
+    data[COLOR_SETTINGS_BLUE8] = s->targetPalette.entries[8].raw[2];
 
-    broadcast(cmd);
+    envelopeAdd(e, s == &front ? FRONT_CTX : BACK_CTX, COLORS, data, sizeof(data));
 }
 
+void syncPattern(Strip *s) {
+    Envelope e;
+    beginSync(&e);
+    addPattern(&e, s);
+    envelopeEnd(&e);
+}
 
-void copyPattern(Command command) {
-    if (isMaster(command.src)) {
-        if (command.ctx == FRONT_CTX) {
-            front.pattern = findPattern((char *) command.data);
-        } else if (command.ctx == BACK_CTX) {
-            back.pattern = findPattern((char *) command.data);
-        }
+void syncColorSettings(Strip *s) {
+    Envelope e;
+    beginSync(&e);
+    addColorSettings(&e, s);
+    envelopeEnd(&e);
+}
+
+// Sends color settings and pattern of the given strips, batched where peers allow it.
+void syncStrips(bool syncFront, bool syncBack) {
+    Envelope e;
+    beginSync(&e);
+    if (syncFront) {
+        addColorSettings(&e, &front);
+        addPattern(&e, &front);
+    }
+    if (syncBack) {
+        addColorSettings(&e, &back);
+        addPattern(&e, &back);
+    }
+    envelopeEnd(&e);
+}
+
+void copyPattern(const CommandView *command) {
+    if (isGroupMaster(command->src) && (command->ctx == FRONT_CTX || command->ctx == BACK_CTX)) {
+        StripCommand *cmd = queueCommand(command->ctx == FRONT_CTX ? &front : &back, PEER_PATTERN_PROPERTY);
+        cmd->pattern = findPattern((const char *) command->data);
     }
 }
 
-void copyStripColorSettings(Strip *s, Command cmd) {
-    s->on = cmd.data[0] && cmd.data[2];
-    s->hue = cmd.data[1];
-    s->brightness = cmd.data[2];
-    s->color.raw[0] = cmd.data[3];
-    s->color.raw[1] = cmd.data[4];
-    s->color.raw[2] = cmd.data[5];
+void copyStripColorSettings(Strip *s, const uint8_t *data) {
+    s->on = data[0] && data[2];
+    s->hue = data[1];
+    s->brightness = data[2];
+    s->color.raw[0] = data[3];
+    s->color.raw[1] = data[4];
+    s->color.raw[2] = data[5];
     for (int i = 0, di = 6; i < 16; i++, di += 3) {
-        s->targetPalette.entries[i].raw[0] = cmd.data[di + 0];
-        s->targetPalette.entries[i].raw[1] = cmd.data[di + 1];
-        s->targetPalette.entries[i].raw[2] = cmd.data[di + 2];
+        s->targetPalette.entries[i].raw[0] = data[di + 0];
+        s->targetPalette.entries[i].raw[1] = data[di + 1];
+        s->targetPalette.entries[i].raw[2] = data[di + 2];
     }
-    sleepDimmer = (uint32_t) cmd.data[32];
+    s->targetPalette.entries[8].raw[2] = data[COLOR_SETTINGS_BLUE8];
+    sleepDimmer = (uint32_t) data[COLOR_SETTINGS_DIMMER];
 }
 
-void copyColorSettings(Command command) {
-    if (isMaster(command.src)) {
-        if (command.ctx == FRONT_CTX) {
-            copyStripColorSettings(&front, command);
-        } else if (command.ctx == BACK_CTX) {
-            copyStripColorSettings(&back, command);
-        }
+void copyColorSettings(const CommandView *command) {
+    if (isGroupMaster(command->src) && (command->ctx == FRONT_CTX || command->ctx == BACK_CTX)) {
+        StripCommand *cmd = queueCommand(command->ctx == FRONT_CTX ? &front : &back, PEER_COLORS_PROPERTY);
+        memcpy(cmd->colors, command->data, COLOR_SETTINGS_BLUE8);
+        // Single Commands may come from older lamps, which leave the last byte out or zero.
+        cmd->colors[COLOR_SETTINGS_BLUE8] = command->data[command->command ? COLOR_SETTINGS_DIMMER : COLOR_SETTINGS_BLUE8];
     }
 }
 
@@ -542,36 +1371,28 @@ void pruneSample() {
     }
 }
 
+// Works through the recovery stages in recovery.h while we hear nobody; rebooting is the last of them.
 void handleMulticastRepair() {
-    if (!buddyAvailable && !peerCount) {
+    uint32_t now = millis();
+    if (!buddyAvailable && !memberCount) {
         if (!homeAlone) {
-            homeAlone = millis();
+            homeAlone = now;
         }
     } else {
         homeAlone = 0;
+        recoveryDone(now);
     }
 
-    if (homeAlone && homeAlone + ALONE_TIMEOUT < millis()) {
-        homeAlone = 0;
-        gizmo.scheduleRestart();
+    if (homeAlone && homeAlone + ALONE_TIMEOUT < now) {
+        recoveryStep(now);
     }
 }
 
 void prunePeers() {
     uint32_t now = millis();
-    bool hadPeersOrBuddy = peerCount || buddyAvailable;
-
-    peerCount = 0;
-    for (int i = 1; i < MAX_PEERS; i++) {
-        if (peers[i].ip && peers[i].lastHeard && peers[i].lastHeard + PEER_TIMEOUT < now) {
-            gizmo.debug("Deleted peer %s", IPAddress(peers[i].ip).toString().c_str());
-            peers[i].ip = 0;
-            peers[i].lastHeard = 0;
-        } else if (peers[i].ip) {
-            peerCount++;
-        }
-    }
-    determineMaster();
+    bool hadPeersOrBuddy = memberCount || buddyAvailable;
+
+    pruneMembers(now);
 
     if (buddyTimestamp && buddyTimestamp + PEER_TIMEOUT < now) {
         buddyAvailable = false;
@@ -585,62 +1406,71 @@ void prunePeers() {
         handleMulticastRepair();
     }
 
-    gizmo.debug("peerCount=%d, buddyAvailable=%d", peerCount, buddyAvailable);
+    gizmo.debug("memberCount=%d, helloInterval=%d, buddyAvailable=%d", memberCount, helloInterval, buddyAvailable);
 }
 
 void handlePeers() {
     EVERY_N_SECONDS(1)
     {
         prunePeers();
-        sayHello();
         requestSamples();
+        layoutSpan(&front);
+    }
+
+    if (helloDue(millis())) {
+        sayHello();
     }
 
-    Command command;
     while (group.parsePacket()) {
-        int len = group.read((char *) &command, sizeof(command));
+        int len = group.read((char *) peerPacket.bytes, sizeof(peerPacket));
         if (len < 0) {
             gizmo.debug("Unable to read command!!!!");
         } else {
-            handlePeer(command);
+            uint32_t start = micros();
+            noteGroupPacket();
+            peerStats.rxOps += decodePeerPacket(peerPacket.bytes, len, handlePeer);
+            peerStats.rxMicros += micros() - start;
+            peerStats.rxPackets++;
         }
     }
 }
 
 static uint8_t pon = 128;
 
-void handlePeer(Command command) {
-    uint8_t ch = CH(command.op);
-    uint16_t op = OP(command.op);
+void handlePeer(const CommandView *command) {
+    uint16_t op = command->op;
 
-    if (command.src != (uint32_t) WiFi.localIP() && ch == channel) {
+    if (command->src != (uint32_t) WiFi.localIP() && command->ch == channel && command->len) {
         bool wasSilent = buddySilent;
         switch (op) {
             case SAMPLE:
-                handleSample(command);
+                if (command->command) {
+                    handleSample(command->command);
+                }
                 break;
 
             case HELLO:
-                if (command.ctx & GROUP_MASK) {
-                    addPeer(command.src, (char *) command.data);
-                    determineMaster();
+                if ((command->ctx & GROUP_MASK) && viewHasString(command)) {
+                    const char *name = (const char *) command->data;
+                    size_t n = strlen(name);
+                    helloFromMember(command->src, name, n + 1 < command->len ? command->data[n + 1] * 1000 : 0);
+                    if (n + 2 < command->len) {
+                        spanFromHello(command->src, command->data + n + 2, command->len - (n + 2));
+                    }
                 }
                 break;
             case SYNC_REQ:
-                if (command.ctx & GROUP_MASK) {
-                    syncColorSettings(&front);
-                    syncPattern(&front);
-                    syncColorSettings(&back);
-                    syncPattern(&back);
+                if (command->ctx & GROUP_MASK) {
+                    syncStrips(true, true);
                 }
                 break;
             case PATTERN:
-                if (command.ctx & GROUP_MASK) {
+                if ((command->ctx & GROUP_MASK) && viewHasString(command)) {
                     copyPattern(command);
                 }
                 break;
             case COLORS:
-                if (command.ctx & GROUP_MASK) {
+                if ((command->ctx & GROUP_MASK) && command->len >= (command->command ? COLOR_SETTINGS_BLUE8 : COLOR_SETTINGS_SIZE)) {
                     copyColorSettings(command);
                 }
                 break;
@@ -649,19 +1479,32 @@ void handlePeer(Command command) {
                     broadcastState(false);
                     gizmo.debug("Discovered buddy");
                 }
-                buddyIp = command.src;
+                buddyIp = command->src;
                 buddyAvailable = true;
                 buddyTimestamp = millis();
-                buddySilent = command.data[0];
+                buddySilent = command->data[0];
                 if (buddySilent != wasSilent) {
                     broadcastState(false);
                 }
                 break;
+            case SCENE:
+                if ((command->ctx & GROUP_MASK) && isGroupMaster(command->src) && command->len >= SCENE_OP_SIZE &&
+                    command->data[0] == SCENE_VERSION) {
+                    StripCommand *cmd = queueCommand(NULL, PEER_SCENE_PROPERTY);
+                    cmd->scene.id = command->data[1];
+                    cmd->scene.crc = command->data[2] | command->data[3] << 8;
+                }
+                break;
+            case SCENE_DATA:
+                if ((command->ctx & GROUP_MASK) && isGroupMaster(command->src)) {
+                    sceneDataFromPeer(command->data, command->len);
+                }
+                break;
             case POWER_ON_OFF:
-                if (command.ctx & GROUP_MASK) {
-                    if (command.data[0] != pon) {
+                if (command->ctx & GROUP_MASK) {
+                    if (command->data[0] != pon) {
                         onOff(!front.on);
-                        pon = command.data[0];
+                        pon = command->data[0];
                     }
                 }
                 break;
@@ -671,50 +1514,187 @@ void handlePeer(Command command) {
     }
 }
 
-void handleSample(Command cmd) {
+void handleSample(const Command *cmd) {
     MicSample sample;
-    decodeSample(&cmd, &sample);
+    decodeSample((Command *) cmd, &sample);
     samplepeak = sample.samplepeak;
     sampleavg = sample.sampleavg;
     oldsample = sample.oldsample;
     lastSample = millis();
 }
 
-void handleLEDs(Strip *strip) {
+// Renders and shows the next frame of a strip, if one is due. Render side only.
+bool renderStrip(Strip *strip) {
     if (strip->on && strip->pattern) {
-        uint32_t renderPause =
-                strip->pattern->renderPause > 0 ? strip->pattern->renderPause : -strip->pattern->renderPause;
+        uint32_t renderPause = governedPause(strip->pattern,
+                strip->pattern->renderPause > 0 ? strip->pattern->renderPause : -strip->pattern->renderPause);
 
+        // Palette blending and hue cycling catch up on every period that has passed,
+        // so that slow frames do not slow them down.
         if (strip->pattern->renderPause > 0) {
-            EVERY_X_MILLIS(strip->tb, 20)
-                uint8_t maxChanges = 24;
+            uint8_t steps = dueSteps(&strip->tb, 20);
+            if (steps) {
+                uint8_t maxChanges = min(255, 24 * steps);
                 nblendPaletteTowardPalette(strip->currentPalette, strip->targetPalette, maxChanges);
             }
         }
 
         if (strip->pattern->huePause > 0) {
-            EVERY_X_MILLIS(strip->th, strip->pattern->huePause)
-                strip->hue++; // slowly cycle the "base color" through the rainbow
-            }
+            strip->hue += dueSteps(&strip->th, strip->pattern->huePause); // slowly cycle the "base color" through the rainbow
         }
 
+        uint32_t due = strip->t1 + 1;
         EVERY_X_MILLIS(strip->t1, renderPause)
-            strip->pattern->renderer(strip);
-            strip->leds[0] = WiFi.status() != WL_CONNECTED ? CRGB::Red : strip->leds[0];
-            showDiagnostics(strip);
-            strip->ctl->showLeds(
-                    sleepDimmer < 100 ? (uint8_t)((sleepDimmer * strip->brightness) / 100) : strip->brightness);
+            // Patterns that render every pass have no deadline to be late for.
+            if (renderPause) {
+                governorLate(millis() - due, renderPause + 1);
+            }
+            // Under load the back strip mirrors the front rather than rendering its own pattern.
+            bool dedupe = strip == &renderStrips[1] && governorDedupes() && renderStrips[0].on && renderStrips[0].pattern;
+            uint32_t start = micros();
+            frameTime(strip);
+            if (dedupe) {
+                copyFront(strip);
+            } else {
+                strip->pattern->renderer(strip);
+            }
+            uint32_t rendered = micros();
+            showFrame(strip);
+            governorRender(dedupe ? NULL : strip->pattern, rendered - start, micros() - start);
+            return true;
         }
-    } else {
-        blend(strip, strip->on ? strip->color : CRGB::Black, 0, strip->count);
-        strip->leds[0] = WiFi.status() != WL_CONNECTED ? CRGB::Red : strip->leds[0];
-        showDiagnostics(strip);
-        strip->ctl->showLeds(strip->brightness);
+        return false;
     }
 
+    uint32_t start = micros();
+    frameTime(strip);
+    blendPixelsToward(strip->leds, strip->count, strip->on ? strip->color : CRGB::Black, transitionFade(strip));
+    showFrame(strip);
+    governorRender(NULL, 0, micros() - start);
+    return true;
+}
+
+// Records the time elapsed since the strip was last rendered, for the frame helpers in simple.h.
+// The first render, or one after a long stall, counts as a single tuned frame.
+void frameTime(Strip *strip) {
+    uint32_t now = millis();
+    uint32_t dt = now - strip->tr;
+    strip->dt = strip->tr && dt < 250 ? dt : framePeriod(strip);
+    strip->tr = now;
+}
+
+// Overlays composited over every shown frame, in order.
+Overlay overlays[] = {wifiOverlay, diagnosticsOverlay};
+
+// Composites the overlays and pushes the frame; the one place a frame goes out.
+void showFrame(Strip *strip) {
+    for (uint8_t i = 0; i < ARRAY_SIZE(overlays); i++) {
+        overlays[i](strip);
+    }
+    showOutput(strip, sleepFade());
+}
+
+void wifiOverlay(Strip *strip) {
+    if (WiFi.status() != WL_CONNECTED) {
+        setOverlay(strip, 0, CRGB::Red);
+    }
+}
+
+// Current sleep dimming on a 0..255 scale. While our own sleep timer is fading out, this
+// follows the timer continuously rather than the whole percent steps synced to peers.
+uint8_t sleepFade() {
+    uint32_t now = millis();
+    if (sleepTime && sleepTime > now && sleepTime - now < SLEEP_FADE_DURATION) {
+        return (sleepTime - now) * 255 / SLEEP_FADE_DURATION;
+    }
+    return sleepDimmer < 100 ? sleepDimmer * 255 / 100 : 255;
+}
+
+void applyRenderCommand(Strip *strip, RenderCommand *cmd) {
+    strip->on = cmd->on;
+    strip->color = cmd->color;
+    strip->brightness = cmd->brightness;
+    strip->pattern = cmd->pattern;
+    if (cmd->setPalette) {
+        strip->targetPalette = cmd->targetPalette;
+    }
+    if (cmd->setHue) {
+        strip->hue = cmd->hue;
+    }
+    strip->offset = cmd->offset;
+    strip->span = cmd->span;
+}
+
+// Applies pending settings at the frame boundary, then renders both strips. Render side only.
+void renderFrame() {
+    for (uint8_t i = 0; i < 2; i++) {
+        Strip *strip = &renderStrips[i];
+        RenderCommand cmd;
+        while (renderCommands[i].pop(cmd)) {
+            applyRenderCommand(strip, &cmd);
+        }
+        CRGBPalette16 palette = strip->targetPalette;
+        if (renderStrip(strip)) {
+            bool changed = strip->targetPalette != palette;
+            FrameReport r = {.strip = i, .hue = strip->hue, .setPalette = changed};
+            if (changed) {
+                r.targetPalette = strip->targetPalette;
+            }
+            frameReports.push(r);
+        }
+    }
+}
+
+void startRenderer() {
+    Strip *strips[] = {&front, &back};
+    for (uint8_t i = 0; i < 2; i++) {
+        renderStrips[i] = *strips[i];
+        lastCommand[i] = {.on = strips[i]->on, .color = strips[i]->color, .brightness = strips[i]->brightness,
+                          .pattern = strips[i]->pattern, .setPalette = false, .targetPalette = strips[i]->targetPalette,
+                          .setHue = false, .hue = strips[i]->hue,
+                          .offset = strips[i]->offset, .span = strips[i]->span};
+    }
+}
+
+// Hands any strip settings changed by the network side over to the render side.
+void publishRenderCommands() {
+    Strip *strips[] = {&front, &back};
+    for (uint8_t i = 0; i < 2; i++) {
+        Strip *s = strips[i];
+        RenderCommand *last = &lastCommand[i];
+        if (s->on != last->on || s->color != last->color || s->brightness != last->brightness ||
+            s->pattern != last->pattern || s->hue != last->hue || s->targetPalette != last->targetPalette ||
+            s->offset != last->offset || s->span != last->span) {
+            RenderCommand cmd = {.on = s->on, .color = s->color, .brightness = s->brightness,
+                                 .pattern = s->pattern, .setPalette = s->targetPalette != last->targetPalette,
+                                 .targetPalette = s->targetPalette, .setHue = s->hue != last->hue, .hue = s->hue,
+                                 .offset = s->offset, .span = s->span};
+            if (renderCommands[i].push(cmd)) {
+                *last = cmd;
+            }
+        }
+    }
+}
+
+// Picks up render side state, so that syncs and status report what is actually shown.
+void collectFrameReports() {
+    Strip *strips[] = {&front, &back};
+    FrameReport r;
+    while (frameReports.pop(r)) {
+        strips[r.strip]->hue = r.hue;
+        lastCommand[r.strip].hue = r.hue;
+        if (r.setPalette) {
+            strips[r.strip]->targetPalette = r.targetPalette;
+            lastCommand[r.strip].targetPalette = r.targetPalette;
+        }
+    }
+}
+
+// Pattern rotation, palette changes and syncing for a strip. Network side only.
+void handleLEDs(Strip *strip) {
     // Change the target palette to a 'related colours' palette every 5 seconds.
     EVERY_X_MILLIS(strip->tp, 5000)
-        if (isMaster(WiFi.localIP())) {
+        if (isGroupMaster(WiFi.localIP())) {
             // This is the base colour. Other colours are within 16 hues of this. One color is 128 + baseclr.
             if (strip->pattern->renderPause > 0) {
                 uint8_t baseclr = random8();
@@ -724,8 +1704,7 @@ void handleLEDs(Strip *strip) {
                         CHSV(baseclr + random8(64), 192, random8(128, 255)),
                         CHSV(baseclr + random8(64), 255, random8(128, 255)));
             }
-            syncColorSettings(strip);
-            syncPattern(strip);
+            syncStrips(strip == &front, strip == &back);
         }
     }
 
@@ -739,7 +1718,7 @@ void handleLEDs(Strip *strip) {
     }
 
     EVERY_X_MILLIS(strip->t0, 30000)
-        if (isMaster(WiFi.localIP())) {
+        if (isGroupMaster(WiFi.localIP())) {
             if (strip->randomMode != NOT_RANDOM) {
                 strip->pattern = randomPattern(strip);
                 syncPattern(strip);
@@ -750,7 +1729,22 @@ void handleLEDs(Strip *strip) {
     }
 }
 
-#define SLEEP_FADE_DURATION 60000
+// Lets the governor adjust load shedding; strips rotating onto a pattern that it
+// has just excluded move on rather than wait for the next rotation.
+void shedLoad() {
+    if (!governorTick()) {
+        return;
+    }
+    if (governor.level == GOVERNOR_EXCLUDE && isGroupMaster(WiFi.localIP())) {
+        Strip *strips[] = {&front, &back};
+        for (uint8_t i = 0; i < 2; i++) {
+            if (strips[i]->randomMode != NOT_RANDOM && strips[i]->pattern && governorExcludes(strips[i]->pattern)) {
+                strips[i]->t0 = 0;
+            }
+        }
+    }
+    broadcastState(false);
+}
 
 void handleSleep() {
     if (sleepTime && sleepTime < millis()) {
@@ -768,6 +1762,12 @@ void handleSleep() {
 }
 
 void loop() {
+    if (continueBoot()) {
+        renderFrame();
+        return;
+    }
+
+    uint32_t start = micros();
     if (gizmo.isNetworkAvailable(finishWiFiConnect)) {
         pruneSample();
         handlePeers();
@@ -777,40 +1777,55 @@ void loop() {
     EVERY_N_SECONDS(1)
     {
         handleSleep();
+        shedLoad();
     }
 
+    applyStripCommands();
+    collectFrameReports();
     handleLEDs(&front);
     handleLEDs(&back);
+    publishRenderCommands();
+    governorNetPass(micros() - start);
+
+    renderFrame();
+
+    if (pendingJsonState) {
+        publishJsonState();
+    }
 }
 
-void showDiagnostics(Strip *strip) {
+void diagnosticsOverlay(Strip *strip) {
     if (!diagnosticsOn) {
         return;
     }
     int i = 0;
-    strip->leds[i++] = WiFi.status() == WL_CONNECTED ? CRGB::Blue : CRGB::Red;
-    strip->leds[i++] = master ? CRGB::Green : CRGB::Red;
-    strip->leds[i++] = peerCount ? CRGB::Green : CRGB::Red;
-    strip->leds[i++] = CRGB::Black;
-    strip->leds[i++] = buddyAvailable ? CRGB::Green : CRGB::Red;
-    strip->leds[i++] = !buddySilent ? CRGB::Green : CRGB::Red;
-    strip->leds[i++] = lastSample + SAMPLE_TIMEOUT > millis() ? CRGB::Green : CRGB::Red;
-    strip->leds[i++] = homeAlone ? CRGB::Blue : CRGB::Black;
-    strip->leds[i++] = CRGB::Black;
-    strip->leds[i++] = CRGB::Black;
-    strip->ctl->showLeds(strip->brightness);
+    setOverlay(strip, i++, WiFi.status() == WL_CONNECTED ? CRGB::Blue : CRGB::Red);
+    setOverlay(strip, i++, !isGroupMaster(peers[0].ip) ? CRGB::Green : CRGB::Red);
+    setOverlay(strip, i++, memberCount ? CRGB::Green : CRGB::Red);
+    setOverlay(strip, i++, CRGB::Black);
+    setOverlay(strip, i++, buddyAvailable ? CRGB::Green : CRGB::Red);
+    setOverlay(strip, i++, !buddySilent ? CRGB::Green : CRGB::Red);
+    setOverlay(strip, i++, lastSample + SAMPLE_TIMEOUT > millis() ? CRGB::Green : CRGB::Red);
+    setOverlay(strip, i++, homeAlone ? CRGB::Blue : CRGB::Black);
+    setOverlay(strip, i++, CRGB::Black);
+    setOverlay(strip, i++, CRGB::Black);
 }
 
 void finishWiFiConnect() {
     Serial.printf("%s finishing setup\n", LED_LIGHTS);
+    if (!wifiTimed) {
+        wifiTimed = true;
+        bootPhase("wifi");
+    }
 
     peers[0].ip = (uint32_t) WiFi.localIP();
     strcpy(peers[0].name, gizmo.getHostname());
 
     setupSync();
 
-    determineMaster();
-    sayHello();
+    electMaster();
+    membershipChanged = true;
+    nextHello = 0;
     requestSamples();
 
     publishState("/state", front.on ? "on" : "off", &front);
@@ -820,13 +1835,25 @@ void finishWiFiConnect() {
     Serial.printf("%s is ready\n", LED_LIGHTS);
 }
 
-#define STRIP_STATUS "\"%s\": {\"on\": %s,\"rgb\": \"#%06X\",\"brightness\": %d,\"effect\": \"%s\"}"
+void stripStatus(JsonWriter *w, Strip *s) {
+    jsonObjectBegin(w, s->name);
+    jsonBool(w, "on", s->on);
+    jsonColor(w, "rgb", s->color);
+    jsonUInt(w, "brightness", s->brightness);
+    jsonString(w, "effect", s->pattern ? s->pattern->name : "solid");
+    jsonObjectEnd(w);
+}
 
-char *stripStatus(char *html, Strip *s) {
-    snprintf(html, 127, STRIP_STATUS, s->name, s->on ? "true" : "false",
-             s->color.red << 16 | s->color.green << 8 | s->color.blue, s->brightness,
-             s->pattern ? s->pattern->name : "solid");
-    return html;
+// Restores both strips from the binary last-state record; returns false if there is none.
+bool loadLastState() {
+    LastState last;
+    if (!readLastState(&last, patternCatalog())) {
+        return false;
+    }
+    restoreStrip(&front, &last.scene.strips[0]);
+    restoreStrip(&back, &last.scene.strips[1]);
+    syncWithMaster = last.syncWithMaster;
+    return true;
 }
 
 void loadState() {
@@ -880,6 +1907,12 @@ const char *effect(Strip *s) {
 }
 
 void saveState() {
+    LastState last = {.version = LAST_STATE_VERSION, .syncWithMaster = syncWithMaster,
+                      .scene = {.version = SCENE_VERSION, .catalog = patternCatalog()}};
+    snapshotStrip(&last.scene.strips[0], &front);
+    snapshotStrip(&last.scene.strips[1], &back);
+    writeLastState(&last);
+
     File f = SPIFFS.open(STATE, "w");
     if (f) {
         f.printf("%s|%d,%d,%d|%d|%s\n", front.on ? "on" : "off",
@@ -892,7 +1925,9 @@ void saveState() {
 }
 
 void copyFront(Strip *s) {
-    memmove(&s->leds[0], &front.leds[0], s->count * sizeof(CRGB));
+    uint16_t n = min(s->count, front.count);
+    memmove(&s->leds[0], &front.leds[0], n * sizeof(CRGB));
+    fill_solid(s->leds + n, s->count - n, CRGB::Black);
 }
 
 
@@ -909,6 +1944,8 @@ Pattern patterns[] = {
         Pattern{.name = "juggle", .renderer = juggle, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
         Pattern{.name = "bpm", .renderer = bpm, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
         Pattern{.name = "fire", .renderer = fire, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = true},
+        Pattern{.name = "mirrorfire", .renderer = mirrorfire, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
+        Pattern{.name = "multifire", .renderer = multifire, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
         Pattern{.name = "noise", .renderer = noise, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
         Pattern{.name = "blendwave", .renderer = blendwave, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
         Pattern{.name = "dotbeat", .renderer = dotBeat, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
@@ -921,7 +1958,14 @@ Pattern patterns[] = {
         Pattern{.name = "twinklefairy", .renderer = twinklefairy, .huePause = 20, .renderPause = -10, .soundReactive = false, .favorite = false},
         Pattern{.name = "twinkleplain", .renderer = twinkleplain, .huePause = 20, .renderPause = -10, .soundReactive = false, .favorite = false},
         Pattern{.name = "twinklefox", .renderer = twinklefox, .huePause = 20, .renderPause = -10, .soundReactive = false, .favorite = false},
+        Pattern{.name = "noise2d", .renderer = noise2d, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
+        Pattern{.name = "plasma2d", .renderer = plasma2d, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
+        Pattern{.name = "fire2d", .renderer = fire2d, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
         Pattern{.name = "fireworks", .renderer = fireworks, .huePause = 20, .renderPause = 2, .soundReactive = false, .favorite = false},
+        Pattern{.name = "span_noise", .renderer = spanNoise, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
+        Pattern{.name = "span_chase", .renderer = spanChase, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
+        Pattern{.name = "span_rainbow", .renderer = spanRainbow, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
+        Pattern{.name = "span_fire", .renderer = spanFire, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
 
         Pattern{.name = "sr_pixel", .renderer = pixel, .huePause = 2000, .renderPause = 0, .soundReactive = true, .favorite = false},
         Pattern{.name = "sr_pixels", .renderer = pixels, .huePause = 2000, .renderPause = 30, .soundReactive = true, .favorite = false},
@@ -938,11 +1982,13 @@ Pattern patterns[] = {
         Pattern{.name = "sr_plasma", .renderer = plasmasr, .huePause = 2000, .renderPause = 10, .soundReactive = true, .favorite = false},
 
         Pattern{.name = "solid", .renderer = solid, .huePause = 2000, .renderPause = 20, .soundReactive = false, .favorite = false},
+        Pattern{.name = "user1", .renderer = userProgram, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
+        Pattern{.name = "user2", .renderer = userProgram, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
+        Pattern{.name = "user3", .renderer = userProgram, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
+        Pattern{.name = "user4", .renderer = userProgram, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false},
         Pattern{.name = "test", .renderer = test, .huePause = 20, .renderPause = 20, .soundReactive = false, .favorite = false}
 };
 
-#define ARRAY_SIZE(A) (sizeof(A) / sizeof((A)[0]))
-
 Pattern *findPattern(const char *name) {
     int i = 0;
     while (strcmp(patterns[i].name, name) && strcmp(patterns[i].name, "test")) {
@@ -951,6 +1997,16 @@ Pattern *findPattern(const char *name) {
     return &patterns[i];
 }
 
+// CRC of the pattern names in catalog order, terminators included, as stored with scenes
+// and the last state: a renamed, added, removed or moved pattern changes it.
+uint16_t patternCatalog() {
+    uint16_t crc = 0xFFFF;
+    for (uint8_t i = 0; i < ARRAY_SIZE(patterns); i++) {
+        crc = crc16Update(crc, patterns[i].name, strlen(patterns[i].name) + 1);
+    }
+    return crc;
+}
+
 Pattern *randomPattern(Strip *s) {
     Pattern *p;
     boolean nsrFavs = 0;
@@ -971,31 +2027,137 @@ Pattern *randomPattern(Strip *s) {
         mode = NOT_SOUND_REACTIVE;
     }
 
+    // Patterns the governor excludes are only accepted if nothing else turns up.
+    uint8_t tries = 0;
     do {
         p = &patterns[1 + random8(ARRAY_SIZE(patterns) - 2)];
     } while ((mode == FAVORITES && (!p->favorite || (p->soundReactive && buddySilent))) ||
              (mode == SOUND_REACTIVE && !p->soundReactive) ||
-             (mode == NOT_SOUND_REACTIVE && p->soundReactive));
+             (mode == NOT_SOUND_REACTIVE && p->soundReactive) ||
+             (p->renderer == userProgram && !isProgramLoaded(p)) ||
+             (governorExcludes(p) && ++tries < GOVERNOR_TRIES));
     return p;
 }
 
-char *favorites(char *favs) {
-    char fav[32];
-    favs[0] = '\0';
-    strncat(favs, "\"favs\": {", 16);
+uint8_t overBudgetPatterns() {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < ARRAY_SIZE(patterns); i++) {
+        n += isOverBudget(&patterns[i]);
+    }
+    return n;
+}
+
+void snapshotStrip(StripScene *ss, Strip *s) {
+    ss->pattern = s->pattern ? s->pattern - patterns : SCENE_NO_PATTERN;
+    ss->randomMode = s->randomMode;
+    ss->on = s->on;
+    ss->brightness = s->brightness;
+    ss->hue = s->hue;
+    memcpy(ss->color, s->color.raw, 3);
+    for (int i = 0; i < 16; i++) {
+        memcpy(ss->palette + i * 3, s->targetPalette.entries[i].raw, 3);
+    }
+}
+
+void restoreStrip(Strip *s, const StripScene *ss) {
+    s->pattern = ss->pattern < ARRAY_SIZE(patterns) ? &patterns[ss->pattern] : findPattern("solid");
+    s->randomMode = ss->randomMode <= NOT_SOUND_REACTIVE ? (RandomMode) ss->randomMode : NOT_RANDOM;
+    s->on = ss->on;
+    s->brightness = ss->brightness;
+    s->hue = ss->hue;
+    memcpy(s->color.raw, ss->color, 3);
+    for (int i = 0; i < 16; i++) {
+        memcpy(s->targetPalette.entries[i].raw, ss->palette + i * 3, 3);
+    }
+    // Random strips rotate from the scene's pattern as usual.
+    s->t0 = millis() + 30000;
+}
+
+// Saves both strips as a scene and hands the scene to peers, so that later recalls need one op.
+bool saveScene(uint8_t id) {
+    Scene scene = {.version = SCENE_VERSION, .catalog = patternCatalog()};
+    snapshotStrip(&scene.strips[0], &front);
+    snapshotStrip(&scene.strips[1], &back);
+    if (!writeScene(id, &scene)) {
+        return false;
+    }
+    sceneStats.saves++;
+    Envelope e;
+    beginSync(&e);
+    addSceneData(&e, id, &scene);
+    envelopeEnd(&e);
+    return true;
+}
+
+void applyScene(const Scene *scene) {
+    uint32_t start = micros();
+    restoreStrip(&front, &scene->strips[0]);
+    restoreStrip(&back, &scene->strips[1]);
+    sceneStats.applyMicros = micros() - start;
+    Strip *strips[] = {&front, &back};
+    for (uint8_t i = 0; i < 2; i++) {
+        char value[16];
+        publishState("/state", strips[i]->on ? "on" : "off", strips[i]);
+        snprintf(value, sizeof(value), "%d", strips[i]->brightness);
+        publishState("/brightness/state", value, strips[i]);
+        snprintf(value, sizeof(value), "%d,%d,%d", strips[i]->color.red, strips[i]->color.green, strips[i]->color.blue);
+        publishState("/rgb/state", value, strips[i]);
+        publishState("/effect/state", strips[i]->pattern->name, strips[i]);
+    }
+}
+
+// Applies a stored scene and tells peers to do the same.
+bool recallScene(uint8_t id) {
+    Scene scene;
+    if (!readScene(id, &scene, patternCatalog())) {
+        gizmo.debug("Scene %d not found", id);
+        return false;
+    }
+    applyScene(&scene);
+    sceneStats.recalls++;
+
+    uint8_t data[SCENE_OP_SIZE];
+    writeSceneOp(data, id, sceneCrc(&scene));
+    sendSingle((uint32_t) WiFi.localIP(), ALL_CTX, SCENE, data, sizeof(data));
+    return true;
+}
+
+// Applies a scene recalled by the master if we hold the same copy, otherwise asks for a full sync.
+void copyScene(uint8_t id, uint16_t crc) {
+    Scene scene;
+    if (isSceneId(id) && readScene(id, &scene, patternCatalog()) && sceneCrc(&scene) == crc) {
+        applyScene(&scene);
+        sceneStats.peerRecalls++;
+    } else {
+        sceneStats.misses++;
+        requestSync();
+    }
+}
+
+// POST /api/scene?id=3 recalls a scene; POST /api/scene?id=3&save=1 saves the current state as one.
+void handleScene() {
+    ESP8266WebServer *server = gizmo.httpServer();
+    sendCorsHeaders();
+    char value[16];
+    snprintf(value, sizeof(value), server->hasArg("save") ? "save %d" : "%d", (int) server->arg("id").toInt());
+    if (!processScene(value)) {
+        server->send(400, "text/plain", "invalid scene\n");
+        return;
+    }
+    applyStripCommands();
+    server->send(200, "text/plain", "ok\n");
+}
+
+void favorites(JsonWriter *w) {
+    jsonObjectBegin(w, "favs");
     int i = 0;
-    boolean first = true;
     while (strcmp(patterns[i].name, "test")) {
         if (patterns[i].favorite) {
-            fav[0] = '\0';
-            snprintf(fav, 24, "%s\"%s\":1", !first ? "," : "", patterns[i].name);
-            strncat(favs, fav, 31);
-            first = false;
+            jsonUInt(w, patterns[i].name, 1);
         }
         i++;
     }
-    strncat(favs, "},", 16);
-    return favs;
+    jsonObjectEnd(w);
 }
 
 void loadFavorites() {
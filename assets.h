@@ -0,0 +1,144 @@
+// Pre-compressed, cache-validated web assets.
+//
+// tools/gzassets.py gzips the files listed in data/catalog and writes an
+// "/etags" manifest with one "<path> <gzip etag> <plain etag>" line per
+// asset. Each listed asset gets its own handler that serves "<path>.gz" to
+// clients accepting gzip and the plain file to the rest, each with its own
+// strong ETag and Vary: Accept-Encoding, so that caches keep them apart.
+// Revalidation requests are answered with a 304 straight from the manifest
+// held in RAM, without touching flash. Assets missing from the manifest
+// fall through to the regular web root.
+
+#define ASSET_ETAGS     "/etags"
+#define MAX_ASSETS      16
+
+#define ASSET_CACHE     "public, max-age=604800"
+#define PAGE_CACHE      "no-cache"
+
+typedef struct {
+    char path[24];
+    char etag[20];              // of the .gz
+    char plainEtag[20];         // of the file itself; empty with manifests that predate it
+    bool gzipped;
+} Asset;
+
+typedef struct {
+    uint32_t requests;
+    uint32_t notModified;
+    uint32_t bytes;
+    uint32_t maxMicros;
+} AssetStats;
+
+static Asset assets[MAX_ASSETS];
+static uint8_t assetCount = 0;
+AssetStats assetStats;
+
+Asset *findAsset(const char *path) {
+    for (uint8_t i = 0; i < assetCount; i++) {
+        if (!strcmp(assets[i].path, path)) {
+            return &assets[i];
+        }
+    }
+    return NULL;
+}
+
+const char *assetContentType(const char *path) {
+    const char *ext = strrchr(path, '.');
+    if (!ext) {
+        return "application/octet-stream";
+    } else if (!strcmp(ext, ".html")) {
+        return "text/html";
+    } else if (!strcmp(ext, ".js")) {
+        return "application/javascript";
+    } else if (!strcmp(ext, ".css")) {
+        return "text/css";
+    } else if (!strcmp(ext, ".png")) {
+        return "image/png";
+    }
+    return "application/octet-stream";
+}
+
+void handleAsset() {
+    ESP8266WebServer *server = gizmo.httpServer();
+    uint32_t start = micros();
+    Asset *asset = findAsset(server->uri() == "/" ? "/index.html" : server->uri().c_str());
+    if (!asset) {
+        server->send(404, "text/plain", "Not found");
+        return;
+    }
+
+    // Pages must revalidate so that updates show up; everything else can be cached outright.
+    const char *type = assetContentType(asset->path);
+    bool gzip = asset->gzipped && server->header("Accept-Encoding").indexOf("gzip") >= 0;
+    const char *etag = gzip ? asset->etag : asset->plainEtag;
+    if (*etag) {
+        server->sendHeader("ETag", etag);
+    }
+    server->sendHeader("Vary", "Accept-Encoding");
+    server->sendHeader("Cache-Control", strcmp(type, "text/html") ? ASSET_CACHE : PAGE_CACHE);
+    assetStats.requests++;
+
+    if (*etag && server->header("If-None-Match") == etag) {
+        server->send(304);
+        assetStats.notModified++;
+    } else {
+        char gz[sizeof(asset->path) + 3];
+        snprintf(gz, sizeof(gz), "%s.gz", asset->path);
+        File f = SPIFFS.open(gzip ? gz : asset->path, "r");
+        if (!f) {
+            server->send(404, "text/plain", "Not found");
+            return;
+        }
+        // streamFile adds Content-Encoding: gzip for .gz files.
+        assetStats.bytes += server->streamFile(f, type);
+        f.close();
+    }
+    assetStats.maxMicros = max(assetStats.maxMicros, micros() - start);
+}
+
+// Loads the ETag manifest and registers a handler per asset; must run before the web root is set up.
+void setupAssets() {
+    static const char *headers[] = {"If-None-Match", "Accept-Encoding"};
+    ESP8266WebServer *server = gizmo.httpServer();
+    server->collectHeaders(headers, ARRAY_SIZE(headers));
+
+    File f = SPIFFS.open(ASSET_ETAGS, "r");
+    if (!f) {
+        return;
+    }
+    char line[80];
+    while (assetCount < MAX_ASSETS && f.available()) {
+        size_t l = f.readBytesUntil('\n', line, sizeof(line) - 1);
+        line[l] = '\0';
+        if (l == sizeof(line) - 1) {
+            // Too long for any valid entry; skip the rest of it rather than read it as another line.
+            while (f.available() && f.read() != '\n');
+            continue;
+        }
+        Asset *a = &assets[assetCount];
+        char *etag = strchr(line, ' ');
+        char *plainEtag = etag ? strchr(etag + 1, ' ') : NULL;
+        if (plainEtag) {
+            *plainEtag++ = '\0';
+        }
+        if (!etag || (size_t) (etag - line) >= sizeof(a->path) || strlen(etag + 1) >= sizeof(a->etag) ||
+            (plainEtag && strlen(plainEtag) >= sizeof(a->plainEtag))) {
+            continue;
+        }
+        *etag++ = '\0';
+        strcpy(a->path, line);
+        strcpy(a->etag, etag);
+        char gz[sizeof(a->path) + 3];
+        snprintf(gz, sizeof(gz), "%s.gz", a->path);
+        a->gzipped = SPIFFS.exists(gz);
+        // Older manifests only hash the file that was served by default, the plain one when there is no .gz.
+        strcpy(a->plainEtag, plainEtag ? plainEtag : a->gzipped ? "" : etag);
+        server->on(a->path, HTTP_GET, handleAsset);
+        if (!strcmp(a->path, "/index.html")) {
+            server->on("/", HTTP_GET, handleAsset);
+        }
+        assetCount++;
+    }
+    f.close();
+    gizmo.debug("Serving %d compressed assets", assetCount);
+}
@@ -7,5 +7,5 @@ void besin(Strip *s) {
     // Move the pixels to the left/right, but not too fast.
     waveit(s);
 
-    fadeToBlackBy(s->leds, s->count, 2);
+    fadeFrame(s, s->leds, s->count, 2);
 }
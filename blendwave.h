@@ -5,7 +5,7 @@ void blendwave(Strip *s) {
     CRGB clr1 = blend(CHSV(beatsin8(3,0,255),255,255), CHSV(beatsin8(4,0,255),255,255), speed);
     CRGB clr2 = blend(CHSV(beatsin8(4,0,255),255,255), CHSV(beatsin8(3,0,255),255,255), speed);
 
-    uint8_t loc1 = beatsin8(10,0,s->count-1);
+    uint16_t loc1 = beatsin16(10,0,s->count-1);
 
     fill_gradient_RGB(s->leds, 0, clr2, loc1, clr1);
     fill_gradient_RGB(s->leds, loc1, clr2, s->count-1, clr1);
@@ -0,0 +1,76 @@
+// Fast boot.
+//
+// setup() only brings up what is needed to show light: flash, the LED outputs
+// and a compact binary record of the last state, written next to the text
+// state on every save. The first frame goes out right away. WiFi and gizmo,
+// web routes, MQTT topics and the rest of the configuration are brought up one
+// step per loop pass afterwards, so frames keep going out in between. Each step
+// still blocks for as long as it takes; the longest is gizmo.beginSetup(),
+// which starts WiFi, MQTT and the web server in one call.
+//
+// Every phase is timed from power-on and the timings are served by /api/boot.
+
+#define LAST_STATE          "/cfg/last"
+#define LAST_STATE_VERSION  1
+#define MAX_BOOT_PHASES     12
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t syncWithMaster;
+    Scene scene;
+} LastState;
+
+typedef struct {
+    const char *name;
+    uint32_t at;                // ms since power-on when the phase ended
+    uint32_t micros;            // duration of the phase
+} BootPhase;
+
+// Deferred setup step run from loop().
+typedef struct {
+    const char *name;
+    void (*run)();
+} BootStep;
+
+BootPhase bootPhases[MAX_BOOT_PHASES];
+uint8_t bootPhaseCount = 0;
+static uint32_t bootPhaseStart = 0;
+
+// Ends the current boot phase under the given name and starts the next one.
+void bootPhase(const char *name) {
+    uint32_t now = micros();
+    if (bootPhaseCount < MAX_BOOT_PHASES) {
+        bootPhases[bootPhaseCount++] = {.name = name, .at = millis(), .micros = now - bootPhaseStart};
+    }
+    bootPhaseStart = now;
+}
+
+bool readLastState(LastState *last, uint16_t catalog) {
+    File f = SPIFFS.open(LAST_STATE, "r");
+    if (!f) {
+        return false;
+    }
+    bool ok = f.read((uint8_t *) last, sizeof(LastState)) == sizeof(LastState);
+    f.close();
+    return ok && last->version == LAST_STATE_VERSION && last->scene.version == SCENE_VERSION &&
+           last->scene.catalog == catalog;
+}
+
+void writeLastState(const LastState *last) {
+    File f = SPIFFS.open(LAST_STATE, "w");
+    if (f) {
+        f.write((const uint8_t *) last, sizeof(LastState));
+        f.close();
+    }
+}
+
+void writeBootPhases(JsonWriter *w) {
+    jsonObjectBegin(w, NULL);
+    for (uint8_t i = 0; i < bootPhaseCount; i++) {
+        jsonObjectBegin(w, bootPhases[i].name);
+        jsonUInt(w, "at", bootPhases[i].at);
+        jsonUInt(w, "us", bootPhases[i].micros);
+        jsonObjectEnd(w);
+    }
+    jsonObjectEnd(w);
+}
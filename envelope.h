@@ -0,0 +1,182 @@
+// Batched sync envelopes and in-place decoding of peer packets.
+//
+// An envelope is a datagram with the Command header and the BATCH op, but
+// its data runs past MAX_CMD_DATA up to PEER_PACKET_SIZE and holds a version
+// byte, a record count and then the records back to back:
+//
+//     [version][count] { [ctx lo][ctx hi][op lo][op hi][len][data...] } ...
+//
+// so several ops for several strips go out in a single datagram of just the
+// length they need. Lamps that predate envelopes ignore the unknown op;
+// envelopes are therefore only used while every known member advertises a
+// HELLO interval (see members.h), and otherwise each record goes out as its
+// own single-op Command as before.
+//
+// Envelopes are assembled in one static packet buffer and handed to a
+// PacketSink when full or ended, so only one envelope can be open at a time.
+//
+// Received packets are decoded in place into CommandView records pointing
+// into the receive buffer; nothing is copied and every record is bounds
+// checked against the datagram length before it is handed on.
+
+#define BATCH               0xBA    // op code not used by LampSync
+#define ENVELOPE_VERSION    1
+#define ENVELOPE_HEADER     2
+#define RECORD_HEADER       5
+
+#define PEER_PACKET_SIZE    512
+
+// Read-only view of one received op.
+typedef struct {
+    uint32_t src;
+    uint16_t ctx;
+    uint8_t ch;
+    uint16_t op;
+    const uint8_t *data;
+    uint16_t len;
+    const Command *command;     // the whole Command for single-op packets, NULL for envelope records
+} CommandView;
+
+typedef void (*PeerHandler)(const CommandView *);
+
+// Sends a finished envelope datagram of the given length.
+typedef void (*PacketSink)(const uint8_t *, size_t);
+
+typedef struct {
+    PacketSink sink;            // NULL sends every op as its own Command
+    uint32_t src;
+    uint16_t used;
+} Envelope;
+
+typedef struct {
+    uint32_t rxPackets;
+    uint32_t rxOps;
+    uint32_t rxRejected;
+    uint32_t rxMicros;
+    uint32_t txPackets;
+} PeerStats;
+
+PeerStats peerStats;
+
+static union {
+    Command command;
+    uint8_t bytes[PEER_PACKET_SIZE];
+} peerPacket;
+
+#define ENVELOPE_DATA       ((int) (PEER_PACKET_SIZE - offsetof(Command, data)))
+
+static union {
+    Command command;
+    uint8_t bytes[PEER_PACKET_SIZE];
+} envelopePacket;
+
+static uint8_t *const envelopeData = envelopePacket.bytes + offsetof(Command, data);
+
+void envelopeReset(Envelope *e) {
+    envelopeData[0] = ENVELOPE_VERSION;
+    envelopeData[1] = 0;
+    e->used = ENVELOPE_HEADER;
+}
+
+void envelopeBegin(Envelope *e, uint32_t src, PacketSink sink) {
+    e->sink = sink;
+    e->src = src;
+    envelopeReset(e);
+}
+
+void envelopeFlush(Envelope *e) {
+    if (envelopeData[1]) {
+        envelopePacket.command.src = e->src;
+        envelopePacket.command.ctx = ALL_CTX;
+        envelopePacket.command.op = CHOP(BATCH);
+        e->sink(envelopePacket.bytes, offsetof(Command, data) + e->used);
+        peerStats.txPackets++;
+    }
+    envelopeReset(e);
+}
+
+void sendSingle(uint32_t src, uint16_t ctx, uint16_t op, const uint8_t *data, uint16_t len) {
+    Command cmd = {.src = src, .ctx = ctx, .op = CHOP(op), .data = {[0] = 0}};
+    memcpy(cmd.data, data, min((uint16_t) MAX_CMD_DATA, len));
+    broadcast(cmd);
+    peerStats.txPackets++;
+}
+
+// Adds an op to the envelope, sending the envelope first if the op would not fit.
+void envelopeAdd(Envelope *e, uint16_t ctx, uint16_t op, const uint8_t *data, uint8_t len) {
+    if (!e->sink || ENVELOPE_HEADER + RECORD_HEADER + len > ENVELOPE_DATA) {
+        sendSingle(e->src, ctx, op, data, len);
+        return;
+    }
+    if (e->used + RECORD_HEADER + len > ENVELOPE_DATA) {
+        envelopeFlush(e);
+    }
+    uint8_t *r = envelopeData + e->used;
+    r[0] = ctx & 0xFF;
+    r[1] = ctx >> 8;
+    r[2] = op & 0xFF;
+    r[3] = op >> 8;
+    r[4] = len;
+    memcpy(r + RECORD_HEADER, data, len);
+    e->used += RECORD_HEADER + len;
+    envelopeData[1]++;
+}
+
+void envelopeEnd(Envelope *e) {
+    envelopeFlush(e);
+}
+
+// Decodes a received datagram and hands each op to the handler. Returns the number of ops
+// delivered; malformed envelopes are rejected as a whole before any op is delivered.
+int decodePeerPacket(const uint8_t *packet, size_t len, PeerHandler handler) {
+    const size_t header = offsetof(Command, data);
+    if (len <= header) {
+        peerStats.rxRejected++;
+        return 0;
+    }
+
+    const Command *cmd = (const Command *) packet;
+    CommandView v = {
+            .src = cmd->src, .ctx = cmd->ctx, .ch = (uint8_t) CH(cmd->op), .op = (uint16_t) OP(cmd->op),
+            .data = packet + header, .len = (uint16_t) (len - header), .command = cmd
+    };
+
+    if (v.op != BATCH) {
+        handler(&v);
+        return 1;
+    }
+
+    const uint8_t *p = v.data;
+    const uint8_t *end = v.data + v.len;
+    if (v.len < ENVELOPE_HEADER || p[0] != ENVELOPE_VERSION) {
+        peerStats.rxRejected++;
+        return 0;
+    }
+
+    uint8_t count = p[1];
+    const uint8_t *r = p + ENVELOPE_HEADER;
+    for (uint8_t i = 0; i < count; i++) {
+        if (r + RECORD_HEADER > end || r + RECORD_HEADER + r[4] > end) {
+            peerStats.rxRejected++;
+            return 0;
+        }
+        r += RECORD_HEADER + r[4];
+    }
+
+    r = p + ENVELOPE_HEADER;
+    for (uint8_t i = 0; i < count; i++) {
+        v.ctx = r[0] | r[1] << 8;
+        v.op = r[2] | r[3] << 8;
+        v.len = r[4];
+        v.data = r + RECORD_HEADER;
+        v.command = NULL;
+        handler(&v);
+        r += RECORD_HEADER + v.len;
+    }
+    return count;
+}
+
+// Returns true if the view holds a NUL terminated string within its bounds.
+bool viewHasString(const CommandView *v) {
+    return v->len && memchr(v->data, '\0', v->len);
+}
@@ -14,18 +14,27 @@ void fillnoise(Strip *s) {
     }
 
     // The louder the sound, the wider the soundbar.
-    for (int i = (s->count - sampleavg / 2) / 2; i < (s->count + sampleavg / 2) / 2; i++) {
-        // Get a value from the noise function. I'm using both x and y axis.
-        uint8_t index = inoise8(i * sampleavg + xdist, ydist + i * sampleavg);
+    int first = (s->count - sampleavg / 2) / 2;
+    int last = (s->count + sampleavg / 2) / 2;
+
+    uint8_t *index = noiseBuffer(s->count);
+    if (!index) {
+        return;
+    }
+
+    // Get values from the noise function for the whole bar. I'm using both x and y axis.
+    fillNoise8(index, last - first, first * sampleavg + xdist, sampleavg, ydist + first * sampleavg, sampleavg);
+
+    for (int i = first; i < last; i++) {
         // With that value, look up the 8 bit colour palette value and assign it to the current LED.
         // Effect is a NOISE bar the width of sampleavg. Very fun. By Andrew Tuline.
-        s->leds[i] = ColorFromPalette(s->currentPalette, index, sampleavg, LINEARBLEND);
+        s->leds[i] = ColorFromPalette(s->currentPalette, index[i - first], sampleavg, LINEARBLEND);
     }
 
     // Moving forward in the NOISE field, but with a sine motion.
-    xdist = xdist + beatsin8(5, 0, 3);
+    xdist = xdist + frameDelta(s, beatsin8(5, 0, 3));
     // Moving sideways in the NOISE field, but with a sine motion.
-    ydist = ydist + beatsin8(4, 0, 3);
+    ydist = ydist + frameDelta(s, beatsin8(4, 0, 3));
 
     // Add glitter based on sample and not peaks.
     addGlitter(s, sampleavg / 2);
@@ -34,5 +43,5 @@ void fillnoise(Strip *s) {
     waveit(s);
 
     // Fade the center, while waveit moves everything out to the edges.
-    fadeToBlackBy(s->leds + s->count / 2 - 1, 2, 128);
+    fadeFrame(s, s->leds + s->count / 2 - 1, 2, 128);
 }
@@ -8,27 +8,125 @@
 // Default 120, suggested range 50-200.
 #define SPARKING    100
 
-void fire(Strip *s) {
-    EVERY_X_MILLIS(s->t2, 10)
-        // Step 1.  Cool down every cell a little
-        for (int i = 0; i < s->count; i++) {
-            s->data[i] = qsub8(s->data[i], random8(0, ((COOLING * 10) / s->count) + 2));
-        }
+// How the heat columns are laid out along the strip.
+typedef enum {
+    FIRE_LINEAR,    // one flame rising from the first pixel
+    FIRE_SPLIT,     // one flame rising from the center out to both ends
+    FIRE_MIRROR,    // one flame rising from both ends in toward the center
+    FIRE_MULTI      // several independent flames side by side
+} FireLayout;
 
-        // Step 2.  Heat from each cell drifts 'up' and diffuses a little
-        for (int k = s->count - 1; k >= 2; k--) {
-            s->data[k] = (s->data[k - 1] + s->data[k - 2] + s->data[k - 2]) / 3;
-        }
+// Heat to color lookup; same colors as HeatColor(), built on first use.
+static CRGB heatPalette[256];
+static bool heatPaletteReady = false;
 
-        // Step 3.  Randomly ignite new 'sparks' of heat near the bottom
-        if (random8() < SPARKING) {
-            int y = random8(7);
-            s->data[y] = qadd8(s->data[y], random8(160, 255));
+void setupHeatPalette() {
+    if (!heatPaletteReady) {
+        for (int i = 0; i < 256; i++) {
+            heatPalette[i] = HeatColor(i);
         }
+        heatPaletteReady = true;
+    }
+}
+
+// Cheap per-cell random source for cooling; seeded from the FastLED PRNG once per frame.
+static uint16_t fireSeed = 1;
+
+inline uint8_t fireRandom8(uint8_t lim) {
+    fireSeed ^= fireSeed << 7;
+    fireSeed ^= fireSeed >> 9;
+    fireSeed ^= fireSeed << 8;
+    return ((fireSeed & 0xFF) * lim) >> 8;
+}
+
+// Advances one heat column by one step.
+void fireColumn(byte *heat, uint16_t len, uint8_t coolMax, uint16_t sparking) {
+    // Step 1.  Cool down every cell a little
+    for (uint16_t i = 0; i < len; i++) {
+        heat[i] = qsub8(heat[i], fireRandom8(coolMax));
+    }
+
+    // Step 2.  Heat from each cell drifts 'up' and diffuses a little
+    for (uint16_t k = len - 1; k >= 2; k--) {
+        heat[k] = (heat[k - 1] + heat[k - 2] + heat[k - 2]) / 3;
+    }
+
+    // Step 3.  Randomly ignite new 'sparks' of heat near the bottom
+    if (random8() < sparking) {
+        int y = random8(len < 7 ? len : 7);
+        heat[y] = qadd8(heat[y], random8(160, 255));
+    }
+}
+
+// Heat diffusion fire engine shared by all the fire patterns. Heat is kept per strip
+// in s->data, so strips never disturb each other.
+void fireEngine(Strip *s, uint16_t cooling, uint16_t sparking, FireLayout layout, uint8_t flames) {
+    setupHeatPalette();
+    fireSeed = random16() | 1;
+
+    uint8_t coolMax = min(255, ((cooling * 10) / s->count) + 2);
+    uint16_t columns = layout == FIRE_MULTI ? flames : 1;
+    uint16_t len = layout == FIRE_LINEAR ? s->count : s->count / (layout == FIRE_MULTI ? flames : 2);
+    if (len < 3) {
+        return;
+    }
 
-        // Step 4.  Map from heat cells to LED colors
-        for (int j = 0; j < s->count; j++) {
-            s->leds[j] = HeatColor(s->data[j]);
+    for (uint16_t c = 0; c < columns; c++) {
+        fireColumn(s->data + c * len, len, coolMax, sparking);
+    }
+
+    // Step 4.  Map from heat cells to LED colors
+    uint16_t half = s->count / 2;
+    for (uint16_t j = 0; j < len; j++) {
+        switch (layout) {
+            case FIRE_SPLIT:
+                s->leds[half - j - 1] = s->leds[half + j] = heatPalette[s->data[j]];
+                break;
+            case FIRE_MIRROR:
+                s->leds[j] = s->leds[s->count - j - 1] = heatPalette[s->data[j]];
+                break;
+            case FIRE_MULTI:
+                for (uint16_t c = 0; c < columns; c++) {
+                    s->leds[c * len + j] = heatPalette[s->data[c * len + j]];
+                }
+                break;
+            default:
+                s->leds[j] = heatPalette[s->data[j]];
+                break;
         }
     }
 }
+
+// Sound reactive cooling and sparking; louder means taller, more roaring flames.
+void soundFireParams(uint16_t *cooling, uint16_t *sparking) {
+    *sparking = map(sampleavg, 0, 255, 0, 100);
+    *cooling = map(255 - sampleavg, 0, 255, 20, 200);
+
+    if (samplepeak) {
+        *sparking = *sparking * 1.6;
+        *cooling = *cooling * 2.7;
+    }
+}
+
+// The heat simulation steps as EVERY_X_MILLIS(s->t2, FIRE_STEP) would, every
+// FIRE_STEP + 1 ms, however often the pattern renders.
+#define FIRE_STEP       10
+#define FIRE_STEP_SR    10
+
+void fire(Strip *s) {
+    for (uint8_t n = dueSteps(&s->t2, FIRE_STEP); n; n--) {
+        fireEngine(s, COOLING, SPARKING, FIRE_LINEAR, 1);
+    }
+}
+
+void mirrorfire(Strip *s) {
+    for (uint8_t n = dueSteps(&s->t2, FIRE_STEP); n; n--) {
+        fireEngine(s, COOLING, SPARKING, FIRE_MIRROR, 1);
+    }
+}
+
+void multifire(Strip *s) {
+    for (uint8_t n = dueSteps(&s->t2, FIRE_STEP); n; n--) {
+        fireEngine(s, COOLING, SPARKING, FIRE_MULTI, 3);
+    }
+}
@@ -1,7 +1,7 @@
 
 
 #define NUM_LAUNCH_SPARKS   5
-#define NUM_SPARKS LED_COUNT/2
+#define NUM_SPARKS          64
 
 static int nSparks;
 static float sparkPos[NUM_SPARKS];
@@ -59,7 +59,7 @@ void fireworksFlare(Strip *s) {
     // sparks
     for (int i = 0; i < NUM_LAUNCH_SPARKS; i++) {
         sparkPos[i] += sparkVel[i];
-        sparkPos[i] = constrain(sparkPos[i], 0, s->count);
+        sparkPos[i] = constrain(sparkPos[i], 0, s->count - 1);
         sparkVel[i] += gravity;
         sparkCol[i] += -.98;
         sparkCol[i] = constrain(sparkCol[i], 32, 255);
@@ -71,13 +71,13 @@ void fireworksFlare(Strip *s) {
     s->leds[int(flarePos)] = CHSV(0, 0, int(brightness * 255));
 
     flarePos += flareVel;
-    flarePos = constrain(flarePos, 0, s->count);
+    flarePos = constrain(flarePos, 0, s->count - 1);
     flareVel += gravity;
     brightness *= .985;
 }
 
 void fireworksExplode(Strip *s) {
-    nSparks = flarePos / 3; // works out to look about right
+    nSparks = min(int(flarePos / 3), NUM_SPARKS); // works out to look about right
 
     // initialize sparks
     for (int i = 0; i < nSparks; i++) {
@@ -110,7 +110,7 @@ void fireworksFade(Strip *s) {
 
     for (int i = 0; i < nSparks; i++) {
         sparkPos[i] += sparkVel[i];
-        sparkPos[i] = constrain(sparkPos[i], 0, s->count);
+        sparkPos[i] = constrain(sparkPos[i], 0, s->count - 1);
         sparkVel[i] += dying_gravity;
         sparkCol[i] *= .99;
         sparkCol[i] = constrain(sparkCol[i], 0, 255); // red cross dissolve
@@ -131,22 +131,25 @@ void fireworksFade(Strip *s) {
     s->leds[0] = CRGB::Black;
 }
 
+// The simulation advances one step per elapsed frame.
 void fireworks(Strip *s) {
-    switch (stage) {
-        case LAUNCH_STAGE:
-            fireworksLaunch(s);
-            break;
+    for (uint8_t n = frameSteps(s); n; n--) {
+        switch (stage) {
+            case LAUNCH_STAGE:
+                fireworksLaunch(s);
+                break;
             case FLARE_STAGE:
                 fireworksFlare(s);
                 break;
-                case EXPLODE_STAGE:
-                    fireworksExplode(s);
-                    break;
-                    case FADE_STAGE:
-                        fireworksFade(s);
-                        break;
-                        default:
-                            fireworksWait(s);
-                            break;
+            case EXPLODE_STAGE:
+                fireworksExplode(s);
+                break;
+            case FADE_STAGE:
+                fireworksFade(s);
+                break;
+            default:
+                fireworksWait(s);
+                break;
+        }
     }
 }
@@ -0,0 +1,169 @@
+// Strip geometry: maps each pixel of a strip to XY and polar coordinates.
+//
+// The layout of a strip is read from /cfg/geometry/<strip> at startup and
+// compiled once into per-pixel lookup tables, so 2D patterns never need
+// trig or division per pixel. The file holds one line describing the layout:
+//
+//   matrix <width> <height>    serpentine matrix, first pixel bottom left
+//   ring                       pixels evenly spaced around a circle
+//   points                     followed by one "x,y" line per pixel
+//
+// Without a file the strip is treated as a straight line along x.
+
+#define GEOMETRY "/cfg/geometry/%s"
+
+// Allocates the per-pixel tables; matrices also get a (column, row) to pixel grid.
+bool allocGeometry(Geometry *g, uint16_t count) {
+    g->x = (uint8_t *) malloc(count);
+    g->y = (uint8_t *) malloc(count);
+    g->angle = (uint8_t *) malloc(count);
+    g->radius = (uint8_t *) malloc(count);
+    g->grid = g->kind == MATRIX_GEOMETRY ? (uint16_t *) malloc(g->width * g->height * sizeof(uint16_t)) : NULL;
+    return g->x && g->y && g->angle && g->radius && (g->kind != MATRIX_GEOMETRY || g->grid);
+}
+
+void freeGeometry(Geometry *g) {
+    free(g->x);
+    free(g->y);
+    free(g->angle);
+    free(g->radius);
+    free(g->grid);
+    g->x = g->y = g->angle = g->radius = NULL;
+    g->grid = NULL;
+}
+
+// Derives the polar coordinates of all pixels around the center of the XY space.
+void compilePolar(Geometry *g, uint16_t count) {
+    float maxr = 1;
+    for (uint16_t i = 0; i < count; i++) {
+        maxr = max(maxr, hypotf(g->x[i] - 127.5f, g->y[i] - 127.5f));
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        float dx = g->x[i] - 127.5f;
+        float dy = g->y[i] - 127.5f;
+        float a = atan2f(dy, dx);
+        g->angle[i] = (uint8_t) (int) (a * 128 / PI);
+        g->radius[i] = (uint8_t) (hypotf(dx, dy) * 255 / maxr);
+    }
+}
+
+void compileLinear(Geometry *g, uint16_t count) {
+    for (uint16_t i = 0; i < count; i++) {
+        g->x[i] = count > 1 ? i * 255 / (count - 1) : 0;
+        g->y[i] = 0;
+    }
+}
+
+void compileMatrix(Geometry *g, uint16_t count) {
+    uint8_t w = g->width, h = g->height;
+    for (uint16_t i = 0; i < w * h; i++) {
+        g->grid[i] = count;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t row = i / w;
+        uint16_t col = row & 1 ? w - 1 - i % w : i % w;
+        g->x[i] = w > 1 ? col * 255 / (w - 1) : 0;
+        g->y[i] = h > 1 ? min(row, (uint16_t) (h - 1)) * 255 / (h - 1) : 0;
+        if (row < h) {
+            g->grid[row * w + col] = i;
+        }
+    }
+}
+
+void compileRing(Geometry *g, uint16_t count) {
+    for (uint16_t i = 0; i < count; i++) {
+        float a = 2 * PI * i / count;
+        g->x[i] = (uint8_t) (127.5f + 127.5f * cosf(a));
+        g->y[i] = (uint8_t) (127.5f + 127.5f * sinf(a));
+    }
+}
+
+bool readPoint(File f, float *x, float *y) {
+    char line[32];
+    int l = f.available() ? f.readBytesUntil('\n', line, sizeof(line) - 1) : 0;
+    line[l] = '\0';
+    char *comma = strchr(line, ',');
+    *x = atof(line);
+    *y = comma ? atof(comma + 1) : 0;
+    return l > 0;
+}
+
+// Reads "x,y" lines in arbitrary units and scales them to fill the XY space.
+void compilePoints(Geometry *g, uint16_t count, File f) {
+    size_t start = f.position();
+    float x, y;
+    float minx = 1e9, miny = 1e9, maxx = -1e9, maxy = -1e9;
+    for (uint16_t i = 0; i < count; i++) {
+        readPoint(f, &x, &y);
+        minx = min(minx, x);
+        maxx = max(maxx, x);
+        miny = min(miny, y);
+        maxy = max(maxy, y);
+    }
+
+    f.seek(start, SeekSet);
+    float sx = maxx > minx ? 255 / (maxx - minx) : 0;
+    float sy = maxy > miny ? 255 / (maxy - miny) : 0;
+    for (uint16_t i = 0; i < count; i++) {
+        readPoint(f, &x, &y);
+        g->x[i] = (uint8_t) ((x - minx) * sx);
+        g->y[i] = (uint8_t) ((y - miny) * sy);
+    }
+}
+
+void loadGeometry(Strip *s) {
+    Geometry *g = s->geometry;
+    freeGeometry(g);
+    g->kind = LINEAR_GEOMETRY;
+    g->width = s->count;
+    g->height = 1;
+
+    char path[32];
+    snprintf(path, sizeof(path), GEOMETRY, s->name);
+    File f = SPIFFS.open(path, "r");
+    if (f) {
+        char field[32];
+        int l = f.readBytesUntil('\n', field, sizeof(field) - 1);
+        field[l] = '\0';
+        int w = 0, h = 0;
+        if (sscanf(field, "matrix %d %d", &w, &h) == 2 && w > 0 && h > 0 && w * h <= s->count) {
+            g->kind = MATRIX_GEOMETRY;
+            g->width = w;
+            g->height = h;
+        } else if (!strncmp(field, "ring", 4)) {
+            g->kind = RING_GEOMETRY;
+        } else if (!strncmp(field, "points", 6)) {
+            g->kind = POINTS_GEOMETRY;
+        }
+    }
+
+    if (!allocGeometry(g, s->count)) {
+        gizmo.debug("Unable to allocate %s geometry", s->name);
+        freeGeometry(g);
+        g->kind = LINEAR_GEOMETRY;
+        if (f) {
+            f.close();
+        }
+        return;
+    }
+
+    switch (g->kind) {
+        case MATRIX_GEOMETRY:
+            compileMatrix(g, s->count);
+            break;
+        case RING_GEOMETRY:
+            compileRing(g, s->count);
+            break;
+        case POINTS_GEOMETRY:
+            compilePoints(g, s->count, f);
+            break;
+        default:
+            compileLinear(g, s->count);
+            break;
+    }
+    compilePolar(g, s->count);
+
+    if (f) {
+        f.close();
+    }
+}
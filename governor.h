@@ -0,0 +1,138 @@
+// Load shedding governor.
+//
+// loop() never sleeps, so busy time says nothing about pressure: an idle lamp
+// spends all of its time polling. What shows pressure is renders starting
+// late. Every render records how long after it was due it started, and once
+// a second the lateness is compared with the frame periods it covered. While
+// renders keep starting late the governor sheds work one level at a time,
+// and it steps back down once they have been on time for a while:
+//
+//   slow       strips that are not sound reactive render at half their rate
+//   dedupe     the back strip mirrors the front instead of rendering its own pattern
+//   exclude    patterns whose renders cost more than a strip's share of the frame
+//              budget are left out of random rotation
+//
+// Animations are scaled by elapsed time (see simple.h), so a lower render rate
+// makes them less smooth but not slower.
+
+#define GOVERNOR_BUDGET         (1000000 / FRAMES_PER_SECOND)   // us per frame
+#define GOVERNOR_HIGH           30      // lateness, in percent of the frame period, that sheds another level
+#define GOVERNOR_LOW            10      // lateness low enough to count towards recovery
+#define GOVERNOR_STALL          250     // ms late beyond which a render counts as a restart, not as lateness
+#define GOVERNOR_RECOVERY       5       // low load evaluations before stepping back down
+#define GOVERNOR_TRIES          32      // random picks before an excluded pattern is accepted
+
+typedef enum {
+    GOVERNOR_NORMAL,
+    GOVERNOR_SLOW,
+    GOVERNOR_DEDUPE,
+    GOVERNOR_EXCLUDE
+} GovernorLevel;
+
+static const char *governorLevels[] = {"normal", "slow", "dedupe", "exclude"};
+
+typedef struct {
+    uint8_t level;
+    uint8_t quiet;              // consecutive low load evaluations
+    uint8_t load;               // render lateness in the last window, percent of the frame periods
+    uint8_t renderLoad;         // percent of the last window spent rendering
+    uint32_t late;              // running totals of render lateness and of frame periods, ms
+    uint32_t periods;
+    uint32_t renderBusy;        // running total of render us
+    uint32_t netPeak;           // longest network pass in the last window, us
+    uint32_t netPeakWindow;
+    uint32_t lastLate, lastPeriods, lastRender, lastTick;
+    uint32_t changes;
+    const char *cause;
+} Governor;
+
+Governor governor = {.level = GOVERNOR_NORMAL, .cause = ""};
+
+void governorNetPass(uint32_t us) {
+    governor.netPeakWindow = max(governor.netPeakWindow, us);
+}
+
+// Records how late a render started against its frame period, in ms.
+void governorLate(uint32_t late, uint32_t period) {
+    if (late < GOVERNOR_STALL) {
+        governor.late += min(late, period);
+        governor.periods += period;
+    }
+}
+
+// Records a render of the given pattern; cost excludes the push, busy includes it.
+void governorRender(Pattern *p, uint32_t cost, uint32_t busy) {
+    if (p) {
+        uint32_t c = min(cost, (uint32_t) UINT16_MAX);
+        p->cost = p->cost ? p->cost - (p->cost >> 3) + (c >> 3) : c;
+    }
+    governor.renderBusy += busy;
+}
+
+bool isOverBudget(const Pattern *p) {
+    return p->cost > GOVERNOR_BUDGET / 2;
+}
+
+bool governorExcludes(const Pattern *p) {
+    return governor.level >= GOVERNOR_EXCLUDE && isOverBudget(p);
+}
+
+bool governorDedupes() {
+    return governor.level >= GOVERNOR_DEDUPE;
+}
+
+// Render period of a pattern once load shedding is applied.
+uint32_t governedPause(const Pattern *p, uint32_t renderPause) {
+    return governor.level >= GOVERNOR_SLOW && !p->soundReactive ? max(renderPause, (uint32_t) 5) * 2 : renderPause;
+}
+
+// Evaluates the load since the last call and moves one level up or down.
+// Returns true if the level changed.
+bool governorTick() {
+    uint32_t now = micros();
+    uint32_t window = now - governor.lastTick;
+    uint32_t late = governor.late - governor.lastLate;
+    uint32_t periods = governor.periods - governor.lastPeriods;
+    uint32_t render = governor.renderBusy - governor.lastRender;
+    bool first = !governor.lastTick;
+    governor.lastTick = now;
+    governor.lastLate += late;
+    governor.lastPeriods += periods;
+    governor.lastRender += render;
+    governor.netPeak = governor.netPeakWindow;
+    governor.netPeakWindow = 0;
+    if (first || !window) {
+        return false;
+    }
+
+    // Strips that are off or not due render nothing and count as on time.
+    governor.load = periods ? late * 100 / periods : 0;
+    governor.renderLoad = min((uint64_t) render * 100 / window, (uint64_t) 100);
+
+    uint8_t level = governor.level;
+    if (governor.load >= GOVERNOR_HIGH) {
+        governor.quiet = 0;
+        if (level < GOVERNOR_EXCLUDE) {
+            governor.level++;
+            // Late renders are down to the renders themselves once they take most of the time.
+            governor.cause = governor.renderLoad >= 50 ? "render" : "network";
+        }
+    } else if (governor.load <= GOVERNOR_LOW) {
+        if (level > GOVERNOR_NORMAL && ++governor.quiet >= GOVERNOR_RECOVERY) {
+            governor.quiet = 0;
+            governor.level--;
+            governor.cause = governor.level ? governor.cause : "";
+        }
+    } else {
+        governor.quiet = 0;
+    }
+
+    if (governor.level == level) {
+        return false;
+    }
+    governor.changes++;
+    gizmo.debug("Governor %s -> %s: renders %d%% late, rendering %d%%, longest network pass %lu us",
+                governorLevels[level], governorLevels[governor.level], governor.load, governor.renderLoad,
+                (unsigned long) governor.netPeak);
+    return true;
+}
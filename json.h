@@ -0,0 +1,242 @@
+// Minimal streaming JSON writer.
+//
+// Output is accumulated in a single static buffer rather than in stack
+// temporaries. Chunked sinks (e.g. HTTP chunked responses) get the buffer
+// handed over whenever it fills up, so documents of any length can be
+// produced. Whole-message sinks (e.g. WebSocket text frames) get the
+// buffer only once the document is complete; if it would not fit, the
+// writer marks it as truncated and the sink is never called. Without a
+// sink, the finished document is simply left in jsonBuf.
+
+#define JSON_BUF_SIZE   2048
+
+typedef void (*JsonSink)(const char *, size_t);
+
+typedef struct {
+    JsonSink sink;
+    bool chunked;
+    bool comma;
+    bool truncated;
+    size_t len;
+} JsonWriter;
+
+static char jsonBuf[JSON_BUF_SIZE + 1];
+
+void jsonBegin(JsonWriter *w, JsonSink sink, bool chunked) {
+    w->sink = sink;
+    w->chunked = chunked;
+    w->comma = false;
+    w->truncated = false;
+    w->len = 0;
+}
+
+void jsonFlush(JsonWriter *w) {
+    jsonBuf[w->len] = '\0';
+    if (w->sink) {
+        if (w->len && !w->truncated) {
+            w->sink(jsonBuf, w->len);
+        }
+        w->len = 0;
+    }
+}
+
+void jsonWrite(JsonWriter *w, const char *s, size_t n) {
+    while (n && !w->truncated) {
+        size_t room = JSON_BUF_SIZE - w->len;
+        if (!room) {
+            if (w->chunked) {
+                jsonFlush(w);
+                continue;
+            }
+            w->truncated = true;
+            return;
+        }
+        size_t c = n < room ? n : room;
+        memcpy(jsonBuf + w->len, s, c);
+        w->len += c;
+        s += c;
+        n -= c;
+    }
+}
+
+void jsonRaw(JsonWriter *w, const char *s) {
+    jsonWrite(w, s, strlen(s));
+}
+
+void jsonChar(JsonWriter *w, char c) {
+    if (w->len < JSON_BUF_SIZE && !w->truncated) {
+        jsonBuf[w->len++] = c;
+    } else {
+        jsonWrite(w, &c, 1);
+    }
+}
+
+// Copies the string in runs, breaking only to escape quotes and backslashes.
+void jsonQuoted(JsonWriter *w, const char *s) {
+    jsonChar(w, '"');
+    const char *run = s;
+    const char *p = s;
+    for (; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            jsonWrite(w, run, p - run);
+            jsonChar(w, '\\');
+            run = p;
+        }
+    }
+    jsonWrite(w, run, p - run);
+    jsonChar(w, '"');
+}
+
+// Emits the separator and key for the next member; pass NULL for array elements.
+void jsonKey(JsonWriter *w, const char *key) {
+    if (w->comma) {
+        jsonChar(w, ',');
+    }
+    if (key) {
+        jsonQuoted(w, key);
+        jsonChar(w, ':');
+    }
+    w->comma = true;
+}
+
+void jsonObjectBegin(JsonWriter *w, const char *key) {
+    jsonKey(w, key);
+    jsonChar(w, '{');
+    w->comma = false;
+}
+
+void jsonObjectEnd(JsonWriter *w) {
+    jsonChar(w, '}');
+    w->comma = true;
+}
+
+void jsonString(JsonWriter *w, const char *key, const char *value) {
+    jsonKey(w, key);
+    jsonQuoted(w, value);
+}
+
+void jsonBool(JsonWriter *w, const char *key, bool value) {
+    jsonKey(w, key);
+    jsonRaw(w, value ? "true" : "false");
+}
+
+void jsonUInt(JsonWriter *w, const char *key, uint32_t value) {
+    char num[11];
+    char *p = num + sizeof(num);
+    do {
+        *--p = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    jsonKey(w, key);
+    jsonWrite(w, p, num + sizeof(num) - p);
+}
+
+void jsonInt(JsonWriter *w, const char *key, int32_t value) {
+    char num[12];
+    int l = snprintf(num, sizeof(num), "%ld", (long) value);
+    jsonKey(w, key);
+    jsonWrite(w, num, l);
+}
+
+// Writes a CSS style "#RRGGBB" color string.
+void jsonColor(JsonWriter *w, const char *key, CRGB c) {
+    static const char hex[] = "0123456789ABCDEF";
+    char css[9] = {'"', '#',
+                   hex[c.red >> 4], hex[c.red & 0xF],
+                   hex[c.green >> 4], hex[c.green & 0xF],
+                   hex[c.blue >> 4], hex[c.blue & 0xF], '"'};
+    jsonKey(w, key);
+    jsonWrite(w, css, sizeof(css));
+}
+
+// Writes a dotted quad IP address string without going through String.
+void jsonIp(JsonWriter *w, const char *key, uint32_t ip) {
+    char quad[17];
+    snprintf(quad, sizeof(quad), "%u.%u.%u.%u",
+             (unsigned) (ip & 0xFF), (unsigned) ((ip >> 8) & 0xFF),
+             (unsigned) ((ip >> 16) & 0xFF), (unsigned) (ip >> 24));
+    jsonString(w, key, quad);
+}
+
+// Completes the document and hands the remainder to the sink.
+// Returns false if the document had to be dropped.
+bool jsonEnd(JsonWriter *w) {
+    jsonFlush(w);
+    return !w->truncated;
+}
+
+// Minimal JSON reader for small, trusted-shape request bodies.
+
+// Returns the end (exclusive) of the object or array starting at p, or NULL if unbalanced.
+const char *jsonSkipValue(const char *p) {
+    int depth = 0;
+    bool quoted = false;
+    for (; *p; p++) {
+        if (quoted) {
+            if (*p == '\\' && p[1]) {
+                p++;
+            } else if (*p == '"') {
+                quoted = false;
+            }
+        } else if (*p == '"') {
+            quoted = true;
+        } else if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            if (--depth == 0) {
+                return p + 1;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Finds the value of a direct member of the object spanning [obj, end).
+// Returns a pointer to the first character of the value or NULL.
+const char *jsonMember(const char *obj, const char *end, const char *key) {
+    size_t kl = strlen(key);
+    int depth = 0;
+    for (const char *p = obj; p < end; p++) {
+        if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            depth--;
+        } else if (*p == '"') {
+            const char *k = p + 1;
+            const char *q = k;
+            while (q < end && *q != '"') {
+                q += *q == '\\' ? 2 : 1;
+            }
+            p = q;
+            if (depth != 1 || q >= end || (size_t) (q - k) != kl || strncmp(k, key, kl)) {
+                continue;
+            }
+            for (q++; q < end && *q == ' '; q++);
+            if (q >= end || *q != ':') {
+                continue;
+            }
+            for (q++; q < end && *q == ' '; q++);
+            return q < end ? q : NULL;
+        }
+    }
+    return NULL;
+}
+
+// Copies a scalar value (string contents or bare token) into value.
+bool jsonScalar(const char *p, char *value, size_t size) {
+    if (!p || !size) {
+        return false;
+    }
+    size_t n = 0;
+    if (*p == '"') {
+        for (p++; *p && *p != '"' && n < size - 1; p++) {
+            value[n++] = *p;
+        }
+    } else {
+        for (; *p && !strchr(",}] \t\r\n", *p) && n < size - 1; p++) {
+            value[n++] = *p;
+        }
+    }
+    value[n] = '\0';
+    return n > 0;
+}
@@ -5,8 +5,7 @@ void matrixUp(Strip *s) {
 
     s->leds[0] = ColorFromPalette(s->currentPalette, thishue++, sampleavg * 2, s->currentBlending);
 
-    for (int i = s->count - 1; i > 0; i--)
-        s->leds[i] = s->leds[i - 1];
+    lineit(s, 0);
 
     addGlitter(s, sampleavg / 2);
 }
@@ -17,8 +16,7 @@ void matrixDown(Strip *s) {
 
     s->leds[s->count - 1] = ColorFromPalette(s->currentPalette, thishue++, sampleavg * 2, s->currentBlending);
 
-    for (int i = 0; i < s->count - 1; i++)
-        s->leds[i] = s->leds[i + 1];
+    lineit(s, 1);
 
     addGlitter(s, sampleavg / 2);
 }
\ No newline at end of file
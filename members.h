@@ -0,0 +1,245 @@
+// Group membership for lamps sharing a sync channel.
+//
+// Peers are kept in an open addressed hash table keyed by IP, so handling a
+// HELLO is a constant time lookup rather than a scan of every slot. The master
+// (the lowest IP among live members, ourselves included) is maintained
+// incrementally as members join and leave; only the departure of the current
+// lowest member needs a rescan.
+//
+// Lamps that do not advertise a HELLO interval elect with LampSync's
+// determineMaster() over its peers[] table instead. While any of them are
+// present, members are mirrored into that table and its result is followed,
+// so that the whole group agrees on one master.
+//
+// HELLO intervals back off while membership is stable and drop back to the
+// base interval whenever a lamp joins or leaves. Each HELLO carries the
+// sender's current interval in the byte after its name, and members are timed
+// out after missing HELLO_MISSES of them, allowing for the sender's interval
+// doubling after each one. Older lamps leave that byte zero; while any are
+// present our interval stays short enough for their fixed PEER_TIMEOUT.
+
+#define MAX_MEMBERS         128     // power of two
+#define MEMBER_NAME_SIZE    32
+
+#define HELLO_INTERVAL      1000
+#define HELLO_MAX_INTERVAL  16000
+#define HELLO_MISSES        3
+
+typedef struct {
+    uint32_t ip;
+    uint32_t lastHeard;
+    uint32_t timeout;
+    char name[MEMBER_NAME_SIZE];
+    uint8_t spanPosition;       // see span.h
+    uint16_t spanCount;
+} Member;
+
+static Member members[MAX_MEMBERS];
+uint16_t memberCount = 0;
+uint16_t legacyMembers = 0;
+
+// Lowest member IP (or our own) and the resulting master IP.
+uint32_t lowestIp = 0;
+uint32_t masterIp = 0;
+
+uint32_t helloInterval = HELLO_INTERVAL;
+uint32_t nextHello = 0;
+bool membershipChanged = true;
+
+// IPs are stored in network order; compare them as dotted quads.
+inline uint32_t memberRank(uint32_t ip) {
+    return __builtin_bswap32(ip);
+}
+
+inline uint16_t memberSlot(uint32_t ip) {
+    return ((ip * 2654435761u) >> 16) & (MAX_MEMBERS - 1);
+}
+
+Member *findMember(uint32_t ip) {
+    for (uint16_t i = memberSlot(ip); members[i].ip; i = (i + 1) & (MAX_MEMBERS - 1)) {
+        if (members[i].ip == ip) {
+            return &members[i];
+        }
+    }
+    return NULL;
+}
+
+void updateMaster() {
+    if (legacyMembers) {
+        determineMaster();
+        masterIp = syncWithMaster ? peers[master].ip : peers[0].ip;
+    } else {
+        masterIp = syncWithMaster ? lowestIp : peers[0].ip;
+    }
+}
+
+// Refills LampSync's peers[] table from the members, for its election rule.
+void seedLegacyPeers() {
+    for (int i = 1; i < MAX_PEERS; i++) {
+        peers[i].ip = 0;
+        peers[i].lastHeard = 0;
+    }
+    for (uint16_t i = 0; i < MAX_MEMBERS; i++) {
+        if (members[i].ip) {
+            addPeer(members[i].ip, members[i].name);
+        }
+    }
+}
+
+void forgetLegacyPeer(uint32_t ip) {
+    for (int i = 1; i < MAX_PEERS; i++) {
+        if (peers[i].ip == ip) {
+            peers[i].ip = 0;
+            peers[i].lastHeard = 0;
+        }
+    }
+}
+
+// Full rescan; only needed when the lowest member leaves or our own IP changes.
+void electMaster() {
+    lowestIp = peers[0].ip;
+    for (uint16_t i = 0; i < MAX_MEMBERS; i++) {
+        if (members[i].ip && memberRank(members[i].ip) < memberRank(lowestIp)) {
+            lowestIp = members[i].ip;
+        }
+    }
+    updateMaster();
+}
+
+bool isGroupMaster(uint32_t ip) {
+    return ip == masterIp;
+}
+
+bool hasOtherMaster() {
+    return legacyMembers ? hasPotentialMaster() : lowestIp != peers[0].ip;
+}
+
+const char *masterName() {
+    Member *m = isGroupMaster(peers[0].ip) ? NULL : findMember(masterIp);
+    return m ? m->name : peers[0].name;
+}
+
+// Time to wait for HELLO_MISSES more HELLOs from a member that advertised the given
+// interval: it may back off after each one and adds up to an eighth at random.
+uint32_t memberTimeout(uint32_t interval) {
+    uint32_t timeout = 0;
+    for (int i = 0; i < HELLO_MISSES; i++) {
+        timeout += interval + interval / 8;
+        interval = min(interval * 2, (uint32_t) HELLO_MAX_INTERVAL);
+    }
+    return max((uint32_t) PEER_TIMEOUT, timeout);
+}
+
+// Records a HELLO; interval is the sender's advertised HELLO interval or 0 for older lamps.
+void helloFromMember(uint32_t ip, const char *name, uint32_t interval) {
+    bool hadLegacy = legacyMembers;
+    bool lowered = false;
+    Member *m = findMember(ip);
+    if (!m) {
+        if (memberCount == MAX_MEMBERS - 1) {
+            return;
+        }
+        uint16_t i = memberSlot(ip);
+        while (members[i].ip) {
+            i = (i + 1) & (MAX_MEMBERS - 1);
+        }
+        m = &members[i];
+        m->ip = ip;
+        m->timeout = 0;
+        m->spanPosition = 0;
+        m->spanCount = 0;
+        memberCount++;
+        legacyMembers++;
+        membershipChanged = true;
+        gizmo.debug("Added peer %s", IPAddress(ip).toString().c_str());
+
+        if (memberRank(ip) < memberRank(lowestIp)) {
+            lowestIp = ip;
+            lowered = true;
+        }
+    }
+
+    uint32_t timeout = interval ? memberTimeout(interval) : 0;
+    if (!timeout != !m->timeout) {
+        legacyMembers += timeout ? -1 : 1;
+    }
+    m->timeout = timeout;
+    m->lastHeard = millis();
+    m->name[0] = '\0';
+    strncat(m->name, name, MEMBER_NAME_SIZE - 1);
+
+    if (legacyMembers) {
+        if (hadLegacy) {
+            addPeer(ip, m->name);
+        } else {
+            seedLegacyPeers();
+        }
+    }
+    if (lowered || legacyMembers || hadLegacy) {
+        updateMaster();
+    }
+}
+
+// Backward shift deletion keeps probe chains intact without tombstones.
+void removeMember(uint16_t i) {
+    uint32_t ip = members[i].ip;
+    bool hadLegacy = legacyMembers;
+    if (!members[i].timeout) {
+        legacyMembers--;
+    }
+    members[i].ip = 0;
+    memberCount--;
+    membershipChanged = true;
+    gizmo.debug("Deleted peer %s", IPAddress(ip).toString().c_str());
+
+    for (uint16_t j = (i + 1) & (MAX_MEMBERS - 1); members[j].ip; j = (j + 1) & (MAX_MEMBERS - 1)) {
+        uint16_t home = memberSlot(members[j].ip);
+        if (((j - home) & (MAX_MEMBERS - 1)) >= ((j - i) & (MAX_MEMBERS - 1))) {
+            members[i] = members[j];
+            members[j].ip = 0;
+            i = j;
+        }
+    }
+
+    if (hadLegacy) {
+        forgetLegacyPeer(ip);
+    }
+    if (ip == lowestIp) {
+        electMaster();
+    } else if (hadLegacy) {
+        updateMaster();
+    }
+}
+
+// Drops members that have missed their HELLOs. Returns true if any were dropped.
+bool pruneMembers(uint32_t now) {
+    bool pruned = false;
+    for (uint16_t i = 0; i < MAX_MEMBERS; i++) {
+        while (members[i].ip &&
+               members[i].lastHeard + (members[i].timeout ? members[i].timeout : PEER_TIMEOUT) < now) {
+            removeMember(i);
+            pruned = true;
+        }
+    }
+    return pruned;
+}
+
+// Returns true when a HELLO is due and schedules the next one.
+bool helloDue(uint32_t now) {
+    if (now < nextHello) {
+        return false;
+    }
+    if (membershipChanged) {
+        helloInterval = HELLO_INTERVAL;
+        membershipChanged = false;
+    } else {
+        // Larger groups back off further, so the channel-wide HELLO rate stays roughly flat.
+        uint32_t limit = min((uint32_t) HELLO_MAX_INTERVAL, (uint32_t) HELLO_INTERVAL * (1 + memberCount / 4));
+        if (legacyMembers) {
+            limit = min(limit, (uint32_t) PEER_TIMEOUT / 2);
+        }
+        helloInterval = max((uint32_t) HELLO_INTERVAL, min(helloInterval * 2, limit));
+    }
+    nextHello = now + helloInterval + random16(helloInterval / 8);
+    return true;
+}
@@ -5,23 +5,27 @@ void fillnoise8(Strip *s) {
     // A random number for our noise generator.
     static uint16_t dist;
 
+    uint8_t *index = noiseBuffer(s->count);
+    if (!index) {
+        return;
+    }
+
+    // Get values from the noise function for the whole strip. I'm using both x and y axis.
+    fillNoise8(index, s->count, 0, SCALE, dist, SCALE);
+
     // Just ONE loop to fill up the LED array as all of the pixels change.
     for(int i = 0; i < s->count; i++) {
-        // Get a value from the noise function. I'm using both x and y axis.
-        uint8_t index = inoise8(i*SCALE, dist+i*SCALE);
         // With that value, look up the 8 bit colour palette value and assign it to the current LED.
-        s->leds[i] = ColorFromPalette(s->currentPalette, index, 255, s->currentBlending);
+        s->leds[i] = ColorFromPalette(s->currentPalette, index[i], 255, s->currentBlending);
     }
     // Moving along the distance (that random number we started out with). Vary it a bit with a sine wave.
-    dist += beatsin8(10,1, 4);
+    dist += frameDelta(s, beatsin8(10, 1, 4));
 }
 
 void noise(Strip *s) {
-    EVERY_X_MILLIS(s->t2, 10)
-        // Blend towards the target palette over 48 iterations
-        nblendPaletteTowardPalette(s->currentPalette, s->targetPalette, 48);
-        fillnoise8(s);
-    }
+    // Blend towards the target palette over 48 iterations
+    nblendPaletteTowardPalette(s->currentPalette, s->targetPalette, min(255, 48 * dueSteps(&s->t2, 10)));
+    fillnoise8(s);
 
     // Change the target palette to a random one every 5 seconds.
     EVERY_X_MILLIS(s->t4, 5000)
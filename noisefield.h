@@ -0,0 +1,105 @@
+// Batch 8-bit 2D noise along a strip.
+//
+// Produces the same values as FastLED's inoise8(x, y), but for a whole run of
+// pixels at once. Pixels only cross into a new lattice cell every 256 units of x
+// or y, and successive frames mostly revisit the same cells, so the four corner
+// hashes of each cell are kept in a small direct-mapped cache rather than being
+// re-derived through the permutation table for every pixel of every frame.
+
+// Ken Perlin's permutation table, as used by FastLED.
+static const uint8_t noisePerm[256] FL_PROGMEM = {
+        151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225,
+        140, 36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148,
+        247, 120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32,
+        57, 177, 33, 88, 237, 149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175,
+        74, 165, 71, 134, 139, 48, 27, 166, 77, 146, 158, 231, 83, 111, 229, 122,
+        60, 211, 133, 230, 220, 105, 92, 41, 55, 46, 245, 40, 244, 102, 143, 54,
+        65, 25, 63, 161, 1, 216, 80, 73, 209, 76, 132, 187, 208, 89, 18, 169,
+        200, 196, 135, 130, 116, 188, 159, 86, 164, 100, 109, 198, 173, 186, 3, 64,
+        52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118, 126, 255, 82, 85, 212,
+        207, 206, 59, 227, 47, 16, 58, 17, 182, 189, 28, 42, 223, 183, 170, 213,
+        119, 248, 152, 2, 44, 154, 163, 70, 221, 153, 101, 155, 167, 43, 172, 9,
+        129, 22, 39, 253, 19, 98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104,
+        218, 246, 97, 228, 251, 34, 242, 193, 238, 210, 144, 12, 191, 179, 162, 241,
+        81, 51, 145, 235, 249, 14, 239, 107, 49, 192, 214, 31, 181, 199, 106, 157,
+        184, 84, 204, 176, 115, 121, 50, 45, 127, 4, 150, 254, 138, 236, 205, 93,
+        222, 114, 67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180
+};
+
+#define NP(x) FL_PGM_READ_BYTE_NEAR(noisePerm + (uint8_t)(x))
+
+// Corner hashes of one lattice cell.
+typedef struct {
+    uint16_t key;
+    bool valid;
+    uint8_t aa, ba, ab, bb;
+} NoiseCell;
+
+#define NOISE_CELLS 16
+
+static NoiseCell noiseCells[NOISE_CELLS];
+
+// Scratch buffer for palette indexes produced by fillNoise8; grows to the longest strip.
+static uint8_t *noiseIndex = NULL;
+static uint16_t noiseIndexSize = 0;
+
+uint8_t *noiseBuffer(uint16_t n) {
+    if (n > noiseIndexSize) {
+        uint8_t *b = (uint8_t *) realloc(noiseIndex, n);
+        if (!b) {
+            return NULL;
+        }
+        noiseIndex = b;
+        noiseIndexSize = n;
+    }
+    return noiseIndex;
+}
+
+NoiseCell &noiseCell(uint8_t X, uint8_t Y) {
+    uint16_t key = X << 8 | Y;
+    NoiseCell &c = noiseCells[(X ^ (Y * 5)) & (NOISE_CELLS - 1)];
+    if (!c.valid || c.key != key) {
+        uint8_t A = NP(X) + Y;
+        uint8_t B = NP(X + 1) + Y;
+        c.aa = NP(NP(A));
+        c.ab = NP(NP(A + 1));
+        c.ba = NP(NP(B));
+        c.bb = NP(NP(B + 1));
+        c.key = key;
+        c.valid = true;
+    }
+    return c;
+}
+
+inline int8_t noiseGrad8(uint8_t hash, int8_t x, int8_t y) {
+    int8_t u = hash & 4 ? y : x;
+    int8_t v = hash & 4 ? x : y;
+    if (hash & 1) {
+        u = -u;
+    }
+    if (hash & 2) {
+        v = -v;
+    }
+    return avg7(u, v);
+}
+
+inline int8_t noiseLerp7by8(int8_t a, int8_t b, fract8 frac) {
+    return b > a ? a + scale8(b - a, frac) : a - scale8(a - b, frac);
+}
+
+// Fills out[0..n) with inoise8(x + i * dx, y + i * dy), using 16-bit wrap-around coordinates.
+void fillNoise8(uint8_t *out, uint16_t n, uint16_t x, int16_t dx, uint16_t y, int16_t dy) {
+    const int8_t N = 0x80;
+    for (uint16_t i = 0; i < n; i++, x += dx, y += dy) {
+        NoiseCell &c = noiseCell(x >> 8, y >> 8);
+        uint8_t u = ease8InOutQuad(x);
+        uint8_t v = ease8InOutQuad(y);
+        int8_t xx = ((uint8_t) x >> 1) & 0x7F;
+        int8_t yy = ((uint8_t) y >> 1) & 0x7F;
+
+        int8_t x1 = noiseLerp7by8(noiseGrad8(c.aa, xx, yy), noiseGrad8(c.ba, xx - N, yy), u);
+        int8_t x2 = noiseLerp7by8(noiseGrad8(c.ab, xx, yy - N), noiseGrad8(c.bb, xx - N, yy - N), u);
+        int8_t r = noiseLerp7by8(x1, x2, v) + 64;
+        out[i] = qadd8(r, r);
+    }
+}
@@ -0,0 +1,131 @@
+// Output stage: gamma, color correction, brightness and sleep dimming fused into
+// one lookup table per channel.
+//
+// Renderers draw into s->leds. At show time every pixel is mapped through the
+// strip's tables into s->output->out, which is the buffer the LED controller
+// actually sends, and the controller is shown at full scale. The tables are
+// only rebuilt when brightness or the dimmer change, from a 16-bit gamma curve,
+// so a slow fade costs one 768-entry rebuild per visible step instead of
+// per-pixel arithmetic, and low levels are rounded once instead of being
+// truncated by successive 8-bit scalings.
+//
+// Overlays (diagnostics, the WiFi status pixel) are composited into the
+// output buffer over the first OVERLAY_PIXELS pixels at show time, so they
+// never alter what the renderer drew and every frame is pushed exactly once.
+
+#define GAMMA "/cfg/gamma"
+#define OUTPUT_GAMMA        2.2
+#define OUTPUT_CORRECTION   TypicalLEDStrip
+#define OVERLAY_PIXELS      16
+
+struct OutputStageRec {
+    CRGB *out;
+    CRGB correction;
+    uint8_t brightness;
+    uint8_t dimmer;
+    bool ready;
+    uint8_t lut[3][256];
+    CRGB overlay[OVERLAY_PIXELS];
+    uint16_t overlayMask;
+};
+
+// Draws an overlay for the frame about to be shown, through setOverlay.
+typedef void (*Overlay)(Strip *);
+
+// Gamma curve scaled to 0..65535, shared by all strips.
+static uint16_t gammaTable[256];
+
+// Builds the gamma curve from /cfg/gamma if present; "1.0" restores linear output.
+void setupGamma() {
+    float gamma = OUTPUT_GAMMA;
+    File f = SPIFFS.open(GAMMA, "r");
+    if (f) {
+        char field[16];
+        int l = f.readBytesUntil('\n', field, sizeof(field) - 1);
+        field[l] = '\0';
+        f.close();
+        float g = atof(field);
+        gamma = g > 0.1 && g < 4.0 ? g : gamma;
+    }
+    for (int v = 0; v < 256; v++) {
+        gammaTable[v] = (uint16_t) (powf(v / 255.0f, gamma) * 65535.0f + 0.5f);
+    }
+}
+
+bool allocOutput(Strip *s) {
+    s->output = (OutputStage *) calloc(1, sizeof(OutputStage));
+    if (s->output) {
+        s->output->out = (CRGB *) calloc(s->count, sizeof(CRGB));
+        if (!s->output->out) {
+            free(s->output);
+            s->output = NULL;
+        }
+    }
+    if (s->output) {
+        s->output->correction = OUTPUT_CORRECTION;
+    }
+    return s->output != NULL;
+}
+
+void freeOutput(Strip *s) {
+    if (s->output) {
+        free(s->output->out);
+        free(s->output);
+        s->output = NULL;
+    }
+}
+
+inline uint16_t outputScale(uint8_t x) {
+    return x + (x >> 7);
+}
+
+// Rebuilds the tables for the given brightness and dimmer (0..255 each).
+void buildOutputLut(OutputStage *o, uint8_t brightness, uint8_t dimmer) {
+    for (int c = 0; c < 3; c++) {
+        // Combined scale as a 0..65536 fraction; each factor maps 0..255 onto 0..256.
+        uint32_t k = ((uint32_t) outputScale(o->correction.raw[c]) * outputScale(brightness) *
+                      outputScale(dimmer)) >> 8;
+        for (int v = 0; v < 256; v++) {
+            o->lut[c][v] = (uint8_t) (((uint64_t) gammaTable[v] * k * 255 + (1ULL << 31)) >> 32);
+        }
+    }
+    o->brightness = brightness;
+    o->dimmer = dimmer;
+    o->ready = true;
+}
+
+// Covers pixel i of the next shown frame with the given color.
+void setOverlay(Strip *s, uint16_t i, CRGB c) {
+    if (i < OVERLAY_PIXELS && i < s->count) {
+        s->output->overlay[i] = c;
+        s->output->overlayMask |= 1 << i;
+    }
+}
+
+// Maps the rendered pixels and any overlays through the output tables and sends them.
+void showOutput(Strip *s, uint8_t dimmer) {
+    OutputStage *o = s->output;
+    if (!o->ready || o->brightness != s->brightness || o->dimmer != dimmer) {
+        buildOutputLut(o, s->brightness, dimmer);
+    }
+
+    const uint8_t *r = o->lut[0];
+    const uint8_t *g = o->lut[1];
+    const uint8_t *b = o->lut[2];
+    const CRGB *in = s->leds;
+    CRGB *out = o->out;
+    for (uint16_t i = 0; i < s->count; i++) {
+        out[i].r = r[in[i].r];
+        out[i].g = g[in[i].g];
+        out[i].b = b[in[i].b];
+    }
+    for (uint16_t i = 0, mask = o->overlayMask; mask; i++, mask >>= 1) {
+        if (mask & 1) {
+            out[i].r = r[o->overlay[i].r];
+            out[i].g = g[o->overlay[i].g];
+            out[i].b = b[o->overlay[i].b];
+        }
+    }
+    o->overlayMask = 0;
+    s->ctl->showLeds(255);
+}
@@ -33,46 +33,68 @@ CRGBPalette16 pacifica_palette_3 =
         {0x000208, 0x00030E, 0x000514, 0x00061A, 0x000820, 0x000927, 0x000B2D, 0x000C33,
          0x000E39, 0x001040, 0x001450, 0x001860, 0x001C70, 0x002080, 0x1040BF, 0x2060FF};
 
-// Add one layer of waves into the led array
-void pacifica_one_layer(Strip *s, CRGBPalette16 &p, uint16_t cistart, uint16_t wavescale, uint8_t bri, uint16_t ioff) {
-    uint16_t ci = cistart;
-    uint16_t waveangle = ioff;
-    uint16_t wavescale_half = (wavescale / 2) + 20;
-    for (uint16_t i = 0; i < s->count; i++) {
-        waveangle += 250;
-        uint16_t s16 = sin16(waveangle) + 32768;
-        uint16_t cs = scale16(s16, wavescale_half) + wavescale_half;
-        ci += cs;
-        uint16_t sindex16 = sin16(ci) + 32768;
-        uint8_t sindex8 = scale16(sindex16, 240);
-        CRGB c = ColorFromPalette(p, sindex8, bri, LINEARBLEND);
-        s->leds[i] += c;
-    }
+// Per-layer wave state, advanced pixel by pixel in the fused loop below.
+typedef struct {
+    CRGBPalette16 *palette;
+    uint16_t ci;
+    uint16_t waveangle;
+    uint16_t wavescale_half;
+    uint8_t bri;
+} PacificaLayer;
+
+void pacifica_layer(PacificaLayer &l, CRGBPalette16 &p, uint16_t cistart, uint16_t wavescale, uint8_t bri, uint16_t ioff) {
+    l.palette = &p;
+    l.ci = cistart;
+    l.waveangle = ioff;
+    l.wavescale_half = (wavescale / 2) + 20;
+    l.bri = bri;
 }
 
-// Add extra 'white' to areas where the four layers of light have lined up brightly
-void pacifica_add_whitecaps(Strip *s) {
+// Color of one layer of waves at the next pixel
+inline CRGB pacifica_layer_step(PacificaLayer &l) {
+    l.waveangle += 250;
+    uint16_t s16 = sin16(l.waveangle) + 32768;
+    uint16_t cs = scale16(s16, l.wavescale_half) + l.wavescale_half;
+    l.ci += cs;
+    uint16_t sindex16 = sin16(l.ci) + 32768;
+    uint8_t sindex8 = scale16(sindex16, 240);
+    return ColorFromPalette(*l.palette, sindex8, l.bri, LINEARBLEND);
+}
+
+// Renders all four layers over the dim background blue-green, adds 'whitecaps' where
+// they line up brightly and deepens the blues and greens, all in a single pass.
+// Layers are summed in 16 bits and saturated once, which gives the same result as
+// saturating after each layer since all contributions are non-negative.
+void pacifica_render(Strip *s, PacificaLayer *layers) {
     uint8_t basethreshold = beatsin8(9, 55, 65);
     uint8_t wave = beat8(7);
 
     for (uint16_t i = 0; i < s->count; i++) {
+        uint16_t r = 2, g = 6, b = 10;
+        for (uint8_t k = 0; k < 4; k++) {
+            CRGB c = pacifica_layer_step(layers[k]);
+            r += c.r;
+            g += c.g;
+            b += c.b;
+        }
+        CRGB pixel(r > 255 ? 255 : r, g > 255 ? 255 : g, b > 255 ? 255 : b);
+
+        // Add extra 'white' to areas where the four layers of light have lined up brightly
         uint8_t threshold = scale8(sin8(wave), 20) + basethreshold;
         wave += 7;
-        uint8_t l = s->leds[i].getAverageLight();
+        uint8_t l = pixel.getAverageLight();
         if (l > threshold) {
             uint8_t overage = l - threshold;
             uint8_t overage2 = qadd8(overage, overage);
-            s->leds[i] += CRGB(overage, overage2, qadd8(overage2, overage2));
+            pixel += CRGB(overage, overage2, qadd8(overage2, overage2));
         }
-    }
-}
 
-// Deepen the blues and greens
-void pacifica_deepen_colors(Strip *s) {
-    for (uint16_t i = 0; i < s->count; i++) {
-        s->leds[i].blue = scale8(s->leds[i].blue, 145);
-        s->leds[i].green = scale8(s->leds[i].green, 200);
-        s->leds[i] |= CRGB(2, 5, 7);
+        // Deepen the blues and greens
+        pixel.blue = scale8(pixel.blue, 145);
+        pixel.green = scale8(pixel.green, 200);
+        pixel |= CRGB(2, 5, 7);
+
+        s->leds[i] = pixel;
     }
 }
 
@@ -94,20 +116,14 @@ void pacifica(Strip *s) {
     sCIStart3 -= (deltams1 * beatsin88(501, 5, 7));
     sCIStart4 -= (deltams2 * beatsin88(257, 4, 6));
 
-    // Clear out the LED array to a dim background blue-green
-    fill_solid(s->leds, s->count, CRGB(2, 6, 10));
-
-    // Render each of four layers, with different scales and speeds, that vary over time
-    pacifica_one_layer(s, pacifica_palette_1, sCIStart1, beatsin16(3, 11 * 256, 14 * 256), beatsin8(10, 70, 130),
-                       0 - beat16(301));
-    pacifica_one_layer(s, pacifica_palette_2, sCIStart2, beatsin16(4, 6 * 256, 9 * 256), beatsin8(17, 40, 80),
-                       beat16(401));
-    pacifica_one_layer(s, pacifica_palette_3, sCIStart3, 6 * 256, beatsin8(9, 10, 38), 0 - beat16(503));
-    pacifica_one_layer(s, pacifica_palette_3, sCIStart4, 5 * 256, beatsin8(8, 10, 28), beat16(601));
-
-    // Add brighter 'whitecaps' where the waves lines up more
-    pacifica_add_whitecaps(s);
+    // Set up each of four layers, with different scales and speeds, that vary over time
+    PacificaLayer layers[4];
+    pacifica_layer(layers[0], pacifica_palette_1, sCIStart1, beatsin16(3, 11 * 256, 14 * 256), beatsin8(10, 70, 130),
+                   0 - beat16(301));
+    pacifica_layer(layers[1], pacifica_palette_2, sCIStart2, beatsin16(4, 6 * 256, 9 * 256), beatsin8(17, 40, 80),
+                   beat16(401));
+    pacifica_layer(layers[2], pacifica_palette_3, sCIStart3, 6 * 256, beatsin8(9, 10, 38), 0 - beat16(503));
+    pacifica_layer(layers[3], pacifica_palette_3, sCIStart4, 5 * 256, beatsin8(8, 10, 28), beat16(601));
 
-    // Deepen the blues and greens a bit
-    pacifica_deepen_colors(s);
+    pacifica_render(s, layers);
 }
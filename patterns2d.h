@@ -0,0 +1,75 @@
+// Patterns rendered in the coordinate space of the strip geometry.
+
+#define NOISE2D_SCALE 3
+
+void noise2d(Strip *s) {
+    static uint16_t z = 0;
+    Geometry *g = s->geometry;
+    if (!g->x) {
+        return;
+    }
+
+    nblendPaletteTowardPalette(s->currentPalette, s->targetPalette, min(255, 48 * dueSteps(&s->t3, 10)));
+
+    for (uint16_t i = 0; i < s->count; i++) {
+        uint8_t index = inoise8(g->x[i] * NOISE2D_SCALE, g->y[i] * NOISE2D_SCALE, z);
+        s->leds[i] = ColorFromPalette(s->currentPalette, index, 255, s->currentBlending);
+    }
+    z += frameDelta(s, beatsin8(10, 4, 12));
+}
+
+void plasma2d(Strip *s) {
+    Geometry *g = s->geometry;
+    if (!g->x) {
+        return;
+    }
+
+    // Setting phase change for a couple of waves.
+    uint8_t thisPhase = beatsin8(6, 0, 255);
+    uint8_t thatPhase = beatsin8(7, 0, 255);
+    uint8_t cutoff = beatsin8(7, 0, 96);
+
+    for (uint16_t i = 0; i < s->count; i++) {
+        // One wave travels across the XY space, the other swirls around its center.
+        uint8_t colorIndex = cubicwave8(g->x[i] + g->y[i] / 2 + thisPhase) / 2 +
+                             cos8(g->angle[i] + g->radius[i] / 2 + thatPhase) / 2;
+        uint8_t thisBright = qsuba(colorIndex, cutoff);
+        s->leds[i] = ColorFromPalette(s->currentPalette, colorIndex, thisBright, LINEARBLEND);
+    }
+}
+
+// Flames rise up every column of a matrix; other layouts share one heat column mapped by height.
+void fire2d(Strip *s) {
+    Geometry *g = s->geometry;
+    if (!g->x) {
+        return;
+    }
+
+    EVERY_X_MILLIS(s->t2, 10)
+        setupHeatPalette();
+        fireSeed = random16() | 1;
+
+        if (g->kind == MATRIX_GEOMETRY && g->height >= 3) {
+            uint16_t h = g->height;
+            uint8_t coolMax = min(255, ((COOLING * 10) / h) + 2);
+            for (uint16_t col = 0; col < g->width; col++) {
+                byte *heat = s->data + col * h;
+                fireColumn(heat, h, coolMax, SPARKING);
+                for (uint16_t row = 0; row < h; row++) {
+                    uint16_t i = g->grid[row * g->width + col];
+                    if (i < s->count) {
+                        s->leds[i] = heatPalette[heat[row]];
+                    }
+                }
+            }
+        } else {
+            uint16_t len = min(s->count, (uint16_t) 32);
+            uint8_t coolMax = min(255, ((COOLING * 10) / len) + 2);
+            fireColumn(s->data, len, coolMax, SPARKING);
+            uint8_t *height = g->kind == LINEAR_GEOMETRY ? g->x : g->y;
+            for (uint16_t i = 0; i < s->count; i++) {
+                s->leds[i] = heatPalette[s->data[(height[i] * len) >> 8]];
+            }
+        }
+    }
+}
@@ -0,0 +1,160 @@
+// Bulk pixel kernels.
+//
+// The blends handle CRGB arrays as packed bytes, four at a time in a 32-bit
+// word (SIMD within a register). Every channel is scaled and blended the same way,
+// so all byte lanes are treated alike: the even and odd bytes of a word are
+// split into two words with 16 bits per lane, which leaves enough headroom
+// that products never carry into the neighbouring lane. Results are bit-exact
+// with the FastLED scalar code, for whichever scale8 and blend8 variants
+// FastLED was built with.
+//
+// Words are only loaded and stored at aligned addresses; the few bytes before
+// and after the aligned run of a range are done one at a time.
+//
+// Fades and fills are left to fadeToBlackBy, nscale8 and fill_solid: word
+// versions of those measured no faster than FastLED's own loops.
+//
+// tools/hosttest/pixeltest.cpp checks every kernel against the FastLED scalar
+// code for each variant and times both.
+
+#define SWAR_EVEN   0x00FF00FFu
+#define SWAR_ODD    0xFF00FF00u
+
+// Pixels per bulk call for renderers that compute their colors one pixel at a time.
+#define PIXEL_CHUNK 32
+
+// Per-lane multipliers equivalent to scale8(x, scale).
+inline uint16_t scaleFactor(uint8_t scale) {
+#if FASTLED_SCALE8_FIXED == 1
+    return scale + 1;
+#else
+    return scale;
+#endif
+}
+
+// (x * k) >> 8 in every byte lane; k is at most 256.
+inline uint32_t swarScale(uint32_t w, uint16_t k) {
+    return ((w & SWAR_EVEN) * k >> 8 & SWAR_EVEN) | ((w >> 8 & SWAR_EVEN) * k & SWAR_ODD);
+}
+
+inline uint8_t byteScale(uint8_t x, uint16_t k) {
+    return x * k >> 8;
+}
+
+// blend8(a, b, amount) in every byte lane.
+#if defined(FASTLED_BLEND_FIXED) && FASTLED_BLEND_FIXED == 1
+// (a * 256 + b + (b - a) * amount) >> 8, i.e. (a * (256 - amount) + b * (amount + 1)) >> 8,
+// which never exceeds 16 bits per lane.
+inline uint32_t swarBlend(uint32_t a, uint32_t b, uint8_t amount) {
+    uint16_t ka = 256 - amount, kb = amount + 1;
+    return (((a & SWAR_EVEN) * ka + (b & SWAR_EVEN) * kb) >> 8 & SWAR_EVEN) |
+           (((a >> 8 & SWAR_EVEN) * ka + (b >> 8 & SWAR_EVEN) * kb) & SWAR_ODD);
+}
+
+inline uint8_t byteBlend(uint8_t a, uint8_t b, uint8_t amount) {
+    return (a * (256 - amount) + b * (amount + 1)) >> 8;
+}
+#else
+// scale8(a, 255 - amount) + scale8(b, amount); the two halves never sum past 255.
+inline uint32_t swarBlend(uint32_t a, uint32_t b, uint8_t amount) {
+    return swarScale(a, scaleFactor(255 - amount)) + swarScale(b, scaleFactor(amount));
+}
+
+inline uint8_t byteBlend(uint8_t a, uint8_t b, uint8_t amount) {
+    return byteScale(a, scaleFactor(255 - amount)) + byteScale(b, scaleFactor(amount));
+}
+#endif
+
+// Bytes to handle one at a time before p is word aligned, at most n.
+inline size_t alignHead(const uint8_t *p, size_t n) {
+    return min((size_t) (-(uintptr_t) p & 3), n);
+}
+
+// Aligned word access to pixel bytes. Going through memcpy keeps it within the aliasing
+// rules, and the alignment hint still lets it compile to a single load or store.
+inline uint32_t loadWord(const uint8_t *p) {
+    uint32_t w;
+    memcpy(&w, __builtin_assume_aligned(p, 4), 4);
+    return w;
+}
+
+inline void storeWord(uint8_t *p, uint32_t w) {
+    memcpy(__builtin_assume_aligned(p, 4), &w, 4);
+}
+
+// Three words holding the color repeated, starting with the channel at byte offset phase.
+void colorWords(CRGB c, uint8_t phase, uint32_t words[3]) {
+    uint8_t pattern[15];
+    for (uint8_t i = 0; i < 15; i++) {
+        pattern[i] = c.raw[i % 3];
+    }
+    memcpy(words, pattern + phase, 12);
+}
+
+// Same as nblend(leds[i], src[i], amount) for every pixel; src may be unaligned.
+void blendPixels(CRGB *leds, const CRGB *src, uint16_t n, uint8_t amount) {
+    // nblend leaves the pixel alone at 0 and copies the overlay at 255.
+    if (!amount) {
+        return;
+    } else if (amount == 255) {
+        memmove(leds, src, n * sizeof(CRGB));
+        return;
+    }
+    uint8_t *p = (uint8_t *) leds;
+    const uint8_t *q = (const uint8_t *) src;
+    size_t len = n * sizeof(CRGB);
+
+    size_t head = alignHead(p, len);
+    for (size_t i = 0; i < head; i++) {
+        p[i] = byteBlend(p[i], q[i], amount);
+    }
+    size_t i = head;
+    for (; i + 4 <= len; i += 4) {
+        uint32_t b;
+        memcpy(&b, q + i, 4);
+        storeWord(p + i, swarBlend(loadWord(p + i), b, amount));
+    }
+    for (; i < len; i++) {
+        p[i] = byteBlend(p[i], q[i], amount);
+    }
+}
+
+// Same as nblend(leds[i], c, amount) for every pixel.
+void blendPixelsToward(CRGB *leds, uint16_t n, CRGB c, uint8_t amount) {
+    if (!amount) {
+        return;
+    } else if (amount == 255) {
+        fill_solid(leds, n, c);
+        return;
+    }
+    uint8_t *p = (uint8_t *) leds;
+    size_t len = n * sizeof(CRGB);
+
+    size_t head = alignHead(p, len);
+    for (size_t i = 0; i < head; i++) {
+        p[i] = byteBlend(p[i], c.raw[i % 3], amount);
+    }
+    uint32_t cw[3];
+    colorWords(c, head % 3, cw);
+    size_t i = head;
+    for (uint8_t j = 0; i + 4 <= len; i += 4, j = j < 2 ? j + 1 : 0) {
+        storeWord(p + i, swarBlend(loadWord(p + i), cw[j], amount));
+    }
+    for (; i < len; i++) {
+        p[i] = byteBlend(p[i], c.raw[i % 3], amount);
+    }
+}
+
+// Moves the pixels of a run of count by n places, towards the end when n is positive
+// and towards the start when negative. The n vacated pixels keep their old values.
+void shiftPixels(CRGB *leds, uint16_t count, int n) {
+    uint16_t d = abs(n);
+    if (!n || d >= count) {
+        return;
+    }
+    if (n > 0) {
+        memmove(leds + d, leds, (count - d) * sizeof(CRGB));
+    } else {
+        memmove(leds, leds + d, (count - d) * sizeof(CRGB));
+    }
+}
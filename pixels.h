@@ -1,12 +1,19 @@
 
 void pixels(Strip *s) {
-    uint16_t currLED = beatsin8(16, 0, 10);
+    uint16_t currLED = beatsin8(16, 0, 10) % s->count;
+    uint8_t amount = frameFade(s, 192);
 
-    for (int i = 0; i < s->count; i++) {
-        // Colour of the LED will be based on oldsample, while brightness is based on sampleavg.
-        CRGB c = ColorFromPalette(s->currentPalette, oldsample + i * 8, sampleavg, s->currentBlending);
+    // Pixel j shows color i, offset by currLED; colors are blended in a chunk at a time.
+    CRGB chunk[PIXEL_CHUNK];
+    for (uint16_t base = 0; base < s->count; base += PIXEL_CHUNK) {
+        uint16_t n = min((uint16_t) (s->count - base), (uint16_t) PIXEL_CHUNK);
+        for (uint16_t k = 0; k < n; k++) {
+            int i = (base + k + s->count - currLED) % s->count;
+            // Colour of the LED will be based on oldsample, while brightness is based on sampleavg.
+            chunk[k] = ColorFromPalette(s->currentPalette, oldsample + i * 8, sampleavg, s->currentBlending);
+        }
 
         // Blend the old value and the new value for a gradual transitioning.
-        nblend(s->leds[(i + currLED) % s->count], c, 192);
+        blendPixels(s->leds + base, chunk, n, amount);
     }
 }
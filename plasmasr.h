@@ -10,9 +10,9 @@ void plasmasr(Strip *s) {
     uint16_t colorIndex;
 
     // You can change direction and speed individually.
-    thisphase += beatsin8(6, -4, 4);
+    thisphase += frameDelta(s, (int8_t) beatsin8(6, -4, 4));
     // Two phase values to make a complex pattern. By Andrew Tuline.
-    thatphase += beatsin8(7, -4, 4);
+    thatphase += frameDelta(s, (int8_t) beatsin8(7, -4, 4));
 
     // For each of the LED's in the strand, set a brightness based on a wave as follows.
     for (int k = 0; k < s->count; k++) {
@@ -0,0 +1,299 @@
+// User uploadable per-pixel pattern programs.
+//
+// A program is a short straight-line bytecode run once per pixel on a small
+// stack of 16-bit values. It ends with exactly one output instruction that
+// colors the pixel. There are no jumps, so the cost of a program is known
+// once it has been validated: one step per instruction per pixel. Every
+// render gets a fixed step budget. A program too expensive to cover the
+// whole strip within it renders the strip in slices over successive frames
+// instead of stalling the loop.
+//
+// Programs are uploaded as hex over HTTP, validated and stored in SPIFFS,
+// and run through the "user1".."user4" entries in patterns[].
+
+#define PROGRAMS        4
+#define PROGRAM_SIZE    96
+#define PROGRAM_STACK   8
+#define PROGRAM_BUDGET  16384       // instruction steps per render
+#define PROGRAM "/cfg/program/%d"
+
+typedef enum {
+    // Inputs
+    VM_I = 1,       // -> pixel index
+    VM_N,           // -> pixel count
+    VM_T,           // -> milliseconds, low 16 bits
+    VM_HUE,         // -> strip hue
+    VM_AVG,         // -> sample average
+    VM_PEAK,        // -> sample peak
+    VM_K8,          // imm8 -> value
+    VM_K16,         // imm16 (little endian) -> value
+
+    // Stack
+    VM_DUP,         // a -> a a
+    VM_SWAP,        // a b -> b a
+    VM_DROP,        // a ->
+    VM_OVER,        // a b -> a b a
+
+    // Arithmetic, wrapping at 16 bits unless noted
+    VM_ADD,         // a b -> a + b
+    VM_SUB,         // a b -> a - b
+    VM_MUL,         // a b -> a * b
+    VM_SHL,         // imm8; a -> a << imm
+    VM_SHR,         // imm8; a -> a >> imm
+    VM_AND,         // a b -> a & b
+    VM_XOR,         // a b -> a ^ b
+    VM_QADD,        // a b -> qadd8(a, b)
+    VM_QSUB,        // a b -> qsub8(a, b)
+    VM_SCALE,       // a b -> scale8(a, b)
+
+    // Waves and noise, 8-bit results
+    VM_SIN8,        // a -> sin8(a)
+    VM_COS8,        // a -> cos8(a)
+    VM_CUBIC,       // a -> cubicwave8(a)
+    VM_TRI,         // a -> triwave8(a)
+    VM_BEAT,        // bpm -> beat8(bpm)
+    VM_BEATSIN,     // bpm lo hi -> beatsin8(bpm, lo, hi)
+    VM_NOISE,       // x y -> inoise8(x, y)
+
+    // Output; must be the last instruction
+    VM_PAL,         // index bri -> pixel from the strip palette
+    VM_HSV,         // h s v -> pixel
+    VM_RGB,         // r g b -> pixel
+
+    VM_OPS
+} ProgramOp;
+
+// Stack effect and immediate size of each instruction.
+typedef struct {
+    uint8_t pops;
+    uint8_t pushes;
+    uint8_t imm;
+} ProgramOpInfo;
+
+static const ProgramOpInfo programOps[VM_OPS] = {
+        {0, 0, 0},                                                          // unused
+        {0, 1, 0}, {0, 1, 0}, {0, 1, 0}, {0, 1, 0},                         // I N T HUE
+        {0, 1, 0}, {0, 1, 0}, {0, 1, 1}, {0, 1, 2},                         // AVG PEAK K8 K16
+        {1, 2, 0}, {2, 2, 0}, {1, 0, 0}, {2, 3, 0},                         // DUP SWAP DROP OVER
+        {2, 1, 0}, {2, 1, 0}, {2, 1, 0}, {1, 1, 1}, {1, 1, 1},              // ADD SUB MUL SHL SHR
+        {2, 1, 0}, {2, 1, 0}, {2, 1, 0}, {2, 1, 0}, {2, 1, 0},              // AND XOR QADD QSUB SCALE
+        {1, 1, 0}, {1, 1, 0}, {1, 1, 0}, {1, 1, 0},                         // SIN8 COS8 CUBIC TRI
+        {1, 1, 0}, {3, 1, 0}, {2, 1, 0},                                    // BEAT BEATSIN NOISE
+        {2, 0, 0}, {3, 0, 0}, {3, 0, 0}                                     // PAL HSV RGB
+};
+
+typedef struct {
+    uint8_t code[PROGRAM_SIZE];
+    uint8_t len;
+    uint8_t steps;      // instructions executed per pixel
+} ProgramCode;
+
+// Double buffered, so a program can be replaced while the render side runs the other copy.
+// The render side records the buffer it is running in running (buffer + 1, or 0 when idle),
+// and an install only writes to the inactive buffer once the render side has released it.
+typedef struct {
+    ProgramCode buffers[2];
+    std::atomic<uint8_t> active;
+    std::atomic<uint8_t> running;
+} ProgramSlot;
+
+static ProgramSlot programs[PROGRAMS];
+
+static const char programBusy[] = "program busy, try again";
+
+// Returns NULL if the program is valid, or a description of the first problem.
+const char *validateProgram(const uint8_t *code, uint8_t len, uint8_t *steps) {
+    uint8_t depth = 0;
+    *steps = 0;
+    if (!len) {
+        return "empty program";
+    }
+    for (uint8_t pc = 0; pc < len; (*steps)++) {
+        uint8_t op = code[pc];
+        if (!op || op >= VM_OPS) {
+            return "unknown instruction";
+        }
+        const ProgramOpInfo *info = &programOps[op];
+        if (pc + 1 + info->imm > len) {
+            return "truncated instruction";
+        }
+        if (depth < info->pops) {
+            return "stack underflow";
+        }
+        depth += info->pushes - info->pops;
+        if (depth > PROGRAM_STACK) {
+            return "stack overflow";
+        }
+        pc += 1 + info->imm;
+        bool output = op >= VM_PAL;
+        if (output != (pc == len)) {
+            return "program must end with one output instruction";
+        }
+    }
+    return NULL;
+}
+
+// Returns the slot running the given pattern, or -1.
+int programSlot(const Pattern *p) {
+    return !strncmp(p->name, "user", 4) && p->name[4] >= '1' && p->name[4] < '1' + PROGRAMS && !p->name[5] ?
+           p->name[4] - '1' : -1;
+}
+
+ProgramCode *activeProgram(int slot) {
+    if (slot < 0) {
+        return NULL;
+    }
+    ProgramCode *pc = &programs[slot].buffers[programs[slot].active.load(std::memory_order_acquire)];
+    return pc->len ? pc : NULL;
+}
+
+bool isProgramLoaded(const Pattern *p) {
+    return activeProgram(programSlot(p)) != NULL;
+}
+
+// Render side: takes the active buffer of a slot for the length of a render. The active
+// index is checked again after marking it, so that a buffer swapped out in between is not used.
+ProgramCode *acquireProgram(int slot) {
+    if (slot < 0) {
+        return NULL;
+    }
+    ProgramSlot *ps = &programs[slot];
+    uint8_t active;
+    do {
+        active = ps->active.load();
+        ps->running.store(active + 1);
+    } while (ps->active.load() != active);
+    ProgramCode *pc = &ps->buffers[active];
+    if (!pc->len) {
+        ps->running.store(0);
+        return NULL;
+    }
+    return pc;
+}
+
+void releaseProgram(int slot) {
+    programs[slot].running.store(0);
+}
+
+// Validates and installs a program; stores it in SPIFFS if save is set.
+const char *installProgram(int slot, const uint8_t *code, uint8_t len, bool save) {
+    uint8_t steps;
+    const char *error = validateProgram(code, len, &steps);
+    if (error) {
+        return error;
+    }
+    // Refuses a second install while the render side still runs the buffer the first one replaced.
+    uint8_t next = !programs[slot].active.load();
+    if (programs[slot].running.load() == next + 1) {
+        return programBusy;
+    }
+    ProgramCode *pc = &programs[slot].buffers[next];
+    memcpy(pc->code, code, len);
+    pc->len = len;
+    pc->steps = steps;
+    programs[slot].active.store(next);
+
+    if (save) {
+        char path[32];
+        snprintf(path, sizeof(path), PROGRAM, slot + 1);
+        File f = SPIFFS.open(path, "w");
+        if (f) {
+            f.write(code, len);
+            f.close();
+        }
+    }
+    return NULL;
+}
+
+void loadPrograms() {
+    for (int slot = 0; slot < PROGRAMS; slot++) {
+        char path[32];
+        snprintf(path, sizeof(path), PROGRAM, slot + 1);
+        File f = SPIFFS.open(path, "r");
+        if (f) {
+            uint8_t code[PROGRAM_SIZE];
+            int len = f.read(code, sizeof(code));
+            f.close();
+            const char *error = len > 0 ? installProgram(slot, code, len, false) : "empty program";
+            if (error) {
+                gizmo.debug("Program %d not loaded: %s", slot + 1, error);
+            }
+        }
+    }
+}
+
+inline CRGB runProgram(Strip *s, const ProgramCode *p, uint16_t i, uint16_t t) {
+    uint16_t stack[PROGRAM_STACK];
+    uint8_t sp = 0;
+    const uint8_t *code = p->code;
+    for (uint8_t pc = 0; pc < p->len;) {
+        uint16_t a, b;
+        switch (code[pc++]) {
+            case VM_I: stack[sp++] = i; break;
+            case VM_N: stack[sp++] = s->count; break;
+            case VM_T: stack[sp++] = t; break;
+            case VM_HUE: stack[sp++] = s->hue; break;
+            case VM_AVG: stack[sp++] = min(sampleavg, (uint16_t) 255); break;
+            case VM_PEAK: stack[sp++] = samplepeak; break;
+            case VM_K8: stack[sp++] = code[pc++]; break;
+            case VM_K16: stack[sp++] = code[pc] | code[pc + 1] << 8; pc += 2; break;
+
+            case VM_DUP: a = stack[sp - 1]; stack[sp++] = a; break;
+            case VM_SWAP: a = stack[sp - 1]; stack[sp - 1] = stack[sp - 2]; stack[sp - 2] = a; break;
+            case VM_DROP: sp--; break;
+            case VM_OVER: a = stack[sp - 2]; stack[sp++] = a; break;
+
+            case VM_ADD: b = stack[--sp]; stack[sp - 1] += b; break;
+            case VM_SUB: b = stack[--sp]; stack[sp - 1] -= b; break;
+            case VM_MUL: b = stack[--sp]; stack[sp - 1] *= b; break;
+            case VM_SHL: stack[sp - 1] <<= code[pc++] & 15; break;
+            case VM_SHR: stack[sp - 1] >>= code[pc++] & 15; break;
+            case VM_AND: b = stack[--sp]; stack[sp - 1] &= b; break;
+            case VM_XOR: b = stack[--sp]; stack[sp - 1] ^= b; break;
+            case VM_QADD: b = stack[--sp]; stack[sp - 1] = qadd8(stack[sp - 1], b); break;
+            case VM_QSUB: b = stack[--sp]; stack[sp - 1] = qsub8(stack[sp - 1], b); break;
+            case VM_SCALE: b = stack[--sp]; stack[sp - 1] = scale8(stack[sp - 1], b); break;
+
+            case VM_SIN8: stack[sp - 1] = sin8(stack[sp - 1]); break;
+            case VM_COS8: stack[sp - 1] = cos8(stack[sp - 1]); break;
+            case VM_CUBIC: stack[sp - 1] = cubicwave8(stack[sp - 1]); break;
+            case VM_TRI: stack[sp - 1] = triwave8(stack[sp - 1]); break;
+            case VM_BEAT: stack[sp - 1] = beat8(stack[sp - 1]); break;
+            case VM_BEATSIN:
+                b = stack[--sp];
+                a = stack[--sp];
+                stack[sp - 1] = beatsin8(stack[sp - 1], a, b);
+                break;
+            case VM_NOISE: b = stack[--sp]; stack[sp - 1] = inoise8(stack[sp - 1], b); break;
+
+            case VM_PAL:
+                return ColorFromPalette(s->currentPalette, stack[sp - 2], stack[sp - 1], s->currentBlending);
+            case VM_HSV:
+                return CHSV(stack[sp - 3], stack[sp - 2], stack[sp - 1]);
+            case VM_RGB:
+                return CRGB(stack[sp - 3], stack[sp - 2], stack[sp - 1]);
+        }
+    }
+    return CRGB::Black;
+}
+
+// Renderer for the user program patterns. s->t4 holds the next pixel when a program
+// needs more than one render to cover the strip.
+void userProgram(Strip *s) {
+    int slot = programSlot(s->pattern);
+    ProgramCode *p = acquireProgram(slot);
+    if (!p) {
+        fadeToBlackBy(s->leds, s->count, 20);
+        return;
+    }
+
+    uint16_t slice = min((uint32_t) s->count, max((uint32_t) 1, (uint32_t) PROGRAM_BUDGET / p->steps));
+    uint16_t i = s->t4 < s->count ? s->t4 : 0;
+    uint16_t t = millis();
+    for (uint16_t n = 0; n < slice; n++) {
+        s->leds[i] = runProgram(s, p, i, t);
+        i = i + 1 < s->count ? i + 1 : 0;
+    }
+    s->t4 = i;
+    releaseProgram(slot);
+}
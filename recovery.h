@@ -0,0 +1,145 @@
+#include <lwip/igmp.h>
+
+// Staged recovery from multicast loss.
+//
+// A lamp that has heard neither peers nor its buddy for ALONE_TIMEOUT used to
+// reboot, going dark and starting the STARTUP_MILLIS window over. It now
+// escalates one stage at a time, giving each stage RECOVERY_SETTLE to bring
+// peers back before trying the next:
+//
+//   rejoin     leave and re-join the multicast group (IGMP), keeping the socket
+//   rebind     close the sync socket and set it up again
+//   wifi       drop and re-establish the WiFi connection, then rebind
+//   restart    reboot, as before
+//
+// The loop and the renderer keep running throughout. Reboots done by the
+// last stage are counted in /cfg/reboots so that they survive the restart.
+
+#define REBOOTS             "/cfg/reboots"
+#define RECOVERY_SETTLE     30000
+
+typedef enum {
+    RECOVERY_IDLE,
+    RECOVERY_REJOIN,
+    RECOVERY_REBIND,
+    RECOVERY_WIFI,
+    RECOVERY_RESTART
+} RecoveryStage;
+
+static const char *recoveryStages[] = {"idle", "rejoin", "rebind", "wifi", "restart"};
+
+typedef struct {
+    RecoveryStage stage;
+    uint32_t started;           // when the first stage ran
+    uint32_t stageTime;         // when the current stage ran
+    bool rebindPending;         // rebind once WiFi is back
+    uint32_t recoveries;
+    uint32_t lastMillis;        // from the first stage to peers being heard again
+    RecoveryStage lastStage;    // the stage that brought them back
+    uint32_t attempts[RECOVERY_RESTART + 1];
+    uint32_t reboots;
+} Recovery;
+
+Recovery recovery = {.stage = RECOVERY_IDLE, .lastStage = RECOVERY_IDLE};
+
+// Multicast group address of the sync channel, learned from received packets.
+uint32_t groupIp = 0;
+
+void noteGroupPacket() {
+    IPAddress d = group.destinationIP();
+    if (d[0] >= 224 && d[0] <= 239) {
+        groupIp = (uint32_t) d;
+    }
+}
+
+void loadReboots() {
+    File f = SPIFFS.open(REBOOTS, "r");
+    if (f) {
+        char field[12];
+        int l = f.readBytesUntil('\n', field, sizeof(field) - 1);
+        field[l] = '\0';
+        f.close();
+        recovery.reboots = strtoul(field, NULL, 10);
+    }
+}
+
+void saveReboots() {
+    File f = SPIFFS.open(REBOOTS, "w");
+    if (f) {
+        f.printf("%lu\n", (unsigned long) recovery.reboots);
+        f.close();
+    }
+}
+
+bool rejoinGroup() {
+    if (!groupIp) {
+        return false;
+    }
+    ip4_addr_t g;
+    g.addr = groupIp;
+    igmp_leavegroup(IP4_ADDR_ANY4, &g);
+    return igmp_joingroup(IP4_ADDR_ANY4, &g) == ERR_OK;
+}
+
+void rebindGroup() {
+    group.stop();
+    setupSync();
+}
+
+// Runs a stage; returns false if it could not be attempted, so the next one should run right away.
+bool runRecoveryStage(RecoveryStage stage) {
+    recovery.attempts[stage]++;
+    gizmo.debug("Multicast recovery: %s", recoveryStages[stage]);
+    switch (stage) {
+        case RECOVERY_REJOIN:
+            return rejoinGroup();
+        case RECOVERY_REBIND:
+            rebindGroup();
+            return true;
+        case RECOVERY_WIFI:
+            recovery.rebindPending = true;
+            // Unlike disconnect(), this keeps the stored SSID and password.
+            WiFi.reconnect();
+            return true;
+        case RECOVERY_RESTART:
+            recovery.reboots++;
+            saveReboots();
+            gizmo.scheduleRestart();
+            return true;
+        default:
+            return true;
+    }
+}
+
+// Called about once a second while the lamp has been alone for too long.
+void recoveryStep(uint32_t now) {
+    if (recovery.rebindPending && WiFi.status() == WL_CONNECTED) {
+        recovery.rebindPending = false;
+        rebindGroup();
+    }
+    if (recovery.stage == RECOVERY_RESTART ||
+        (recovery.stage != RECOVERY_IDLE && now - recovery.stageTime < RECOVERY_SETTLE)) {
+        return;
+    }
+    if (recovery.stage == RECOVERY_IDLE) {
+        recovery.started = now;
+    }
+    do {
+        recovery.stage = (RecoveryStage) (recovery.stage + 1);
+    } while (!runRecoveryStage(recovery.stage) && recovery.stage < RECOVERY_RESTART);
+    recovery.stageTime = now;
+}
+
+// Called once peers or the buddy are heard again.
+void recoveryDone(uint32_t now) {
+    if (recovery.stage == RECOVERY_IDLE) {
+        return;
+    }
+    recovery.recoveries++;
+    recovery.lastMillis = now - recovery.started;
+    recovery.lastStage = recovery.stage;
+    recovery.stage = RECOVERY_IDLE;
+    recovery.rebindPending = false;
+    gizmo.debug("Multicast recovered by %s after %lu ms", recoveryStages[recovery.lastStage],
+                (unsigned long) recovery.lastMillis);
+}
@@ -15,35 +15,37 @@ void ripple(Strip *s) {
         step = -1;
     }
 
-    fadeToBlackBy(s->leds, s->count, 64);
-
-    switch (step) {
-        case -1:
-            center = random(s->count);
-            colour = (oldsample) % 255; // More peaks/s = higher the hue colour.
-            step = 0;
-            break;
-
-        case 0:
-            // Display the first pixel of the ripple.
-            s->leds[center] += ColorFromPalette(s->currentPalette, colour, 255, s->currentBlending);
-            step++;
-            break;
-
-        case maxsteps:                                                              // At the end of the ripples.
-            break;
-
-        default:                                                                    // Middle of the ripples.
-            // A spreading and fading pattern up the strand.
-            s->leds[(center + step + s->count) % s->count] +=
-                    ColorFromPalette(s->currentPalette, colour, 255 / step * 2, s->currentBlending);
-            // A spreading and fading pattern down the strand.
-            s->leds[(center - step + s->count) % s->count] +=
-                    ColorFromPalette(s->currentPalette, colour, 255 / step * 2, s->currentBlending);
-            step++;
-            break;
-
-    } // switch step
+    fadeFrame(s, s->leds, s->count, 64);
+
+    for (uint8_t n = frameSteps(s); n; n--) {
+        switch (step) {
+            case -1:
+                center = random(s->count);
+                colour = (oldsample) % 255; // More peaks/s = higher the hue colour.
+                step = 0;
+                break;
+
+            case 0:
+                // Display the first pixel of the ripple.
+                s->leds[center] += ColorFromPalette(s->currentPalette, colour, 255, s->currentBlending);
+                step++;
+                break;
+
+            case maxsteps:                                                              // At the end of the ripples.
+                break;
+
+            default:                                                                    // Middle of the ripples.
+                // A spreading and fading pattern up the strand.
+                s->leds[(center + step + s->count) % s->count] +=
+                        ColorFromPalette(s->currentPalette, colour, 255 / step * 2, s->currentBlending);
+                // A spreading and fading pattern down the strand.
+                s->leds[(center - step + s->count) % s->count] +=
+                        ColorFromPalette(s->currentPalette, colour, 255 / step * 2, s->currentBlending);
+                step++;
+                break;
+
+        } // switch step
+    }
 
     addGlitter(s, sampleavg);                                                        // Add glitter baesd on sampleavg.
 }
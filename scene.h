@@ -0,0 +1,152 @@
+// Scene presets.
+//
+// A scene is a binary snapshot of both strips: pattern, random mode, power,
+// brightness, hue, color and palette. Scenes are stored in SPIFFS as
+// /cfg/scene/<id> and a recall applies both strips in the same loop pass.
+// Patterns are stored by index, so a scene also holds a CRC of the pattern
+// names in catalog order and only firmware with the same catalog reads it.
+//
+// Peers learn of a recall from a single SCENE op holding just the scene ID
+// and a CRC of the scene. A peer holding an identical copy applies it
+// directly; any other peer asks the master for a full sync instead. Saving a
+// scene sends its bytes to peers in SCENE_DATA chunks, so that they hold the
+// same copy from then on.
+//
+//     SCENE       [version][id][crc lo][crc hi]
+//     SCENE_DATA  [version][id][crc lo][crc hi][offset][len][bytes...]
+
+#define SCENES              "/cfg/scene/%d"
+#define MAX_SCENES          16
+#define SCENE_VERSION       2
+#define SCENE               0xBB    // op codes not used by LampSync
+#define SCENE_DATA          0xBC
+#define SCENE_OP_SIZE       4
+#define SCENE_CHUNK         24      // keeps a chunk within what a single COLORS op already carries
+#define SCENE_NO_PATTERN    0xFF
+
+typedef struct __attribute__((packed)) {
+    uint8_t pattern;            // index into patterns[]
+    uint8_t randomMode;
+    uint8_t on;
+    uint8_t brightness;
+    uint8_t hue;
+    uint8_t color[3];
+    uint8_t palette[48];
+} StripScene;
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint16_t catalog;           // CRC of the pattern names, see patternCatalog()
+    StripScene strips[2];
+} Scene;
+
+typedef struct {
+    uint32_t recalls;
+    uint32_t peerRecalls;
+    uint32_t misses;            // peer recalls that fell back to a full sync
+    uint32_t saves;
+    uint32_t received;
+    uint32_t applyMicros;
+} SceneStats;
+
+SceneStats sceneStats;
+
+// Scene being received from the master in SCENE_DATA chunks.
+static struct {
+    uint8_t id;
+    uint16_t crc;
+    uint8_t chunks;             // bit per chunk received
+    Scene scene;
+} sceneTransfer;
+
+#define SCENE_CHUNKS        ((sizeof(Scene) + SCENE_CHUNK - 1) / SCENE_CHUNK)
+
+// CRC-16/CCITT over n more bytes; start from 0xFFFF.
+uint16_t crc16Update(uint16_t crc, const void *data, size_t n) {
+    const uint8_t *p = (const uint8_t *) data;
+    for (size_t i = 0; i < n; i++) {
+        crc ^= p[i] << 8;
+        for (uint8_t b = 0; b < 8; b++) {
+            crc = crc & 0x8000 ? crc << 1 ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+uint16_t sceneCrc(const Scene *scene) {
+    return crc16Update(0xFFFF, scene, sizeof(Scene));
+}
+
+bool isSceneId(int id) {
+    return id >= 1 && id <= MAX_SCENES;
+}
+
+bool readScene(uint8_t id, Scene *scene, uint16_t catalog) {
+    char path[24];
+    snprintf(path, sizeof(path), SCENES, id);
+    File f = SPIFFS.open(path, "r");
+    if (!f) {
+        return false;
+    }
+    bool ok = f.read((uint8_t *) scene, sizeof(Scene)) == sizeof(Scene);
+    f.close();
+    return ok && scene->version == SCENE_VERSION && scene->catalog == catalog;
+}
+
+bool writeScene(uint8_t id, const Scene *scene) {
+    char path[24];
+    snprintf(path, sizeof(path), SCENES, id);
+    File f = SPIFFS.open(path, "w");
+    if (!f) {
+        return false;
+    }
+    bool ok = f.write((const uint8_t *) scene, sizeof(Scene)) == sizeof(Scene);
+    f.close();
+    return ok;
+}
+
+void writeSceneOp(uint8_t *data, uint8_t id, uint16_t crc) {
+    data[0] = SCENE_VERSION;
+    data[1] = id;
+    data[2] = crc & 0xFF;
+    data[3] = crc >> 8;
+}
+
+// Adds the chunks of a scene to an envelope.
+void addSceneData(Envelope *e, uint8_t id, const Scene *scene) {
+    uint8_t data[SCENE_OP_SIZE + 2 + SCENE_CHUNK];
+    writeSceneOp(data, id, sceneCrc(scene));
+    for (uint8_t offset = 0; offset < sizeof(Scene); offset += SCENE_CHUNK) {
+        uint8_t len = min(sizeof(Scene) - offset, (size_t) SCENE_CHUNK);
+        data[SCENE_OP_SIZE] = offset;
+        data[SCENE_OP_SIZE + 1] = len;
+        memcpy(data + SCENE_OP_SIZE + 2, (const uint8_t *) scene + offset, len);
+        envelopeAdd(e, ALL_CTX, SCENE_DATA, data, SCENE_OP_SIZE + 2 + len);
+    }
+}
+
+// Collects a SCENE_DATA chunk and stores the scene once every chunk is in and the CRC matches.
+void sceneDataFromPeer(const uint8_t *data, uint16_t len) {
+    if (len < SCENE_OP_SIZE + 2 || data[0] != SCENE_VERSION || !isSceneId(data[1])) {
+        return;
+    }
+    uint16_t crc = data[2] | data[3] << 8;
+    uint8_t offset = data[SCENE_OP_SIZE];
+    uint8_t n = data[SCENE_OP_SIZE + 1];
+    if (offset % SCENE_CHUNK || offset + n > sizeof(Scene) || SCENE_OP_SIZE + 2 + n > len) {
+        return;
+    }
+    if (sceneTransfer.id != data[1] || sceneTransfer.crc != crc) {
+        sceneTransfer.id = data[1];
+        sceneTransfer.crc = crc;
+        sceneTransfer.chunks = 0;
+    }
+    memcpy((uint8_t *) &sceneTransfer.scene + offset, data + SCENE_OP_SIZE + 2, n);
+    sceneTransfer.chunks |= 1 << (offset / SCENE_CHUNK);
+    if (sceneTransfer.chunks == (1 << SCENE_CHUNKS) - 1) {
+        if (sceneCrc(&sceneTransfer.scene) == crc && writeScene(sceneTransfer.id, &sceneTransfer.scene)) {
+            sceneStats.received++;
+        }
+        sceneTransfer.id = 0;
+    }
+}
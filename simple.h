@@ -1,4 +1,135 @@
 
+// Time based animation.
+//
+// Renderers are tuned for one frame every |renderPause| + 1 ms, which is how far
+// apart EVERY_X_MILLIS fires. s->dt holds the time actually elapsed since the strip
+// was last rendered, and the helpers below scale per-frame fades, steps and
+// increments by it, so the render rate can change without changing the look.
+// Patterns with a renderPause of 0 render once per loop pass and are not scaled.
+
+#define FRAME_SCALE_MAX         (32 * 256)
+#define TRANSITION_PERIOD       10      // ms per step of the on/off transition
+
+// Tuned frame period, or 0 for patterns that render every pass.
+uint16_t framePeriod(Strip *s) {
+    return s->pattern && s->pattern->renderPause ? abs(s->pattern->renderPause) + 1 : 0;
+}
+
+// Elapsed time in periods, as 8.8 fixed point; a period of 0 counts every call as one.
+uint16_t periodScale(Strip *s, uint16_t period) {
+    return period ? min((uint32_t) s->dt * 256 / period, (uint32_t) FRAME_SCALE_MAX) : 256;
+}
+
+// Elapsed time in frames of the pattern's tuned period.
+uint16_t frameScale(Strip *s) {
+    return periodScale(s, framePeriod(s));
+}
+
+// Rounds 8.8 fixed point up or down at random in proportion to the fraction, so
+// that small per-frame amounts still add up correctly over many short frames.
+inline int32_t ditherRound(int32_t x88) {
+    return (x88 >> 8) + (random8() < (x88 & 0xFF));
+}
+
+// Scales a per-frame increment to the elapsed time.
+int16_t frameDelta(Strip *s, int16_t perFrame) {
+    return ditherRound((int32_t) perFrame * frameScale(s));
+}
+
+// Square root of a 0.16 fixed point fraction, in 0.16 fixed point, rounded down.
+uint16_t sqrtFraction(uint16_t x) {
+    uint32_t v = (uint32_t) x << 16;
+    uint32_t root = 0;
+    for (uint32_t bit = 1UL << 30; bit; bit >>= 2) {
+        if (v >= root + bit) {
+            v -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+    }
+    return root;
+}
+
+// What is left after a per-period fade of amount over scale periods (8.8 fixed point),
+// as 16.16 fixed point: (1 - amount / 256)^periods. The ESP8266 has no FPU, so this
+// takes repeated squaring for the whole periods and repeated square roots for the fraction.
+uint32_t fadeKeep(uint16_t scale, uint8_t amount) {
+    if (!amount) {
+        return 65536;
+    }
+    uint32_t base = (uint32_t) (256 - amount) << 8;
+    uint32_t keep = 65536;
+    for (uint32_t x = base, e = scale >> 8; e; e >>= 1) {
+        if (e & 1) {
+            keep = keep * x >> 16;
+        }
+        x = x * x >> 16;
+    }
+    for (uint16_t x = base, bit = 0x80; bit && (scale & (2 * bit - 1)) && keep; bit >>= 1) {
+        x = sqrtFraction(x);
+        if (scale & bit) {
+            keep = keep * x >> 16;
+        }
+    }
+    return keep;
+}
+
+// Scales a per-period fade (or blend) amount to a number of periods; fades compound,
+// so this is 1 - (1 - amount)^periods rather than a linear scaling.
+uint8_t scaledFade(uint16_t scale, uint8_t amount) {
+    if (scale == 256 || !amount) {
+        return amount;
+    }
+    return min((int32_t) 255, ditherRound((int32_t) (65536 - fadeKeep(scale, amount))));
+}
+
+uint8_t frameFade(Strip *s, uint8_t amount) {
+    return scaledFade(frameScale(s), amount);
+}
+
+// Same as fadeToBlackBy(leds, n, amount) once per tuned frame.
+void fadeFrame(Strip *s, CRGB *leds, uint16_t n, uint8_t amount) {
+    fadeToBlackBy(leds, n, frameFade(s, amount));
+}
+
+// Same as nscale8(leds, n, keep) once per tuned frame.
+void scaleFrame(Strip *s, CRGB *leds, uint16_t n, uint8_t keep) {
+    uint16_t scale = frameScale(s);
+    nscale8(leds, n, scale == 256 ? keep : 255 - scaledFade(scale, 255 - keep));
+}
+
+// Blend amount for the on/off transition. It steps every TRANSITION_PERIOD whatever
+// pattern was showing, so switching takes the same time, about two seconds, for all of them.
+uint8_t transitionFade(Strip *s) {
+    return scaledFade(periodScale(s, TRANSITION_PERIOD), 8);
+}
+
+// Whole frames elapsed since the last call, carrying the remainder over.
+uint8_t frameSteps(Strip *s) {
+    s->drift += frameScale(s);
+    uint8_t n = s->drift >> 8;
+    s->drift &= 0xFF;
+    return n;
+}
+
+// Number of times EVERY_X_MILLIS(*t, period) would have fired since *t, that is one
+// step every period + 1 ms, moving *t past them. After a long gap (first use, pattern
+// change) it resynchronises with a single step.
+uint8_t dueSteps(uint32_t *t, uint32_t period) {
+    uint32_t now = millis();
+    if (now < *t) {
+        return 0;
+    }
+    uint32_t n = (now - *t) / (period + 1) + 1;
+    if (n > 8) {
+        *t = now + period + 1;
+        return 1;
+    }
+    *t += n * (period + 1);
+    return n;
+}
+
 void solid(Strip *s) {
     fill_solid(s->leds, s->count, s->color);
 }
@@ -10,13 +141,13 @@ void test(Strip *s) {
 }
 
 void addGlitter(Strip *s, fract8 chanceOfGlitter) {
-    if (random8() < chanceOfGlitter) {
+    if (random8() < min((uint32_t) 255, (uint32_t) chanceOfGlitter * frameScale(s) >> 8)) {
         s->leds[random16(s->count)] += CRGB::White;
     }
 }
 
 void glitter(Strip *s) {
-    fadeToBlackBy(s->leds, s->count, 20);
+    fadeFrame(s, s->leds, s->count, 20);
     addGlitter(s, 80);
 }
 
@@ -29,31 +160,38 @@ void rainbowWithGlitter(Strip *s) {
     addGlitter(s, 80);
 }
 
-// Send the pixels one or the other direction down the line.
+// Send the pixels one or the other direction down the line, one pixel per elapsed
+// frame; the pixel entering at the end is repeated to fill the gap.
 void lineit(Strip *s, int thisdir) {
+    int n = min((int) frameSteps(s), s->count - 1);
+    if (!n) {
+        return;
+    }
     if (thisdir == 0) {
-        for (int i = s->count - 1; i > 0; i--) {
-            s->leds[i] = s->leds[i - 1];
-        }
+        shiftPixels(s->leds, s->count, n);
+        fill_solid(s->leds + 1, n - 1, s->leds[0]);
     } else {
-        for (int i = 0; i < s->count - 1; i++) {
-            s->leds[i] = s->leds[i + 1];
-        }
+        shiftPixels(s->leds, s->count, -n);
+        fill_solid(s->leds + s->count - n, n - 1, s->leds[s->count - 1]);
     }
 }
 
 
-// Shifting pixels from the center to the left and right.
+// Shifting pixels from the center to the left and right, one pixel per elapsed frame.
 void waveit(Strip *s) {
-    // Move to the right.
-    for (int i = s->count - 1; i > s->count / 2; i--) {
-        s->leds[i] = s->leds[i - 1];
+    int half = s->count / 2;
+    int n = min((int) frameSteps(s), half - 1);
+    if (n <= 0) {
+        return;
     }
 
+    // Move to the right.
+    shiftPixels(s->leds + half, s->count - half, n);
+    fill_solid(s->leds + half + 1, n - 1, s->leds[half]);
+
     // Move to the left.
-    for (int i = 0; i < s->count / 2; i++) {
-        s->leds[i] = s->leds[i + 1];
-    }
+    shiftPixels(s->leds, half + 1, -n);
+    fill_solid(s->leds + half - n + 1, n - 1, s->leds[half]);
 }
 
 
@@ -63,14 +201,14 @@ void cycle(Strip *s) {
 
 void confetti(Strip *s) {
     // random colored speckles that blink in and fade smoothly
-    fadeToBlackBy(s->leds, s->count, 10);
+    fadeFrame(s, s->leds, s->count, 10);
     int pos = random16(s->count);
     s->leds[pos] += CHSV(s->hue + random8(64), 200, 255);
 }
 
 void sinelon(Strip *s) {
     // a colored dot sweeping back and forth, with fading trails
-    fadeToBlackBy(s->leds, s->count, 20);
+    fadeFrame(s, s->leds, s->count, 20);
     int pos = beatsin16(13, 0, s->count - 1);
     s->leds[pos] += CHSV(s->hue, 255, 192);
 }
@@ -86,7 +224,7 @@ void bpm(Strip *s) {
 
 void juggle(Strip *s) {
     // eight colored dots, weaving in and out of sync with each other
-    fadeToBlackBy(s->leds, s->count, 20);
+    fadeFrame(s, s->leds, s->count, 20);
     byte dothue = 0;
     for (int i = 0; i < 8; i++) {
         s->leds[beatsin16(i + 7, 0, s->count - 1)] |= CHSV(dothue, 200, 255);
@@ -95,7 +233,7 @@ void juggle(Strip *s) {
 }
 
 void gradient(Strip *s) {
-    CRGB entries[16] = s->currentPalette.entries;
+    const CRGB *entries = s->currentPalette.entries;
     fill_gradient_RGB(s->leds, s->count, entries[0], entries[5], entries[10], entries[15]);
 }
 
@@ -113,14 +251,19 @@ int shift(int v, int min, int max, int d) {
 #define C2 CRGB::Cyan
 
 void blend(Strip *s, CRGB c, int f, int t) {
-    for (int i = f; i < t; i++) {
-        s->leds[i] = blend(s->leds[i], c, 8);
+    if (t > f) {
+        blendPixelsToward(s->leds + f, t - f, c, frameFade(s, 8));
     }
 }
 
 void vibrancy(Strip *s) {
-    static int b1 = LED_COUNT * 0.3;
-    static int b2 = LED_COUNT * 0.7;
+    static int b1 = 0;
+    static int b2 = 0;
+
+    if (!b2 || b2 > s->count - 6) {
+        b1 = s->count * 0.3;
+        b2 = s->count * 0.7;
+    }
 
     EVERY_X_MILLIS(s->t2, 2000)
         b1 = shift(b1, 6, b2, random(3) - 1);
@@ -154,23 +297,27 @@ void pride(Strip *s) {
     sPseudotime += deltams * msmultiplier;
     sHue16 += deltams * beatsin88(400, 5, 9);
     uint16_t brightnesstheta16 = sPseudotime;
-
-    for (uint16_t i = 0; i < s->count; i++) {
-        hue16 += hueinc16;
-        uint8_t hue8 = hue16 / 256;
-
-        brightnesstheta16 += brightnessthetainc16;
-        uint16_t b16 = sin16(brightnesstheta16) + 32768;
-
-        uint16_t bri16 = (uint32_t)((uint32_t) b16 * (uint32_t) b16) / 65536;
-        uint8_t bri8 = (uint32_t)(((uint32_t) bri16) * brightdepth) / 65536;
-        bri8 += (255 - brightdepth);
-
-        CRGB newcolor = CHSV(hue8, sat8, bri8);
-
-        uint16_t pixelnumber = i;
-        pixelnumber = (s->count - 1) - pixelnumber;
-
-        nblend(s->leds[pixelnumber], newcolor, 64);
+    uint8_t amount = frameFade(s, 64);
+
+    // Colors are generated from the last pixel backwards, a chunk at a time, and
+    // each chunk is blended in with one bulk call.
+    CRGB chunk[PIXEL_CHUNK];
+    for (uint16_t base = s->count; base > 0;) {
+        uint16_t n = min(base, (uint16_t) PIXEL_CHUNK);
+        base -= n;
+        for (uint16_t k = n; k-- > 0;) {
+            hue16 += hueinc16;
+            uint8_t hue8 = hue16 / 256;
+
+            brightnesstheta16 += brightnessthetainc16;
+            uint16_t b16 = sin16(brightnesstheta16) + 32768;
+
+            uint16_t bri16 = (uint32_t)((uint32_t) b16 * (uint32_t) b16) / 65536;
+            uint8_t bri8 = (uint32_t)(((uint32_t) bri16) * brightdepth) / 65536;
+            bri8 += (255 - brightdepth);
+
+            chunk[k] = CHSV(hue8, sat8, bri8);
+        }
+        blendPixels(s->leds + base, chunk, n, amount);
     }
 }
\ No newline at end of file
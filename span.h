@@ -0,0 +1,155 @@
+// Virtual strip spanning a row of lamps.
+//
+// A lamp given a position in the row (/cfg/span) announces it, with the pixel
+// count of its front strip, in the bytes after the HELLO interval. Every lamp
+// orders the announced lamps by position, ties broken by IP, and works out
+// where its own front strip sits in one long virtual strip: s->offset pixels
+// from the start of a strip s->span pixels long.
+//
+// HELLOs also carry the sender's clock and every lamp follows the group
+// master's, so the span patterns below are pure functions of the global
+// pixel index and the shared time. Each lamp renders only its own slice, no
+// pixel data crosses the network, and the slices meet without seams. On a
+// lamp that is not part of a span they simply cover its own strip.
+
+#define SPAN "/cfg/span"
+#define SPAN_HELLO_SIZE     7       // [position + 1][count lo][count hi][clock, 4 bytes, little endian]
+
+#define SPAN_CHASE_SPEED    40      // pixels per second
+#define SPAN_CHASE_TAIL     24
+#define SPAN_FIRE_SCALE     40
+
+// Our position in the row plus one; 0 when not spanning.
+uint8_t spanPosition = 0;
+
+// Group master's clock minus ours.
+int32_t clockOffset = 0;
+
+// Milliseconds on the group master's clock.
+uint32_t groupMillis() {
+    return isGroupMaster(peers[0].ip) ? millis() : millis() + clockOffset;
+}
+
+inline uint16_t virtualLength(const Strip *s) {
+    return s->span ? s->span : s->count;
+}
+
+void loadSpan() {
+    File f = SPIFFS.open(SPAN, "r");
+    if (f) {
+        char field[8];
+        int l = f.readBytesUntil('\n', field, sizeof(field) - 1);
+        field[l] = '\0';
+        f.close();
+        int position = atoi(field);
+        spanPosition = l && position >= 0 && position < 255 ? position + 1 : 0;
+    }
+}
+
+// Sets our position in the row, or leaves the span with a negative position.
+void saveSpan(int position) {
+    spanPosition = position >= 0 && position < 255 ? position + 1 : 0;
+    if (spanPosition) {
+        File f = SPIFFS.open(SPAN, "w");
+        if (f) {
+            f.printf("%d\n", position);
+            f.close();
+        }
+    } else {
+        SPIFFS.remove(SPAN);
+    }
+}
+
+// Appends our span announcement to a HELLO.
+void writeSpanHello(uint8_t *data, const Strip *s) {
+    uint32_t now = groupMillis();
+    data[0] = spanPosition;
+    data[1] = s->count & 0xFF;
+    data[2] = s->count >> 8;
+    data[3] = now & 0xFF;
+    data[4] = now >> 8;
+    data[5] = now >> 16;
+    data[6] = now >> 24;
+}
+
+// Records the span announcement of a member; older lamps send zeros, which means no span.
+void spanFromHello(uint32_t ip, const uint8_t *data, uint16_t len) {
+    Member *m = findMember(ip);
+    if (!m || len < SPAN_HELLO_SIZE) {
+        return;
+    }
+    m->spanPosition = data[0];
+    m->spanCount = data[1] | data[2] << 8;
+    uint32_t clock = data[3] | data[4] << 8 | data[5] << 16 | (uint32_t) data[6] << 24;
+    if (clock && isGroupMaster(ip)) {
+        clockOffset = clock - millis();
+    }
+}
+
+// Places the strip in the virtual strip made up of every spanning member's strip.
+void layoutSpan(Strip *s) {
+    uint32_t offset = 0;
+    uint32_t length = s->count;
+    if (spanPosition) {
+        uint32_t rank = memberRank(peers[0].ip);
+        for (uint16_t i = 0; i < MAX_MEMBERS; i++) {
+            Member *m = &members[i];
+            if (m->ip && m->spanPosition) {
+                length += m->spanCount;
+                if (m->spanPosition < spanPosition ||
+                    (m->spanPosition == spanPosition && memberRank(m->ip) < rank)) {
+                    offset += m->spanCount;
+                }
+            }
+        }
+    }
+    length = min(length, (uint32_t) UINT16_MAX);
+    s->offset = min(offset, length - s->count);
+    s->span = length;
+}
+
+// Noise field flowing through the whole span.
+void spanNoise(Strip *s) {
+    uint8_t *index = noiseBuffer(s->count);
+    if (!index) {
+        return;
+    }
+    uint16_t x = s->offset * SCALE;
+    fillNoise8(index, s->count, x, SCALE, (groupMillis() >> 3) + x, SCALE);
+    for (uint16_t i = 0; i < s->count; i++) {
+        s->leds[i] = ColorFromPalette(s->currentPalette, index[i], 255, s->currentBlending);
+    }
+}
+
+// A comet running from lamp to lamp along the span.
+void spanChase(Strip *s) {
+    uint32_t now = groupMillis();
+    uint16_t length = virtualLength(s);
+    uint16_t head = (uint64_t) now * SPAN_CHASE_SPEED / 1000 % length;
+    uint8_t hue = now >> 6;
+    for (uint16_t i = 0; i < s->count; i++) {
+        uint16_t behind = (head + length - (s->offset + i) % length) % length;
+        s->leds[i] = behind < SPAN_CHASE_TAIL ?
+                     ColorFromPalette(s->currentPalette, hue, dim8_video(255 - behind * 255 / SPAN_CHASE_TAIL),
+                                      s->currentBlending) : CRGB::Black;
+    }
+}
+
+void spanRainbow(Strip *s) {
+    fill_rainbow(s->leds, s->count, groupMillis() / 20 + s->offset * 7, 7);
+}
+
+// Flames drawn from a noise field drifting along the span; the heat simulation of
+// the fire patterns depends on neighbouring pixels, so it cannot be split between lamps.
+void spanFire(Strip *s) {
+    setupHeatPalette();
+    uint8_t *index = noiseBuffer(s->count);
+    if (!index) {
+        return;
+    }
+    uint32_t now = groupMillis();
+    fillNoise8(index, s->count, s->offset * SPAN_FIRE_SCALE - (now >> 2), SPAN_FIRE_SCALE, now, 0);
+    for (uint16_t i = 0; i < s->count; i++) {
+        s->leds[i] = heatPalette[qsub8(index[i], 40)];
+    }
+}
@@ -0,0 +1,38 @@
+#include <atomic>
+
+// Lock-free single-producer/single-consumer ring buffer.
+//
+// Exactly one thread may push and exactly one thread may pop. The producer
+// only writes head and the consumer only writes tail, so plain atomic loads
+// and stores with acquire/release ordering are enough; no read-modify-write
+// atomics are needed, which the ESP8266 does not have. N must be a power of two.
+template<typename T, uint32_t N>
+struct SpscQueue {
+    T items[N];
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+
+    bool push(const T &item) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        items[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = items[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint32_t size() {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+};
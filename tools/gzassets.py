@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""Minifies and gzips the web assets listed in data/catalog.
+
+Writes <asset>.gz next to each asset and an /etags manifest with one
+"<path> <gzip etag> <plain etag>" line per asset. Each ETag is derived from
+the content hash of the file it is sent with, so that the compressed and
+the plain response never share one. Run before uploading the SPIFFS image:
+
+    tools/gzassets.py [data-dir]
+"""
+
+import gzip
+import hashlib
+import os
+import sys
+
+
+def minify(path, content):
+    # Conservative: only indentation and blank lines go, so inline scripts keep working.
+    if path.endswith(('.html', '.css', '.js')) and not path.endswith('.min.js'):
+        text = content.decode('utf-8')
+        lines = (line.strip() for line in text.splitlines())
+        text = '\n'.join(line for line in lines if line)
+        return text.encode('utf-8')
+    return content
+
+
+def etag(content):
+    return '"%s"' % hashlib.sha1(content).hexdigest()[:16]
+
+
+def main():
+    data = sys.argv[1] if len(sys.argv) > 1 else os.path.join(os.path.dirname(__file__), '..', 'data')
+    with open(os.path.join(data, 'catalog')) as f:
+        paths = [line.strip() for line in f if line.strip()]
+
+    before = after = 0
+    etags = []
+    for path in paths:
+        source = os.path.join(data, path.lstrip('/'))
+        with open(source, 'rb') as f:
+            content = f.read()
+        packed = gzip.compress(minify(path, content), 9, mtime=0)
+        if len(packed) >= len(content):
+            print('%-16s %7d bytes, not compressible' % (path, len(content)))
+            packed = None
+            if os.path.exists(source + '.gz'):
+                os.remove(source + '.gz')
+        else:
+            with open(source + '.gz', 'wb') as f:
+                f.write(packed)
+        served = packed if packed is not None else content
+        etags.append('%s %s %s' % (path, etag(served), etag(content)))
+        before += len(content)
+        after += len(served)
+        if packed is not None:
+            print('%-16s %7d -> %7d bytes' % (path, len(content), len(packed)))
+
+    with open(os.path.join(data, 'etags'), 'w') as f:
+        f.write('\n'.join(etags) + '\n')
+    print('%-16s %7d -> %7d bytes' % ('total', before, after))
+
+
+if __name__ == '__main__':
+    main()
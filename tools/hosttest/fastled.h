@@ -0,0 +1,883 @@
+// Host stand-in for the part of FastLED the pattern headers use.
+//
+// The math follows FastLED 3.x's portable C code paths (lib8tion, colorutils,
+// hsv2rgb and noise), so kernels built against it give the same bytes as on
+// the lamp for the same inputs. There is no LED output; millis() is the
+// virtual clock from hoststubs.h.
+
+#ifndef FASTLED_SCALE8_FIXED
+#define FASTLED_SCALE8_FIXED 1
+#endif
+#ifndef FASTLED_BLEND_FIXED
+#define FASTLED_BLEND_FIXED 1
+#endif
+
+#include <cmath>
+
+#define FL_PROGMEM
+#define FL_PGM_READ_BYTE_NEAR(p)    (*(const uint8_t *) (p))
+#define GET_MILLIS                  millis
+#define PI                          3.1415926535897932384626433832795
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint8_t fract8;
+typedef uint16_t fract16;
+typedef uint16_t accum88;
+typedef uint32_t TProgmemRGBPalette16[16];
+
+typedef enum {
+    NOBLEND = 0,
+    LINEARBLEND = 1
+} TBlendType;
+
+// lib8tion
+
+inline uint8_t scale8(uint8_t i, fract8 scale) {
+#if FASTLED_SCALE8_FIXED == 1
+    return ((uint16_t) i * (1 + (uint16_t) scale)) >> 8;
+#else
+    return ((uint16_t) i * (uint16_t) scale) >> 8;
+#endif
+}
+
+inline uint8_t scale8_video(uint8_t i, fract8 scale) {
+    return (((int) i * (int) scale) >> 8) + ((i && scale) ? 1 : 0);
+}
+
+inline uint16_t scale16(uint16_t i, fract16 scale) {
+#if FASTLED_SCALE8_FIXED == 1
+    return ((uint32_t) i * (1 + (uint32_t) scale)) / 65536;
+#else
+    return ((uint32_t) i * (uint32_t) scale) / 65536;
+#endif
+}
+
+inline uint16_t scale16by8(uint16_t i, fract8 scale) {
+#if FASTLED_SCALE8_FIXED == 1
+    return (i * (1 + ((uint16_t) scale))) >> 8;
+#else
+    return (i * scale) >> 8;
+#endif
+}
+
+inline uint8_t qadd8(uint8_t i, uint8_t j) {
+    unsigned t = i + j;
+    return t > 255 ? 255 : t;
+}
+
+inline uint8_t qsub8(uint8_t i, uint8_t j) {
+    int t = i - j;
+    return t < 0 ? 0 : t;
+}
+
+inline int8_t avg7(int8_t i, int8_t j) {
+    return (i >> 1) + (j >> 1) + (i & 0x1);
+}
+
+inline uint8_t addmod8(uint8_t a, uint8_t b, uint8_t m) {
+    a += b;
+    while (a >= m) {
+        a -= m;
+    }
+    return a;
+}
+
+inline uint8_t map8(uint8_t in, uint8_t rangeStart, uint8_t rangeEnd) {
+    return scale8(in, rangeEnd - rangeStart) + rangeStart;
+}
+
+inline uint8_t lerp8by8(uint8_t a, uint8_t b, fract8 frac) {
+    if (b > a) {
+        return a + scale8(b - a, frac);
+    }
+    return a - scale8(a - b, frac);
+}
+
+inline int8_t lerp7by8(int8_t a, int8_t b, fract8 frac) {
+    if (b > a) {
+        return a + scale8(b - a, frac);
+    }
+    return a - scale8(a - b, frac);
+}
+
+inline uint8_t ease8InOutQuad(uint8_t i) {
+    uint8_t j = i;
+    if (j & 0x80) {
+        j = 255 - j;
+    }
+    uint8_t jj = scale8(j, j);
+    uint8_t jj2 = jj << 1;
+    if (i & 0x80) {
+        jj2 = 255 - jj2;
+    }
+    return jj2;
+}
+
+inline uint8_t ease8InOutCubic(uint8_t i) {
+    uint8_t ii = scale8(i, i);
+    uint8_t iii = scale8(ii, i);
+    uint16_t r1 = (3 * (uint16_t) ii) - (2 * (uint16_t) iii);
+    uint8_t result = r1;
+    if (r1 & 0x100) {
+        result = 255;
+    }
+    return result;
+}
+
+inline uint8_t triwave8(uint8_t in) {
+    if (in & 0x80) {
+        in = 255 - in;
+    }
+    return in << 1;
+}
+
+inline uint8_t quadwave8(uint8_t in) {
+    return ease8InOutQuad(triwave8(in));
+}
+
+inline uint8_t cubicwave8(uint8_t in) {
+    return ease8InOutCubic(triwave8(in));
+}
+
+inline uint8_t dim8_raw(uint8_t x) {
+    return scale8(x, x);
+}
+
+inline uint8_t dim8_video(uint8_t x) {
+    return scale8_video(x, x);
+}
+
+inline uint8_t blend8(uint8_t a, uint8_t b, uint8_t amountOfB) {
+#if FASTLED_BLEND_FIXED == 1
+    uint16_t partial = (a << 8) | b;
+    partial += b * amountOfB;
+    partial -= a * amountOfB;
+    return partial >> 8;
+#else
+    return scale8(a, 255 - amountOfB) + scale8(b, amountOfB);
+#endif
+}
+
+inline int16_t sin16(uint16_t theta) {
+    static const uint16_t base[] = {0, 6393, 12539, 18204, 23170, 27245, 30273, 32137};
+    static const uint8_t slope[] = {49, 48, 44, 38, 31, 23, 14, 4};
+    uint16_t offset = (theta & 0x3FFF) >> 3;
+    if (theta & 0x4000) {
+        offset = 2047 - offset;
+    }
+    uint8_t section = offset / 256;
+    uint16_t b = base[section];
+    uint8_t m = slope[section];
+    uint8_t secoffset8 = (uint8_t) (offset) / 2;
+    uint16_t mx = m * secoffset8;
+    int16_t y = mx + b;
+    if (theta & 0x8000) {
+        y = -y;
+    }
+    return y;
+}
+
+inline int16_t cos16(uint16_t theta) {
+    return sin16(theta + 16384);
+}
+
+inline uint8_t sin8(uint8_t theta) {
+    static const uint8_t b_m16_interleave[] = {0, 49, 49, 41, 90, 27, 117, 10};
+    uint8_t offset = theta;
+    if (theta & 0x40) {
+        offset = (uint8_t) 255 - offset;
+    }
+    offset &= 0x3F;
+    uint8_t secoffset = offset & 0x0F;
+    if (theta & 0x40) {
+        secoffset++;
+    }
+    uint8_t section = offset >> 4;
+    uint8_t b = b_m16_interleave[section * 2];
+    uint8_t m16 = b_m16_interleave[section * 2 + 1];
+    uint8_t mx = (m16 * secoffset) >> 4;
+    int8_t y = mx + b;
+    if (theta & 0x80) {
+        y = -y;
+    }
+    y += 128;
+    return y;
+}
+
+inline uint8_t cos8(uint8_t theta) {
+    return sin8(theta + 64);
+}
+
+// random8/random16 use FastLED's 16-bit LCG, so call order matters exactly as on the lamp.
+uint16_t rand16seed = 1337;
+
+inline uint8_t random8() {
+    rand16seed = (rand16seed * 2053) + 13849;
+    return (uint8_t) (((uint8_t) (rand16seed & 0xFF)) + ((uint8_t) (rand16seed >> 8)));
+}
+
+inline uint8_t random8(uint8_t lim) {
+    return (random8() * lim) >> 8;
+}
+
+inline uint8_t random8(uint8_t min, uint8_t lim) {
+    return random8(lim - min) + min;
+}
+
+inline uint16_t random16() {
+    rand16seed = (rand16seed * 2053) + 13849;
+    return rand16seed;
+}
+
+inline uint16_t random16(uint16_t lim) {
+    return ((uint32_t) random16() * lim) >> 16;
+}
+
+inline uint16_t random16(uint16_t min, uint16_t lim) {
+    return random16(lim - min) + min;
+}
+
+inline void random16_set_seed(uint16_t seed) {
+    rand16seed = seed;
+}
+
+inline uint16_t beat88(accum88 bpm88, uint32_t timebase = 0) {
+    return ((millis() - timebase) * bpm88 * 280) >> 16;
+}
+
+inline uint16_t beat16(accum88 bpm, uint32_t timebase = 0) {
+    if (bpm < 256) {
+        bpm <<= 8;
+    }
+    return beat88(bpm, timebase);
+}
+
+inline uint8_t beat8(accum88 bpm, uint32_t timebase = 0) {
+    return beat16(bpm, timebase) >> 8;
+}
+
+inline uint16_t beatsin88(accum88 bpm88, uint16_t lowest = 0, uint16_t highest = 65535, uint32_t timebase = 0,
+                          uint16_t phase = 0) {
+    uint16_t beat = beat88(bpm88, timebase);
+    uint16_t beatsin = (sin16(beat + phase) + 32768);
+    uint16_t rangewidth = highest - lowest;
+    return lowest + scale16(beatsin, rangewidth);
+}
+
+inline uint16_t beatsin16(accum88 bpm, uint16_t lowest = 0, uint16_t highest = 65535, uint32_t timebase = 0,
+                          uint16_t phase = 0) {
+    uint16_t beat = beat16(bpm, timebase);
+    uint16_t beatsin = (sin16(beat + phase) + 32768);
+    uint16_t rangewidth = highest - lowest;
+    return lowest + scale16(beatsin, rangewidth);
+}
+
+inline uint8_t beatsin8(accum88 bpm, uint8_t lowest = 0, uint8_t highest = 255, uint32_t timebase = 0,
+                        uint8_t phase = 0) {
+    uint8_t beat = beat8(bpm, timebase);
+    uint8_t beatsin = sin8(beat + phase);
+    uint8_t rangewidth = highest - lowest;
+    return lowest + scale8(beatsin, rangewidth);
+}
+
+// Arduino's random() and map().
+inline long random(long howbig) {
+    return howbig ? rand() % howbig : 0;
+}
+
+inline long random(long howsmall, long howbig) {
+    return howsmall >= howbig ? howsmall : random(howbig - howsmall) + howsmall;
+}
+
+inline long map(long x, long in_min, long in_max, long out_min, long out_max) {
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+// Colors
+
+struct CHSV {
+    union {
+        struct {
+            uint8_t hue;
+            uint8_t sat;
+            uint8_t val;
+        };
+        uint8_t raw[3];
+    };
+
+    CHSV() {}
+
+    CHSV(uint8_t h, uint8_t s, uint8_t v) : hue(h), sat(s), val(v) {}
+};
+
+struct CRGB;
+
+void hsv2rgb_rainbow(const CHSV &hsv, CRGB &rgb);
+
+struct CRGB {
+    union {
+        struct {
+            union {
+                uint8_t r;
+                uint8_t red;
+            };
+            union {
+                uint8_t g;
+                uint8_t green;
+            };
+            union {
+                uint8_t b;
+                uint8_t blue;
+            };
+        };
+        uint8_t raw[3];
+    };
+
+    typedef enum {
+        Aqua = 0x00FFFF,
+        Black = 0x000000,
+        Blue = 0x0000FF,
+        Cyan = 0x00FFFF,
+        DarkOrange = 0xFF8C00,
+        DarkRed = 0x8B0000,
+        FairyLight = 0xFFE42D,
+        Gold = 0xFFD700,
+        Goldenrod = 0xDAA520,
+        Gray = 0x808080,
+        Green = 0x008000,
+        Orange = 0xFFA500,
+        Purple = 0x800080,
+        Red = 0xFF0000,
+        White = 0xFFFFFF,
+        Yellow = 0xFFFF00
+    } HTMLColorCode;
+
+    CRGB() {}
+
+    CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) {}
+
+    CRGB(uint32_t colorcode) : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) {}
+
+    CRGB(HTMLColorCode colorcode) : CRGB((uint32_t) colorcode) {}
+
+    CRGB(const CHSV &rhs) {
+        hsv2rgb_rainbow(rhs, *this);
+    }
+
+    uint8_t &operator[](uint8_t x) {
+        return raw[x];
+    }
+
+    const uint8_t &operator[](uint8_t x) const {
+        return raw[x];
+    }
+
+    CRGB &operator=(const CHSV &rhs) {
+        hsv2rgb_rainbow(rhs, *this);
+        return *this;
+    }
+
+    CRGB &operator+=(const CRGB &rhs) {
+        r = qadd8(r, rhs.r);
+        g = qadd8(g, rhs.g);
+        b = qadd8(b, rhs.b);
+        return *this;
+    }
+
+    CRGB &operator-=(const CRGB &rhs) {
+        r = qsub8(r, rhs.r);
+        g = qsub8(g, rhs.g);
+        b = qsub8(b, rhs.b);
+        return *this;
+    }
+
+    CRGB &operator|=(const CRGB &rhs) {
+        r = std::max(r, rhs.r);
+        g = std::max(g, rhs.g);
+        b = std::max(b, rhs.b);
+        return *this;
+    }
+
+    CRGB &operator%=(uint8_t scaledown) {
+        return nscale8_video(scaledown);
+    }
+
+    CRGB &nscale8(uint8_t scaledown) {
+        r = scale8(r, scaledown);
+        g = scale8(g, scaledown);
+        b = scale8(b, scaledown);
+        return *this;
+    }
+
+    CRGB &nscale8_video(uint8_t scaledown) {
+        r = scale8_video(r, scaledown);
+        g = scale8_video(g, scaledown);
+        b = scale8_video(b, scaledown);
+        return *this;
+    }
+
+    CRGB &fadeToBlackBy(uint8_t fadefactor) {
+        return nscale8(255 - fadefactor);
+    }
+
+    uint8_t getAverageLight() const {
+        const uint8_t eightyfive = 85;
+        return scale8(r, eightyfive) + scale8(g, eightyfive) + scale8(b, eightyfive);
+    }
+
+    explicit operator bool() const {
+        return r || g || b;
+    }
+};
+
+inline bool operator==(const CRGB &a, const CRGB &b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+inline bool operator!=(const CRGB &a, const CRGB &b) {
+    return !(a == b);
+}
+
+inline CRGB operator+(const CRGB &a, const CRGB &b) {
+    return CRGB(qadd8(a.r, b.r), qadd8(a.g, b.g), qadd8(a.b, b.b));
+}
+
+void hsv2rgb_rainbow(const CHSV &hsv, CRGB &rgb) {
+    const uint8_t K255 = 255, K171 = 171, K170 = 170, K85 = 85;
+    uint8_t hue = hsv.hue;
+    uint8_t sat = hsv.sat;
+    uint8_t val = hsv.val;
+    uint8_t offset8 = (hue & 0x1F) << 3;
+    uint8_t third = scale8(offset8, (256 / 3));
+    uint8_t r, g, b;
+
+    if (!(hue & 0x80)) {
+        if (!(hue & 0x40)) {
+            if (!(hue & 0x20)) {
+                r = K255 - third;
+                g = third;
+                b = 0;
+            } else {
+                r = K171;
+                g = K85 + third;
+                b = 0;
+            }
+        } else {
+            if (!(hue & 0x20)) {
+                uint8_t twothirds = scale8(offset8, ((256 * 2) / 3));
+                r = K171 - twothirds;
+                g = K170 + third;
+                b = 0;
+            } else {
+                r = 0;
+                g = K255 - third;
+                b = third;
+            }
+        }
+    } else {
+        if (!(hue & 0x40)) {
+            if (!(hue & 0x20)) {
+                uint8_t twothirds = scale8(offset8, ((256 * 2) / 3));
+                r = 0;
+                g = K171 - twothirds;
+                b = K85 + twothirds;
+            } else {
+                r = third;
+                g = 0;
+                b = K255 - third;
+            }
+        } else {
+            if (!(hue & 0x20)) {
+                r = K85 + third;
+                g = 0;
+                b = K171 - third;
+            } else {
+                r = K170 + third;
+                g = 0;
+                b = K85 - third;
+            }
+        }
+    }
+
+    if (sat != 255) {
+        if (sat == 0) {
+            r = 255;
+            b = 255;
+            g = 255;
+        } else {
+            uint8_t desat = 255 - sat;
+            desat = scale8_video(desat, desat);
+            uint8_t satscale = 255 - desat;
+#if FASTLED_SCALE8_FIXED == 1
+            r = scale8(r, satscale);
+            g = scale8(g, satscale);
+            b = scale8(b, satscale);
+#else
+            if (r) r = scale8(r, satscale) + 1;
+            if (g) g = scale8(g, satscale) + 1;
+            if (b) b = scale8(b, satscale) + 1;
+#endif
+            r += desat;
+            g += desat;
+            b += desat;
+        }
+    }
+
+    if (val != 255) {
+        val = scale8_video(val, val);
+        if (val == 0) {
+            r = 0;
+            g = 0;
+            b = 0;
+        } else {
+#if FASTLED_SCALE8_FIXED == 1
+            r = scale8(r, val);
+            g = scale8(g, val);
+            b = scale8(b, val);
+#else
+            if (r) r = scale8(r, val) + 1;
+            if (g) g = scale8(g, val) + 1;
+            if (b) b = scale8(b, val) + 1;
+#endif
+        }
+    }
+
+    rgb.r = r;
+    rgb.g = g;
+    rgb.b = b;
+}
+
+inline CRGB blend(const CRGB &p1, const CRGB &p2, fract8 amountOfP2) {
+    return CRGB(blend8(p1.r, p2.r, amountOfP2), blend8(p1.g, p2.g, amountOfP2), blend8(p1.b, p2.b, amountOfP2));
+}
+
+inline CRGB &nblend(CRGB &existing, const CRGB &overlay, fract8 amountOfOverlay) {
+    if (amountOfOverlay == 0) {
+        return existing;
+    }
+    if (amountOfOverlay == 255) {
+        existing = overlay;
+        return existing;
+    }
+    existing.r = blend8(existing.r, overlay.r, amountOfOverlay);
+    existing.g = blend8(existing.g, overlay.g, amountOfOverlay);
+    existing.b = blend8(existing.b, overlay.b, amountOfOverlay);
+    return existing;
+}
+
+// Palettes
+
+struct CRGBPalette16 {
+    CRGB entries[16];
+
+    CRGBPalette16() {}
+
+    CRGBPalette16(const TProgmemRGBPalette16 &rhs) {
+        for (int i = 0; i < 16; i++) {
+            entries[i] = CRGB(rhs[i]);
+        }
+    }
+
+    CRGBPalette16(std::initializer_list<uint32_t> codes) {
+        int i = 0;
+        for (uint32_t c : codes) {
+            entries[i++] = CRGB(c);
+        }
+    }
+
+    CRGBPalette16(const CHSV &c1, const CHSV &c2, const CHSV &c3, const CHSV &c4);
+
+    CRGB &operator[](uint8_t x) {
+        return entries[x];
+    }
+
+    const CRGB &operator[](uint8_t x) const {
+        return entries[x];
+    }
+
+    bool operator==(const CRGBPalette16 &rhs) const {
+        return !memcmp(entries, rhs.entries, sizeof(entries));
+    }
+
+    bool operator!=(const CRGBPalette16 &rhs) const {
+        return !(*this == rhs);
+    }
+};
+
+void fill_gradient_RGB(CRGB *leds, uint16_t startpos, CRGB startcolor, uint16_t endpos, CRGB endcolor) {
+    if (endpos < startpos) {
+        uint16_t t = endpos;
+        CRGB tc = endcolor;
+        endcolor = startcolor;
+        endpos = startpos;
+        startpos = t;
+        startcolor = tc;
+    }
+    int16_t rdistance87 = (endcolor.r - startcolor.r) * 128;
+    int16_t gdistance87 = (endcolor.g - startcolor.g) * 128;
+    int16_t bdistance87 = (endcolor.b - startcolor.b) * 128;
+    uint16_t pixeldistance = endpos - startpos;
+    int16_t divisor = pixeldistance ? pixeldistance : 1;
+    int16_t rdelta87 = rdistance87 / divisor;
+    int16_t gdelta87 = gdistance87 / divisor;
+    int16_t bdelta87 = bdistance87 / divisor;
+    rdelta87 *= 2;
+    gdelta87 *= 2;
+    bdelta87 *= 2;
+    uint16_t r88 = startcolor.r << 8;
+    uint16_t g88 = startcolor.g << 8;
+    uint16_t b88 = startcolor.b << 8;
+    for (uint16_t i = startpos; i <= endpos; ++i) {
+        leds[i] = CRGB(r88 >> 8, g88 >> 8, b88 >> 8);
+        r88 += rdelta87;
+        g88 += gdelta87;
+        b88 += bdelta87;
+    }
+}
+
+void fill_gradient_RGB(CRGB *leds, uint16_t numLeds, const CRGB &c1, const CRGB &c2, const CRGB &c3, const CRGB &c4) {
+    uint16_t onethird = (numLeds / 3);
+    uint16_t twothirds = ((numLeds * 2) / 3);
+    uint16_t last = numLeds - 1;
+    fill_gradient_RGB(leds, 0, c1, onethird, c2);
+    fill_gradient_RGB(leds, onethird, c2, twothirds, c3);
+    fill_gradient_RGB(leds, twothirds, c3, last, c4);
+}
+
+CRGBPalette16::CRGBPalette16(const CHSV &c1, const CHSV &c2, const CHSV &c3, const CHSV &c4) {
+    fill_gradient_RGB(entries, 16, CRGB(c1), CRGB(c2), CRGB(c3), CRGB(c4));
+}
+
+const TProgmemRGBPalette16 RainbowColors_p = {
+        0xFF0000, 0xD52A00, 0xAB5500, 0xAB7F00, 0xABAB00, 0x56D500, 0x00FF00, 0x00D52A,
+        0x00AB55, 0x0056AA, 0x0000FF, 0x2A00D5, 0x5500AB, 0x7F0081, 0xAB0055, 0xD5002B};
+
+const TProgmemRGBPalette16 PartyColors_p = {
+        0x5500AB, 0x84007C, 0xB5004B, 0xE5001B, 0xE81700, 0xB84700, 0xAB7700, 0xABAB00,
+        0xAB5500, 0xDD2200, 0xF2000E, 0xC2003E, 0x8F0071, 0x5F00A1, 0x2F00D0, 0x0007F9};
+
+CRGB ColorFromPalette(const CRGBPalette16 &pal, uint8_t index, uint8_t brightness = 255,
+                      TBlendType blendType = LINEARBLEND) {
+    uint8_t hi4 = index >> 4;
+    uint8_t lo4 = index & 0x0F;
+    const CRGB *entry = &pal.entries[hi4];
+    uint8_t blend = lo4 && (blendType != NOBLEND);
+    uint8_t red1 = entry->red;
+    uint8_t green1 = entry->green;
+    uint8_t blue1 = entry->blue;
+
+    if (blend) {
+        entry = hi4 == 15 ? &pal.entries[0] : entry + 1;
+        uint8_t f2 = lo4 << 4;
+        uint8_t f1 = 255 - f2;
+        red1 = scale8(red1, f1) + scale8(entry->red, f2);
+        green1 = scale8(green1, f1) + scale8(entry->green, f2);
+        blue1 = scale8(blue1, f1) + scale8(entry->blue, f2);
+    }
+
+    if (brightness != 255) {
+        if (brightness) {
+            ++brightness;
+#if FASTLED_SCALE8_FIXED == 1
+            if (red1) red1 = scale8(red1, brightness);
+            if (green1) green1 = scale8(green1, brightness);
+            if (blue1) blue1 = scale8(blue1, brightness);
+#else
+            if (red1) red1 = scale8(red1, brightness) + 1;
+            if (green1) green1 = scale8(green1, brightness) + 1;
+            if (blue1) blue1 = scale8(blue1, brightness) + 1;
+#endif
+        } else {
+            red1 = green1 = blue1 = 0;
+        }
+    }
+    return CRGB(red1, green1, blue1);
+}
+
+void nblendPaletteTowardPalette(CRGBPalette16 &current, CRGBPalette16 &target, uint8_t maxChanges) {
+    uint8_t *p1 = (uint8_t *) current.entries;
+    uint8_t *p2 = (uint8_t *) target.entries;
+    uint8_t changes = 0;
+    for (uint8_t i = 0; i < sizeof(CRGBPalette16); ++i) {
+        if (p1[i] == p2[i]) {
+            continue;
+        }
+        if (p1[i] < p2[i]) {
+            ++p1[i];
+            ++changes;
+        }
+        if (p1[i] > p2[i]) {
+            --p1[i];
+            ++changes;
+            if (p1[i] > p2[i]) {
+                --p1[i];
+            }
+        }
+        if (changes >= maxChanges) {
+            break;
+        }
+    }
+}
+
+CRGB HeatColor(uint8_t temperature) {
+    CRGB heatcolor;
+    uint8_t t192 = scale8_video(temperature, 191);
+    uint8_t heatramp = t192 & 0x3F;
+    heatramp <<= 2;
+    if (t192 & 0x80) {
+        heatcolor.r = 255;
+        heatcolor.g = 255;
+        heatcolor.b = heatramp;
+    } else if (t192 & 0x40) {
+        heatcolor.r = 255;
+        heatcolor.g = heatramp;
+        heatcolor.b = 0;
+    } else {
+        heatcolor.r = heatramp;
+        heatcolor.g = 0;
+        heatcolor.b = 0;
+    }
+    return heatcolor;
+}
+
+void fill_solid(CRGB *leds, int numToFill, const CRGB &color) {
+    for (int i = 0; i < numToFill; i++) {
+        leds[i] = color;
+    }
+}
+
+void fill_rainbow(CRGB *leds, int numToFill, uint8_t initialhue, uint8_t deltahue = 5) {
+    CHSV hsv(initialhue, 240, 255);
+    for (int i = 0; i < numToFill; i++) {
+        leds[i] = hsv;
+        hsv.hue += deltahue;
+    }
+}
+
+void fadeToBlackBy(CRGB *leds, uint16_t num_leds, uint8_t fadeBy) {
+    for (uint16_t i = 0; i < num_leds; i++) {
+        leds[i].nscale8(255 - fadeBy);
+    }
+}
+
+void nscale8(CRGB *leds, uint16_t num_leds, uint8_t scale) {
+    for (uint16_t i = 0; i < num_leds; i++) {
+        leds[i].nscale8(scale);
+    }
+}
+
+// Noise
+
+static const uint8_t noisePermutation[] = {
+        151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225,
+        140, 36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148,
+        247, 120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32,
+        57, 177, 33, 88, 237, 149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175,
+        74, 165, 71, 134, 139, 48, 27, 166, 77, 146, 158, 231, 83, 111, 229, 122,
+        60, 211, 133, 230, 220, 105, 92, 41, 55, 46, 245, 40, 244, 102, 143, 54,
+        65, 25, 63, 161, 1, 216, 80, 73, 209, 76, 132, 187, 208, 89, 18, 169,
+        200, 196, 135, 130, 116, 188, 159, 86, 164, 100, 109, 198, 173, 186, 3, 64,
+        52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118, 126, 255, 82, 85, 212,
+        207, 206, 59, 227, 47, 16, 58, 17, 182, 189, 28, 42, 223, 183, 170, 213,
+        119, 248, 152, 2, 44, 154, 163, 70, 221, 153, 101, 155, 167, 43, 172, 9,
+        129, 22, 39, 253, 19, 98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104,
+        218, 246, 97, 228, 251, 34, 242, 193, 238, 210, 144, 12, 191, 179, 162, 241,
+        81, 51, 145, 235, 249, 14, 239, 107, 49, 192, 214, 31, 181, 199, 106, 157,
+        184, 84, 204, 176, 115, 121, 50, 45, 127, 4, 150, 254, 138, 236, 205, 93,
+        222, 114, 67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180,
+        151};
+
+#define P(x) noisePermutation[(uint8_t) (x)]
+
+inline int8_t grad8(uint8_t hash, int8_t x, int8_t y, int8_t z) {
+    hash = hash & 0xF;
+    int8_t u = hash & 8 ? y : x;
+    int8_t v = hash < 4 ? y : hash == 12 || hash == 14 ? x : z;
+    if (hash & 1) {
+        u = -u;
+    }
+    if (hash & 2) {
+        v = -v;
+    }
+    return avg7(u, v);
+}
+
+inline int8_t grad8(uint8_t hash, int8_t x, int8_t y) {
+    int8_t u, v;
+    if (hash & 4) {
+        u = y;
+        v = x;
+    } else {
+        u = x;
+        v = y;
+    }
+    if (hash & 1) {
+        u = -u;
+    }
+    if (hash & 2) {
+        v = -v;
+    }
+    return avg7(u, v);
+}
+
+int8_t inoise8_raw(uint16_t x, uint16_t y, uint16_t z) {
+    uint8_t X = x >> 8;
+    uint8_t Y = y >> 8;
+    uint8_t Z = z >> 8;
+    uint8_t A = P(X) + Y;
+    uint8_t AA = P(A) + Z;
+    uint8_t AB = P(A + 1) + Z;
+    uint8_t B = P(X + 1) + Y;
+    uint8_t BA = P(B) + Z;
+    uint8_t BB = P(B + 1) + Z;
+    uint8_t u = ease8InOutQuad(x);
+    uint8_t v = ease8InOutQuad(y);
+    uint8_t w = ease8InOutQuad(z);
+    int8_t xx = ((uint8_t) (x) >> 1) & 0x7F;
+    int8_t yy = ((uint8_t) (y) >> 1) & 0x7F;
+    int8_t zz = ((uint8_t) (z) >> 1) & 0x7F;
+    uint8_t N = 0x80;
+
+    int8_t X1 = lerp7by8(grad8(P(AA), xx, yy, zz), grad8(P(BA), xx - N, yy, zz), u);
+    int8_t X2 = lerp7by8(grad8(P(AB), xx, yy - N, zz), grad8(P(BB), xx - N, yy - N, zz), u);
+    int8_t X3 = lerp7by8(grad8(P(AA + 1), xx, yy, zz - N), grad8(P(BA + 1), xx - N, yy, zz - N), u);
+    int8_t X4 = lerp7by8(grad8(P(AB + 1), xx, yy - N, zz - N), grad8(P(BB + 1), xx - N, yy - N, zz - N), u);
+    int8_t Y1 = lerp7by8(X1, X2, v);
+    int8_t Y2 = lerp7by8(X3, X4, v);
+    return lerp7by8(Y1, Y2, w);
+}
+
+uint8_t inoise8(uint16_t x, uint16_t y, uint16_t z) {
+    int8_t n = inoise8_raw(x, y, z);
+    n += 64;
+    return qadd8(n, n);
+}
+
+int8_t inoise8_raw(uint16_t x, uint16_t y) {
+    uint8_t X = x >> 8;
+    uint8_t Y = y >> 8;
+    uint8_t A = P(X) + Y;
+    uint8_t AA = P(A);
+    uint8_t AB = P(A + 1);
+    uint8_t B = P(X + 1) + Y;
+    uint8_t BA = P(B);
+    uint8_t BB = P(B + 1);
+    uint8_t u = ease8InOutQuad(x);
+    uint8_t v = ease8InOutQuad(y);
+    int8_t xx = ((uint8_t) (x) >> 1) & 0x7F;
+    int8_t yy = ((uint8_t) (y) >> 1) & 0x7F;
+    uint8_t N = 0x80;
+
+    int8_t X1 = lerp7by8(grad8(P(AA), xx, yy), grad8(P(BA), xx - N, yy), u);
+    int8_t X2 = lerp7by8(grad8(P(AB), xx, yy - N), grad8(P(BB), xx - N, yy - N), u);
+    return lerp7by8(X1, X2, v);
+}
+
+uint8_t inoise8(uint16_t x, uint16_t y) {
+    int8_t n = inoise8_raw(x, y);
+    n += 64;
+    return qadd8(n, n);
+}
+
+#undef P
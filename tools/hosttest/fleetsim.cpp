@@ -0,0 +1,542 @@
+// Fleet simulator: up to 100 lamps in one process, each with its own clock,
+// IP, strip and copy of the sketch's network side (fleetlamp.inc), on a
+// simulated multicast bus with latency, jitter and loss.
+//
+// A scenario file drives it line by line; each `run` advances simulated time
+// and prints convergence time (until every lamp follows the lowest IP as
+// master and shows its pattern, palette and span length), frame divergence against a
+// reference render on the master's clock (over the whole virtual strip when
+// spanning, and separately for the pixels next to a seam), per-lamp render
+// cost, packets per second and multicast recoveries. `expect` lines turn
+// these into checks. From the top of the repository:
+//
+//     g++ -std=gnu++17 -O2 -Wall -Wno-unused-variable -Wno-unused-function -Wno-stringop-truncation -Itools/hosttest -o /tmp/fleetsim tools/hosttest/fleetsim.cpp
+//     for s in tools/hosttest/scenarios/*.txt; do /tmp/fleetsim $s || break; done
+//
+// Scenario commands, times in milliseconds:
+//
+//     lamps <n> [pixels]          power up n lamps within the next second
+//     latency <ms> | jitter <ms> | loss <percent> | drift <ppm>
+//     pattern <name>              the master switches its front strip
+//     sync <lamp>                 the lamp asks the group for a sync
+//     span                        lamps take positions 0, 1, ... in one virtual strip
+//     drop <lamp> | revive <lamp> power a lamp off or on again
+//     blackout <lamp|all> <ms> <none|rejoin|rebind|wifi|restart>
+//                                 multicast is lost until the time is up or the
+//                                 lamp runs the given recovery stage (or a later one)
+//     run <ms>
+//     expect converge <ms> | divergence <max> | seam <max> | tx <pps> | rx <pps>
+//     expect reboots <max> | recovery <stage>
+//
+// A lamp is its index or `master`. A recovery by restart cannot be told from
+// the lamp's recovery record, which the reboot clears, so `expect recovery
+// restart` asks for every lamp to have rebooted instead. Stock FastLED randomness is shared by all
+// lamps, so runs are repeatable but lamps draw from one sequence.
+
+#include <chrono>
+#include <deque>
+#include <queue>
+#include <random>
+
+#include "sketch.h"
+#include "../../pixelops.h"
+#include "../../simple.h"
+#include "../../noisefield.h"
+#include "../../fire.h"
+#include "../../noise.h"
+
+#define FLEET_SIZE      100
+#define FLEET_GROUP     ipOf(239, 49, 0, 1)
+#define FRAME_SAMPLE    100     // milliseconds between frame comparisons
+
+typedef struct {
+    uint32_t ip;
+    bool connected;
+    uint32_t masterIp;
+    uint16_t members;
+    uint32_t helloInterval;
+    const char *pattern;
+    CRGBPalette16 palette;
+    uint16_t offset;
+    uint16_t length;            // of the virtual strip
+    uint32_t cures[5];          // rejoins, rebinds, WiFi reconnects and boots, by recovery stage
+    uint32_t recoveries;
+    uint32_t recoveryMillis;
+    uint8_t recoveryStage;      // the stage that ended the last recovery
+    uint32_t reboots;
+} LampStatus;
+
+// Entry points of one lamp's namespace.
+typedef struct {
+    void (*boot)(uint32_t ip, const char *name, uint16_t count, int32_t ppm);
+    void (*loop)();
+    void (*post)(const uint8_t *, size_t);
+    void (*status)(LampStatus *);
+    void (*setPattern)(const char *);
+    void (*setSpan)(int);
+    void (*requestSync)();
+    void (*render)(Strip *);
+    Strip *(*strip)();
+} FleetLamp;
+
+FleetLamp fleet[FLEET_SIZE];
+int fleetSize = 0;
+
+FleetLamp *joinFleet(FleetLamp lamp) {
+    fleet[fleetSize] = lamp;
+    return &fleet[fleetSize++];
+}
+
+#define FLEET_LAMP(n)   FLEET_LAMP_(n)
+#define FLEET_LAMP_(n)  fleetLamp##n
+
+#include "fleetten.inc"
+#include "fleetten.inc"
+#include "fleetten.inc"
+#include "fleetten.inc"
+#include "fleetten.inc"
+#include "fleetten.inc"
+#include "fleetten.inc"
+#include "fleetten.inc"
+#include "fleetten.inc"
+#include "fleetten.inc"
+
+// Recovery stages are the same in every lamp; "none" stands for idle.
+using fleetLamp0::RECOVERY_REJOIN;
+using fleetLamp0::RECOVERY_RESTART;
+
+static const char *stageNames[] = {"none", "rejoin", "rebind", "wifi", "restart"};
+
+typedef struct {
+    bool powered;
+    uint32_t bootAt;            // host time of a pending power up, 0 if none
+    uint32_t ip;
+    uint16_t pixels;
+    uint32_t tx, rx;
+    LampStatus st;
+} Node;
+
+Node nodes[FLEET_SIZE];
+int lampCount = 0;
+
+struct {
+    uint32_t latency = 2;
+    uint32_t jitter = 0;
+    double loss = 0;
+    int32_t drift = 0;
+} net;
+
+typedef struct {
+    uint32_t at;
+    uint32_t seq;
+    int to;
+    std::vector<uint8_t> bytes;
+} Delivery;
+
+struct Later {
+    bool operator()(const Delivery &a, const Delivery &b) const {
+        return a.at != b.at ? a.at > b.at : a.seq > b.seq;
+    }
+};
+
+std::priority_queue<Delivery, std::vector<Delivery>, Later> inFlight;
+uint32_t sequence = 0;
+
+typedef struct {
+    int lamp;                   // -1 for all
+    uint32_t until;
+    int cure;                   // index into stageNames
+    std::vector<LampStatus> base;
+} Blackout;
+
+std::vector<Blackout> blackouts;
+
+std::mt19937 rng(39);
+
+// Statistics since the last run started.
+struct {
+    uint32_t start;
+    uint64_t tx, rx;
+    double divergence, divergenceMax, seam;
+    uint32_t samples, seamSamples;
+    double renderMicros;
+    uint32_t renders;
+} phase;
+
+uint32_t eventAt = 0;
+uint32_t convergedAt = 0;
+
+int failures = 0;
+
+void event() {
+    eventAt = hostMillis;
+    convergedAt = 0;
+}
+
+// Dotted quad order, as members.h elects.
+inline uint32_t rank(uint32_t ip) {
+    return __builtin_bswap32(ip);
+}
+
+int masterIndex() {
+    int m = -1;
+    for (int i = 0; i < lampCount; i++) {
+        if (nodes[i].powered && (m < 0 || rank(nodes[i].ip) < rank(nodes[m].ip))) {
+            m = i;
+        }
+    }
+    return m;
+}
+
+bool cured(const Blackout &b, int i) {
+    for (int s = b.cure ? b.cure : RECOVERY_RESTART + 1; s <= RECOVERY_RESTART; s++) {
+        if (nodes[i].st.cures[s] > b.base[i].cures[s]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool cutOff(int i) {
+    if (!nodes[i].powered || !nodes[i].st.connected) {
+        return true;
+    }
+    for (Blackout &b : blackouts) {
+        if ((b.lamp < 0 || b.lamp == i) && !cured(b, i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void send(int from) {
+    for (Datagram &d : bus) {
+        nodes[from].tx++;
+        phase.tx++;
+        if (cutOff(from)) {
+            continue;
+        }
+        for (int j = 0; j < lampCount; j++) {
+            if (j == from || !nodes[j].powered || rng() % 10000 < net.loss * 100) {
+                continue;
+            }
+            uint32_t delay = net.latency + (net.jitter ? rng() % (net.jitter + 1) : 0);
+            inFlight.push({hostMillis + delay, sequence++, j, d.bytes});
+        }
+    }
+    bus.clear();
+}
+
+bool agreed() {
+    int m = masterIndex();
+    if (m < 0) {
+        return false;
+    }
+    for (int i = 0; i < lampCount; i++) {
+        if (nodes[i].bootAt) {
+            return false;
+        }
+        if (!nodes[i].powered) {
+            continue;
+        }
+        LampStatus &st = nodes[i].st;
+        if (cutOff(i) || st.masterIp != nodes[m].ip || strcmp(st.pattern, nodes[m].st.pattern) ||
+            st.palette != nodes[m].st.palette || st.length != nodes[m].st.length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline int channelDiff(const CRGB &a, const CRGB &b) {
+    return abs(a.r - b.r) + abs(a.g - b.g) + abs(a.b - b.b);
+}
+
+// Renders every lamp and a reference strip covering the whole virtual strip on the master's
+// clock, and compares each lamp's pixels with its slice of the reference.
+void sampleFrames() {
+    int m = masterIndex();
+    uint16_t length = nodes[m].st.length;
+    std::vector<CRGB> refLeds(length);
+    Strip ref = {};
+    ref.leds = refLeds.data();
+    ref.count = length;
+    ref.span = length;
+    fleet[m].render(&ref);
+
+    uint64_t diff = 0, seamDiff = 0;
+    uint32_t pixels = 0, seamPixels = 0;
+    for (int i = 0; i < lampCount; i++) {
+        if (!nodes[i].powered) {
+            continue;
+        }
+        Strip *s = fleet[i].strip();
+        auto t0 = std::chrono::steady_clock::now();
+        fleet[i].render(s);
+        auto t1 = std::chrono::steady_clock::now();
+        phase.renderMicros += std::chrono::duration<double, std::micro>(t1 - t0).count();
+        phase.renders++;
+
+        for (uint16_t k = 0; k < s->count && s->offset + k < length; k++) {
+            int d = channelDiff(s->leds[k], refLeds[s->offset + k]);
+            diff += d;
+            pixels++;
+            if ((k == 0 && s->offset) || (k == s->count - 1 && s->offset + s->count < length)) {
+                seamDiff += d;
+                seamPixels++;
+            }
+        }
+    }
+    double divergence = (double) diff / (3 * pixels);
+    phase.divergence += divergence;
+    phase.divergenceMax = max(phase.divergenceMax, divergence);
+    phase.samples++;
+    if (seamPixels) {
+        phase.seam += (double) seamDiff / (3 * seamPixels);
+        phase.seamSamples++;
+    }
+}
+
+void step() {
+    hostMillis++;
+
+    for (size_t b = 0; b < blackouts.size();) {
+        if (blackouts[b].until <= hostMillis) {
+            blackouts.erase(blackouts.begin() + b);
+        } else {
+            b++;
+        }
+    }
+
+    while (!inFlight.empty() && inFlight.top().at <= hostMillis) {
+        const Delivery &d = inFlight.top();
+        if (!cutOff(d.to)) {
+            fleet[d.to].post(d.bytes.data(), d.bytes.size());
+            nodes[d.to].rx++;
+            phase.rx++;
+        }
+        inFlight.pop();
+    }
+
+    for (int i = 0; i < lampCount; i++) {
+        Node &n = nodes[i];
+        if (n.bootAt && n.bootAt <= hostMillis) {
+            char name[16];
+            snprintf(name, sizeof(name), "lamp-%d", i);
+            int32_t ppm = net.drift ? (int32_t) (rng() % (2 * net.drift + 1)) - net.drift : 0;
+            fleet[i].boot(n.ip, name, n.pixels, ppm);
+            n.powered = true;
+            n.bootAt = 0;
+        }
+        if (n.powered) {
+            fleet[i].loop();
+            fleet[i].status(&n.st);
+            send(i);
+        }
+    }
+
+    if (hostMillis % 10 == 0 && !convergedAt && agreed()) {
+        convergedAt = hostMillis;
+    }
+    if (hostMillis % FRAME_SAMPLE == 0 && convergedAt && agreed()) {
+        sampleFrames();
+    }
+}
+
+void report() {
+    double seconds = (hostMillis - phase.start) / 1000.0;
+    int m = masterIndex();
+    int powered = 0;
+    uint32_t recoveries = 0, reboots = 0, recoveryMax = 0;
+    uint32_t byStage[RECOVERY_RESTART + 1] = {0};
+    for (int i = 0; i < lampCount; i++) {
+        powered += nodes[i].powered;
+        recoveries += nodes[i].st.recoveries;
+        reboots += nodes[i].st.reboots;
+        if (nodes[i].st.recoveries) {
+            recoveryMax = max(recoveryMax, nodes[i].st.recoveryMillis);
+            byStage[nodes[i].st.recoveryStage]++;
+        }
+    }
+    printf("t %6.1f s  lamps %d/%d  master %s", hostMillis / 1000.0, powered, lampCount,
+           m >= 0 ? IPAddress(nodes[m].ip).toString().c_str() : "-");
+    if (convergedAt) {
+        printf("  converged in %u ms", convergedAt - eventAt);
+    } else {
+        printf("  not converged");
+    }
+    if (m >= 0) {
+        printf("  hello every %u s", nodes[m].st.helloInterval / 1000);
+    }
+    printf("\n          tx %.2f rx %.2f packets/s per lamp", phase.tx / seconds / max(powered, 1),
+           phase.rx / seconds / max(powered, 1));
+    if (phase.samples) {
+        printf("  divergence %.2f (max %.2f)", phase.divergence / phase.samples, phase.divergenceMax);
+    }
+    if (phase.seamSamples) {
+        printf("  seams %.2f", phase.seam / phase.seamSamples);
+    }
+    if (phase.renders) {
+        printf("  render %.1f us", phase.renderMicros / phase.renders);
+    }
+    printf("\n");
+    if (recoveries || reboots) {
+        printf("          recoveries %u (", recoveries);
+        for (int s = RECOVERY_REJOIN; s <= RECOVERY_RESTART; s++) {
+            printf("%s%s %u", s > RECOVERY_REJOIN ? ", " : "", stageNames[s], byStage[s]);
+        }
+        printf("), longest %.1f s, reboots %u\n", recoveryMax / 1000.0, reboots);
+    }
+}
+
+int lampIndex(const char *arg) {
+    if (!strcmp(arg, "master")) {
+        return masterIndex();
+    }
+    int i = atoi(arg);
+    return i >= 0 && i < lampCount ? i : -1;
+}
+
+int stageIndex(const char *arg) {
+    for (int s = 0; s <= RECOVERY_RESTART; s++) {
+        if (!strcmp(arg, stageNames[s])) {
+            return s;
+        }
+    }
+    return -1;
+}
+
+void expect(bool ok, int line, const char *what) {
+    if (!ok) {
+        printf("FAIL line %d: expect %s\n", line, what);
+        failures++;
+    }
+}
+
+void checkExpectation(int line, const char *metric, const char *arg, const char *text) {
+    double limit = atof(arg);
+    double seconds = (hostMillis - phase.start) / 1000.0;
+    int powered = 0;
+    uint32_t reboots = 0;
+    for (int i = 0; i < lampCount; i++) {
+        powered += nodes[i].powered;
+        reboots += nodes[i].st.reboots;
+    }
+    if (!strcmp(metric, "converge")) {
+        expect(convergedAt && convergedAt - eventAt <= limit, line, text);
+    } else if (!strcmp(metric, "divergence")) {
+        expect(phase.samples && phase.divergence / phase.samples <= limit, line, text);
+    } else if (!strcmp(metric, "seam")) {
+        expect(phase.seamSamples && phase.seam / phase.seamSamples <= limit, line, text);
+    } else if (!strcmp(metric, "tx")) {
+        expect(phase.tx / seconds / max(powered, 1) <= limit, line, text);
+    } else if (!strcmp(metric, "rx")) {
+        expect(phase.rx / seconds / max(powered, 1) <= limit, line, text);
+    } else if (!strcmp(metric, "reboots")) {
+        expect(reboots <= limit, line, text);
+    } else if (!strcmp(metric, "recovery")) {
+        int stage = stageIndex(arg);
+        bool all = stage > 0;
+        for (int i = 0; i < lampCount; i++) {
+            all = all && (!nodes[i].powered || (stage == RECOVERY_RESTART ? nodes[i].st.reboots :
+                    nodes[i].st.recoveries && nodes[i].st.recoveryStage == stage));
+        }
+        expect(all, line, text);
+    } else {
+        printf("line %d: unknown metric %s\n", line, metric);
+        failures++;
+    }
+}
+
+bool runScenario(FILE *f) {
+    char line[128];
+    int number = 0;
+    while (fgets(line, sizeof(line), f)) {
+        number++;
+        char text[128];
+        snprintf(text, sizeof(text), "%s", line);
+        text[strcspn(text, "\r\n")] = '\0';
+        char *cmd = strtok(line, " \t\r\n");
+        if (!cmd || *cmd == '#') {
+            continue;
+        }
+        char *a = strtok(NULL, " \t\r\n");
+        char *b = a ? strtok(NULL, " \t\r\n") : NULL;
+        char *c = b ? strtok(NULL, " \t\r\n") : NULL;
+
+        if (!strcmp(cmd, "lamps") && a) {
+            int n = min(atoi(a), fleetSize);
+            uint16_t pixels = b ? atoi(b) : LED_COUNT;
+            for (int i = lampCount; i < n; i++) {
+                nodes[i].ip = ipOf(10, 0, i / 200, i % 200 + 1);
+                nodes[i].pixels = pixels;
+                nodes[i].bootAt = hostMillis + 1 + rng() % 1000;
+            }
+            lampCount = max(lampCount, n);
+            event();
+        } else if (!strcmp(cmd, "latency") && a) {
+            net.latency = atoi(a);
+        } else if (!strcmp(cmd, "jitter") && a) {
+            net.jitter = atoi(a);
+        } else if (!strcmp(cmd, "loss") && a) {
+            net.loss = atof(a);
+        } else if (!strcmp(cmd, "drift") && a) {
+            net.drift = atoi(a);
+        } else if (!strcmp(cmd, "pattern") && a && masterIndex() >= 0) {
+            fleet[masterIndex()].setPattern(a);
+            send(masterIndex());
+            event();
+        } else if (!strcmp(cmd, "sync") && a && lampIndex(a) >= 0) {
+            fleet[lampIndex(a)].requestSync();
+            send(lampIndex(a));
+        } else if (!strcmp(cmd, "span")) {
+            for (int i = 0; i < lampCount; i++) {
+                fleet[i].setSpan(i);
+            }
+            event();
+        } else if (!strcmp(cmd, "drop") && a && lampIndex(a) >= 0) {
+            nodes[lampIndex(a)].powered = false;
+            event();
+        } else if (!strcmp(cmd, "revive") && a && lampIndex(a) >= 0) {
+            nodes[lampIndex(a)].bootAt = hostMillis + 1;
+            event();
+        } else if (!strcmp(cmd, "blackout") && b && c && stageIndex(c) >= 0) {
+            Blackout out = {strcmp(a, "all") ? lampIndex(a) : -1, hostMillis + atoi(b), stageIndex(c)};
+            for (int i = 0; i < lampCount; i++) {
+                out.base.push_back(nodes[i].st);
+            }
+            blackouts.push_back(out);
+            event();
+        } else if (!strcmp(cmd, "run") && a) {
+            memset(&phase, 0, sizeof(phase));
+            phase.start = hostMillis;
+            for (uint32_t end = hostMillis + atoi(a); hostMillis < end;) {
+                step();
+            }
+            report();
+        } else if (!strcmp(cmd, "expect") && a && b) {
+            checkExpectation(number, a, b, text + strlen("expect "));
+        } else {
+            printf("line %d: cannot read \"%s\"\n", number, text);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        printf("usage: %s scenario\n", argv[0]);
+        return 2;
+    }
+    FILE *f = fopen(argv[1], "r");
+    if (!f) {
+        printf("cannot open %s\n", argv[1]);
+        return 2;
+    }
+    printf("%s\n", argv[1]);
+    bool read = runScenario(f);
+    fclose(f);
+    printf(failures ? "%d failures\n" : read ? "ok\n" : "", failures);
+    return failures || !read;
+}
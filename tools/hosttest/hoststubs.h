@@ -0,0 +1,258 @@
+// Minimal host stand-ins for what the sketch's headers use from the ESP8266
+// core, ESPGizmo, FastLED (see fastled.h) and LampSync.h.
+//
+// Only the surface those headers touch is provided. Command and the CH/OP
+// macros have the shape the sketch relies on, not LampSync's wire format, and
+// determineMaster() below is a stand-in rule, so the harness checks the
+// sketch's own logic rather than LampSync.
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+using std::min;
+using std::max;
+
+#define MAX_CMD_DATA        33
+#define MAX_PEERS           16
+#define PEER_TIMEOUT        10000
+#define ALL_CTX             0xFFFF
+#define GROUP_MASK          0x00FF
+#define CHANNEL             1
+#define CH(op)              ((op) >> 8)
+#define OP(op)              ((op) & 0xFF)
+#define CHOP(op)            ((uint16_t) (CHANNEL << 8 | (op)))
+
+// LampSync's op codes and strip contexts; only their distinctness matters here.
+#define HELLO               0x01
+#define SYNC_REQ            0x02
+#define PATTERN             0x03
+#define COLORS              0x04
+#define FRONT_CTX           0x0101
+#define BACK_CTX            0x0201
+
+typedef struct {
+    uint32_t src;
+    uint16_t ctx;
+    uint16_t op;
+    uint8_t data[MAX_CMD_DATA];
+} Command;
+
+typedef struct {
+    uint32_t ip;
+    uint32_t lastHeard;
+    char name[32];
+} Peer;
+
+// Virtual clock shared by every lamp in the process.
+uint32_t hostMillis = 1;
+
+uint32_t millis() {
+    return hostMillis;
+}
+
+uint32_t micros() {
+    return hostMillis * 1000;
+}
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#include "fastled.h"
+
+struct IPAddress {
+    uint32_t ip;
+
+    IPAddress(uint32_t ip) : ip(ip) {}
+
+    operator uint32_t() const {
+        return ip;
+    }
+
+    uint8_t operator[](int i) const {
+        return ip >> 8 * i;
+    }
+
+    std::string toString() const {
+        char s[16];
+        snprintf(s, sizeof(s), "%u.%u.%u.%u", ip & 0xFF, ip >> 8 & 0xFF, ip >> 16 & 0xFF, ip >> 24);
+        return s;
+    }
+};
+
+// Network order, as WiFi.localIP() returns it.
+inline uint32_t ipOf(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    return a | b << 8 | c << 16 | (uint32_t) d << 24;
+}
+
+struct HostGizmo {
+    bool verbose = false;
+    bool restartScheduled = false;
+
+    void scheduleRestart() {
+        restartScheduled = true;
+    }
+
+    void debug(const char *format, ...) {
+        if (verbose) {
+            va_list args;
+            va_start(args, format);
+            vprintf(format, args);
+            va_end(args);
+            printf("\n");
+        }
+    }
+};
+
+HostGizmo gizmo;
+
+// The parts of WiFiUDP and the WiFi connection that recovery.h drives, one of
+// each per lamp. A reconnect takes WIFI_RECONNECT_MILLIS on the lamp's clock.
+#define WL_CONNECTED            3
+#define WL_DISCONNECTED         6
+#define WIFI_RECONNECT_MILLIS   4000
+
+struct HostUDP {
+    uint32_t destination = 0;   // where the last packet read was sent to
+    bool bound = true;
+    uint32_t binds = 0;
+
+    IPAddress destinationIP() {
+        return IPAddress(destination);
+    }
+
+    void begin() {
+        bound = true;
+        binds++;
+    }
+
+    void stop() {
+        bound = false;
+    }
+};
+
+struct HostWiFi {
+    uint32_t (*clock)();        // the lamp's millis()
+    uint32_t ip = 0;
+    uint32_t reconnects = 0;
+    uint32_t connectedAt = 0;
+
+    IPAddress localIP() {
+        return IPAddress(ip);
+    }
+
+    void reconnect() {
+        reconnects++;
+        connectedAt = clock() + WIFI_RECONNECT_MILLIS;
+    }
+
+    int status() {
+        return clock() < connectedAt ? WL_DISCONNECTED : WL_CONNECTED;
+    }
+};
+
+// In-memory SPIFFS; every lamp has its own.
+struct HostFS;
+
+typedef enum {
+    SeekSet,
+    SeekCur,
+    SeekEnd
+} SeekMode;
+
+struct File {
+    std::vector<uint8_t> *content = NULL;
+    size_t pos = 0;
+
+    explicit operator bool() const {
+        return content != NULL;
+    }
+
+    size_t read(uint8_t *buf, size_t n) {
+        n = min(n, content->size() - pos);
+        memcpy(buf, content->data() + pos, n);
+        pos += n;
+        return n;
+    }
+
+    size_t write(const uint8_t *buf, size_t n) {
+        content->insert(content->end(), buf, buf + n);
+        return n;
+    }
+
+    int available() {
+        return content->size() - pos;
+    }
+
+    int read() {
+        return pos < content->size() ? (*content)[pos++] : -1;
+    }
+
+    size_t readBytesUntil(char terminator, char *buf, size_t n) {
+        size_t l = 0;
+        int c;
+        while (l < n && (c = read()) >= 0 && c != terminator) {
+            buf[l++] = c;
+        }
+        return l;
+    }
+
+    size_t position() {
+        return pos;
+    }
+
+    bool seek(size_t to, SeekMode mode) {
+        pos = min(to, content->size());
+        return true;
+    }
+
+    size_t printf(const char *format, ...) {
+        char line[128];
+        va_list args;
+        va_start(args, format);
+        int l = vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+        return write((const uint8_t *) line, min((size_t) l, sizeof(line) - 1));
+    }
+
+    void close() {
+        content = NULL;
+    }
+};
+
+struct HostFS {
+    std::map<std::string, std::vector<uint8_t>> files;
+
+    File open(const char *path, const char *mode) {
+        File f;
+        if (*mode == 'w') {
+            files[path].clear();
+        } else if (!files.count(path)) {
+            return f;
+        }
+        f.content = &files[path];
+        return f;
+    }
+
+    bool exists(const char *path) {
+        return files.count(path);
+    }
+
+    bool remove(const char *path) {
+        return files.erase(path);
+    }
+};
+
+// Datagrams sent by every lamp, in order.
+struct Datagram {
+    uint32_t from;
+    std::vector<uint8_t> bytes;
+};
+
+std::vector<Datagram> bus;
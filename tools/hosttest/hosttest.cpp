@@ -0,0 +1,440 @@
+// Host checks for master election, envelope encoding and decoding, scene
+// transfer and multicast recovery, running several lamps in one process on a
+// shared virtual clock and datagram bus. Each lamp includes members.h,
+// envelope.h, scene.h and recovery.h in its own namespace, so that their
+// globals are per lamp. From the top of the
+// repository:
+//
+//     g++ -std=gnu++17 -Wall -Wno-unused-variable -Itools/hosttest -o /tmp/hosttest tools/hosttest/hosttest.cpp && /tmp/hosttest
+
+#include "hoststubs.h"
+
+namespace lamp0 {
+#include "lamp.inc"
+}
+namespace lamp1 {
+#include "lamp.inc"
+}
+namespace lamp2 {
+#include "lamp.inc"
+}
+namespace lamp3 {
+#include "lamp.inc"
+}
+
+// Per-lamp entry points, so that the checks can loop over lamps.
+typedef struct {
+    const char *name;
+    uint32_t ip;
+    Peer *peers;
+    uint32_t *masterIp;
+    uint16_t *legacyMembers;
+    void (*electMaster)();
+    void (*helloFromMember)(uint32_t, const char *, uint32_t);
+    bool (*pruneMembers)(uint32_t);
+    bool (*hasOtherMaster)();
+    int (*deliver)(const std::vector<uint8_t> &);
+} Lamp;
+
+// A received op, copied out of the lamp's CommandView.
+typedef struct {
+    uint32_t src;
+    uint16_t ctx;
+    uint16_t op;
+    std::vector<uint8_t> data;
+    bool single;
+} Op;
+
+std::vector<Op> received;
+
+// Records every op; SCENE_DATA ops are also handed to the lamp's scene transfer.
+#define LAMP_HANDLER(ns) \
+    void ns##Handler(const ns::CommandView *v) { \
+        received.push_back({v->src, v->ctx, v->op, std::vector<uint8_t>(v->data, v->data + v->len), v->command != NULL}); \
+        if (v->op == SCENE_DATA) { \
+            ns::sceneDataFromPeer(v->data, v->len); \
+        } \
+    } \
+    int ns##Deliver(const std::vector<uint8_t> &d) { \
+        return ns::decodePeerPacket(d.data(), d.size(), ns##Handler); \
+    }
+
+LAMP_HANDLER(lamp0)
+LAMP_HANDLER(lamp1)
+LAMP_HANDLER(lamp2)
+LAMP_HANDLER(lamp3)
+
+#define LAMP(ns, ip) {#ns, ip, ns::peers, &ns::masterIp, &ns::legacyMembers, ns::electMaster, \
+        ns::helloFromMember, ns::pruneMembers, ns::hasOtherMaster, ns##Deliver}
+
+// 10.0.1.1 is the lowest as a plain integer but not as a dotted quad, so the
+// two election rules pick different masters.
+Lamp lamps[] = {
+        LAMP(lamp0, ipOf(10, 0, 0, 5)),
+        LAMP(lamp1, ipOf(10, 0, 0, 2)),
+        LAMP(lamp2, ipOf(10, 0, 1, 1)),
+        LAMP(lamp3, ipOf(10, 0, 0, 9)),
+};
+
+int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+void boot(Lamp *l) {
+    l->peers[0].ip = l->ip;
+    snprintf(l->peers[0].name, sizeof(l->peers[0].name), "%s", l->name);
+    l->electMaster();
+}
+
+// Every lamp in the list hears a HELLO from every other one.
+void exchangeHellos(const int *ids, int n, const uint32_t *intervals) {
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            if (i != j) {
+                lamps[ids[i]].helloFromMember(lamps[ids[j]].ip, lamps[ids[j]].name, intervals[ids[j]]);
+            }
+        }
+    }
+}
+
+void checkElection() {
+    for (Lamp &l : lamps) {
+        boot(&l);
+    }
+    uint32_t intervals[] = {1000, 1000, 1000, 0};
+
+    // Current lamps only: every one agrees on the lowest dotted quad.
+    int current[] = {0, 1, 2};
+    exchangeHellos(current, 3, intervals);
+    for (int i : current) {
+        CHECK(*lamps[i].masterIp == ipOf(10, 0, 0, 2));
+        CHECK(*lamps[i].legacyMembers == 0);
+        CHECK(lamps[i].hasOtherMaster() == (i != 1));
+    }
+
+    // A lamp without a HELLO interval joins: everyone follows LampSync's rule, as it does.
+    int all[] = {0, 1, 2, 3};
+    exchangeHellos(all, 4, intervals);
+    for (int i : current) {
+        CHECK(*lamps[i].legacyMembers == 1);
+        CHECK(*lamps[i].masterIp == ipOf(10, 0, 1, 1));
+    }
+
+    // The old lamp goes quiet and times out: back to the lowest dotted quad.
+    hostMillis += PEER_TIMEOUT / 2;
+    exchangeHellos(current, 3, intervals);
+    hostMillis += PEER_TIMEOUT / 2 + 1;
+    exchangeHellos(current, 3, intervals);
+    for (int i : current) {
+        CHECK(lamps[i].pruneMembers(millis()));
+        CHECK(*lamps[i].legacyMembers == 0);
+        CHECK(*lamps[i].masterIp == ipOf(10, 0, 0, 2));
+    }
+
+    // The master goes quiet: the remaining two elect the next lowest.
+    int rest[] = {0, 2};
+    for (int k = 0; k <= PEER_TIMEOUT / 1000; k++) {
+        hostMillis += 1000;
+        exchangeHellos(rest, 2, intervals);
+    }
+    for (int i : rest) {
+        lamps[i].pruneMembers(millis());
+        CHECK(*lamps[i].masterIp == ipOf(10, 0, 0, 5));
+    }
+}
+
+void checkHelloPacing() {
+    using namespace lamp0;
+    for (uint16_t i = 0; i < 40; i++) {
+        helloFromMember(ipOf(10, 1, i >> 8, i & 0xFF), "peer", HELLO_INTERVAL);
+    }
+    uint32_t expected[] = {1000, 2000, 4000, 8000, 11000, 11000};
+    for (uint32_t want : expected) {
+        hostMillis = max(hostMillis, nextHello);
+        CHECK(helloDue(lamp0::millis()));
+        CHECK(helloInterval == want);
+        CHECK(!helloDue(lamp0::millis()));
+    }
+
+    // A join drops straight back to the base interval.
+    helloFromMember(ipOf(10, 2, 0, 1), "new", HELLO_INTERVAL);
+    hostMillis = nextHello;
+    CHECK(helloDue(lamp0::millis()));
+    CHECK(helloInterval == HELLO_INTERVAL);
+
+    // A member backing off from 8 to 16 seconds survives losing the HELLO in between.
+    helloFromMember(ipOf(10, 2, 0, 3), "backoff", 8000);
+    hostMillis += 9000 + 18000;
+    pruneMembers(lamp0::millis());
+    CHECK(findMember(ipOf(10, 2, 0, 3)) != NULL);
+
+    // While an old lamp is present the interval stays within its fixed timeout.
+    helloFromMember(ipOf(10, 2, 0, 2), "old", 0);
+    for (int k = 0; k < 8; k++) {
+        hostMillis = nextHello;
+        helloDue(lamp0::millis());
+        CHECK(helloInterval <= PEER_TIMEOUT / 2);
+    }
+}
+
+Lamp *receiver;
+
+int deliver(const Datagram &d) {
+    return receiver->deliver(d.bytes);
+}
+
+void checkEnvelopes() {
+    using namespace lamp0;
+    bus.clear();
+    Envelope e;
+    envelopeBegin(&e, lamps[0].ip, multicastSink);
+    uint8_t a[] = {1, 2, 3}, b[] = {4}, c[] = {5, 6, 7, 8, 9, 10};
+    envelopeAdd(&e, 0x0101, 0x11, a, sizeof(a));
+    envelopeAdd(&e, 0x0202, 0x22, b, sizeof(b));
+    envelopeAdd(&e, 0x0303, 0x33, c, sizeof(c));
+    envelopeEnd(&e);
+    CHECK(bus.size() == 1);
+
+    receiver = &lamps[1];
+    received.clear();
+    CHECK(deliver(bus[0]) == 3);
+    CHECK(received.size() == 3);
+    if (received.size() == 3) {
+        CHECK(received[0].ctx == 0x0101 && received[0].op == 0x11 && received[0].data == std::vector<uint8_t>(a, a + 3));
+        CHECK(received[1].ctx == 0x0202 && received[1].op == 0x22 && received[1].data == std::vector<uint8_t>(b, b + 1));
+        CHECK(received[2].ctx == 0x0303 && received[2].op == 0x33 && received[2].data == std::vector<uint8_t>(c, c + 6));
+        CHECK(received[0].src == lamps[0].ip && !received[0].single);
+    }
+
+    // A record count running past the datagram rejects the whole envelope.
+    Datagram bad = bus[0];
+    bad.bytes[offsetof(Command, data) + 1] = 200;
+    received.clear();
+    CHECK(deliver(bad) == 0);
+    CHECK(received.empty());
+
+    // A truncated datagram loses the last record, and with it the envelope.
+    bad = bus[0];
+    bad.bytes.resize(offsetof(Command, data) + ENVELOPE_HEADER + 2 * RECORD_HEADER + 3 + 1 + 2);
+    CHECK(deliver(bad) == 0);
+    CHECK(received.empty());
+
+    // Envelopes that fill up go out before the next op, none longer than a peer packet.
+    uint8_t big[200];
+    memset(big, 0x5A, sizeof(big));
+    bus.clear();
+    envelopeBegin(&e, lamps[0].ip, multicastSink);
+    for (int i = 0; i < 10; i++) {
+        envelopeAdd(&e, ALL_CTX, 0x40 + i, big, sizeof(big));
+    }
+    envelopeEnd(&e);
+    received.clear();
+    int ops = 0;
+    for (Datagram &d : bus) {
+        CHECK(d.bytes.size() <= PEER_PACKET_SIZE);
+        ops += deliver(d);
+    }
+    CHECK(bus.size() == 5);
+    CHECK(ops == 10);
+    for (int i = 0; i < (int) received.size(); i++) {
+        CHECK(received[i].op == 0x40 + i && received[i].data.size() == sizeof(big));
+    }
+
+    // Unbatched envelopes send every op on its own, as older lamps expect.
+    bus.clear();
+    envelopeBegin(&e, lamps[0].ip, NULL);
+    envelopeAdd(&e, 0x0101, 0x12, a, sizeof(a));
+    envelopeAdd(&e, 0x0101, 0x13, b, sizeof(b));
+    envelopeEnd(&e);
+    CHECK(bus.size() == 2);
+    received.clear();
+    for (Datagram &d : bus) {
+        CHECK(deliver(d) == 1);
+    }
+    CHECK(received.size() == 2 && received[0].op == 0x12 && received[0].single);
+    CHECK(received.size() == 2 && !memcmp(received[0].data.data(), a, sizeof(a)));
+}
+
+// What syncStrips(true, true) sends: color settings and pattern of both strips, with the
+// sketch's record sizes and the longest pattern name.
+#define COLOR_SETTINGS_SIZE 55
+
+void sendSync(bool batched) {
+    using namespace lamp0;
+    static const char *longest = "sr_rainbowbit";
+    uint8_t colors[COLOR_SETTINGS_SIZE];
+    memset(colors, 0xC3, sizeof(colors));
+    bus.clear();
+    Envelope e;
+    envelopeBegin(&e, lamps[0].ip, batched ? multicastSink : NULL);
+    envelopeAdd(&e, FRONT_CTX, COLORS, colors, sizeof(colors));
+    envelopeAdd(&e, FRONT_CTX, PATTERN, (const uint8_t *) longest, strlen(longest) + 1);
+    envelopeAdd(&e, BACK_CTX, COLORS, colors, sizeof(colors));
+    envelopeAdd(&e, BACK_CTX, PATTERN, (const uint8_t *) longest, strlen(longest) + 1);
+    envelopeEnd(&e);
+}
+
+void checkSyncDatagram() {
+    sendSync(true);
+    CHECK(bus.size() == 1);
+    receiver = &lamps[1];
+    received.clear();
+    CHECK(deliver(bus[0]) == 4);
+    if (received.size() == 4) {
+        CHECK(received[0].ctx == FRONT_CTX && received[0].op == COLORS && received[0].data.size() == COLOR_SETTINGS_SIZE);
+        CHECK(received[1].ctx == FRONT_CTX && received[1].op == PATTERN &&
+              !strcmp((const char *) received[1].data.data(), "sr_rainbowbit"));
+        CHECK(received[3].ctx == BACK_CTX && received[3].op == PATTERN);
+    }
+    printf("sync of both strips: %zu datagram of %zu bytes\n", bus.size(), bus[0].bytes.size());
+
+    // Older lamps get the same four ops one by one.
+    sendSync(false);
+    CHECK(bus.size() == 4);
+}
+
+void sendScene(uint8_t id, const lamp0::Scene *scene, bool batched) {
+    using namespace lamp0;
+    bus.clear();
+    Envelope e;
+    envelopeBegin(&e, lamps[0].ip, batched ? multicastSink : NULL);
+    addSceneData(&e, id, scene);
+    envelopeEnd(&e);
+}
+
+void checkSceneTransfer() {
+    using namespace lamp0;
+    Scene scene;
+    scene.version = SCENE_VERSION;
+    scene.catalog = 0x5A17;
+    uint8_t *p = (uint8_t *) &scene.strips;
+    for (size_t i = 0; i < sizeof(scene.strips); i++) {
+        p[i] = rand();
+    }
+    CHECK(writeScene(3, &scene));
+
+    // In order, all chunks batched into one datagram.
+    sendScene(3, &scene, true);
+    CHECK(bus.size() == 1);
+    CHECK(bus[0].bytes.size() <= PEER_PACKET_SIZE);
+    receiver = &lamps[1];
+    CHECK(deliver(bus[0]) == (int) SCENE_CHUNKS);
+    lamp1::Scene got;
+    CHECK(lamp1::readScene(3, &got, 0x5A17));
+    CHECK(!memcmp(&got, &scene, sizeof(Scene)));
+    CHECK(lamp1::sceneStats.received == 1);
+    CHECK(!lamp1::readScene(3, &got, 0x5A18));
+
+    // Out of order, one op per datagram.
+    sendScene(4, &scene, false);
+    CHECK(bus.size() == SCENE_CHUNKS);
+    receiver = &lamps[2];
+    for (size_t i = bus.size(); i-- > 0;) {
+        deliver(bus[i]);
+    }
+    lamp2::Scene got2;
+    CHECK(lamp2::readScene(4, &got2, 0x5A17));
+    CHECK(!memcmp(&got2, &scene, sizeof(Scene)));
+
+    // A corrupted chunk fails the CRC and nothing is stored.
+    sendScene(5, &scene, false);
+    bus[1].bytes[offsetof(Command, data) + SCENE_OP_SIZE + 2] ^= 0x40;
+    receiver = &lamps[3];
+    for (Datagram &d : bus) {
+        deliver(d);
+    }
+    lamp3::Scene got3;
+    CHECK(!lamp3::readScene(5, &got3, 0x5A17));
+    CHECK(lamp3::sceneStats.received == 0);
+
+    // A chunk claiming to run past the scene is ignored.
+    uint8_t data[SCENE_OP_SIZE + 2 + SCENE_CHUNK] = {0};
+    writeSceneOp(data, 6, 0);
+    data[SCENE_OP_SIZE] = sizeof(Scene) - 1;
+    data[SCENE_OP_SIZE + 1] = SCENE_CHUNK;
+    lamp3::sceneDataFromPeer(data, sizeof(data));
+    CHECK(!lamp3::readScene(6, &got3, 0x5A17));
+}
+
+// Runs the sketch's once a second recovery call for ms of the virtual clock.
+void recoverFor(uint32_t ms) {
+    for (uint32_t end = hostMillis + ms; hostMillis < end;) {
+        hostMillis += 1000;
+        lamp3::recoveryStep(lamp3::millis());
+    }
+}
+
+void checkRecovery() {
+    using namespace lamp3;
+    WiFi.ip = ipOf(10, 0, 0, 9);
+
+    // Before any group packet there is nothing to rejoin, so rebinding comes first.
+    uint32_t binds = group.binds;
+    recoveryStep(lamp3::millis());
+    CHECK(recovery.stage == RECOVERY_REBIND);
+    CHECK(recovery.attempts[RECOVERY_REJOIN] == 1 && igmpJoins == 0);
+    CHECK(group.binds == binds + 1);
+    recoveryDone(lamp3::millis());
+    CHECK(recovery.stage == RECOVERY_IDLE && recovery.lastStage == RECOVERY_REBIND);
+
+    group.destination = ipOf(239, 49, 0, 1);
+    noteGroupPacket();
+    CHECK(groupIp == ipOf(239, 49, 0, 1));
+
+    // Each stage gets RECOVERY_SETTLE before the next one runs.
+    uint32_t started = lamp3::millis();
+    recoveryStep(started);
+    CHECK(recovery.stage == RECOVERY_REJOIN);
+    CHECK(igmpJoins == 1 && igmpGroup == groupIp);
+    recoverFor(RECOVERY_SETTLE - 1000);
+    CHECK(recovery.stage == RECOVERY_REJOIN && igmpJoins == 1);
+    recoverFor(1000);
+    CHECK(recovery.stage == RECOVERY_REBIND);
+    CHECK(group.binds == binds + 2);
+
+    // The WiFi stage rebinds once the connection is back, not before.
+    recoverFor(RECOVERY_SETTLE);
+    CHECK(recovery.stage == RECOVERY_WIFI && WiFi.reconnects == 1);
+    CHECK(recovery.rebindPending && group.binds == binds + 2);
+    recoverFor(WIFI_RECONNECT_MILLIS);
+    CHECK(!recovery.rebindPending && group.binds == binds + 3);
+
+    // Restarting is the last stage, and it is taken only once.
+    CHECK(!lamp3::gizmo.restartScheduled);
+    recoverFor(RECOVERY_SETTLE - WIFI_RECONNECT_MILLIS);
+    CHECK(recovery.stage == RECOVERY_RESTART && lamp3::gizmo.restartScheduled);
+    CHECK(recovery.reboots == 1);
+    recoverFor(3 * RECOVERY_SETTLE);
+    CHECK(recovery.reboots == 1 && recovery.attempts[RECOVERY_RESTART] == 1);
+    recovery.reboots = 0;
+    loadReboots();
+    CHECK(recovery.reboots == 1);
+
+    // Hearing peers again ends the recovery, and the next one starts over at rejoin.
+    recoveryDone(lamp3::millis());
+    CHECK(recovery.stage == RECOVERY_IDLE && recovery.lastStage == RECOVERY_RESTART);
+    CHECK(recovery.recoveries == 2);
+    CHECK(recovery.lastMillis == lamp3::millis() - started);
+    recoveryDone(lamp3::millis());
+    CHECK(recovery.recoveries == 2);
+    recoveryStep(lamp3::millis());
+    CHECK(recovery.stage == RECOVERY_REJOIN && igmpJoins == 2);
+    recoveryDone(lamp3::millis());
+    CHECK(recovery.lastStage == RECOVERY_REJOIN && recovery.lastMillis == 0);
+}
+
+int main() {
+    checkElection();
+    checkHelloPacing();
+    checkEnvelopes();
+    checkSyncDatagram();
+    checkSceneTransfer();
+    checkRecovery();
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,218 @@
+// Host check and benchmark for the state document written by json.h.
+//
+// The snprintf chain that broadcastState() used before the writer is kept
+// below as the reference. Both produce the fields the old document had, the
+// outputs are compared with the whitespace outside strings removed (the old
+// format put a blank after each colon), then both are timed. From the top of
+// the repository:
+//
+//     g++ -std=gnu++17 -O2 -Wall -Wno-stringop-truncation -fstack-usage -o /tmp/jsontest tools/hosttest/jsontest.cpp && /tmp/jsontest
+//
+// -fstack-usage leaves the frame size of every function in jsontest.su.
+
+#include <chrono>
+#include <string>
+
+#include "sketch.h"
+#include "../../json.h"
+
+#define SW_VERSION "2.0.0"
+
+Pattern patterns[] = {
+        {"fire", NULL, 20, 20, false, true},
+        {"plasma", NULL, 20, 20, false, true},
+        {"gradient", NULL, 200, 20, false, true},
+        {"pacifica", NULL, 20, 20, false, true},
+        {"murica", NULL, 20, -10, false, true},
+        {"embers", NULL, 20, -10, false, true},
+        {"twinklefox", NULL, 20, -10, false, false},
+        {"sr_ripple", NULL, 2000, 20, true, true},
+        {"sr_matrix", NULL, 2000, 40, true, true},
+        {"sr_rainbowbit", NULL, 2000, 10, true, true},
+        {"sr_besin", NULL, 2000, 20, true, true},
+        {"test", NULL, 20, 20, false, false}
+};
+
+Strip front, back;
+char masterName[32] = "living-room";
+uint32_t masterIp = ipOf(192, 168, 1, 23);
+char lampName[32] = "bedroom";
+uint32_t sleepTime = 0;
+
+// --- Reference: the snprintf chain from before json.h ---
+
+#define STRIP_STATUS "\"%s\": {\"on\": %s,\"rgb\": \"#%06X\",\"brightness\": %d,\"effect\": \"%s\"}"
+
+char *refStripStatus(char *html, Strip *s) {
+    snprintf(html, 127, STRIP_STATUS, s->name, s->on ? "true" : "false",
+             s->color.red << 16 | s->color.green << 8 | s->color.blue, s->brightness,
+             s->pattern ? s->pattern->name : "solid");
+    return html;
+}
+
+char *refFavorites(char *favs) {
+    char fav[32];
+    favs[0] = '\0';
+    strncat(favs, "\"favs\": {", 16);
+    int i = 0;
+    boolean first = true;
+    while (strcmp(patterns[i].name, "test")) {
+        if (patterns[i].favorite) {
+            fav[0] = '\0';
+            snprintf(fav, 24, "%s\"%s\":1", !first ? "," : "", patterns[i].name);
+            strncat(favs, fav, 31);
+            first = false;
+        }
+        i++;
+    }
+    strncat(favs, "},", 16);
+    return favs;
+}
+
+#define STATUS \
+    "{%s,%s,\"master\": \"%s\",\"masterIp\": \"%s\",\"isMaster\": %s,\"hasPotentialMaster\": %s," \
+    "\"syncWithMaster\": %s,\"buddyAvailable\": %s,\"buddySilent\": %s,\"name\": \"%s\",%s" \
+    "\"sleep\": %lu,\"version\":\"" SW_VERSION "\"}"
+
+size_t __attribute__((noinline)) refState(char *out, boolean all) {
+    char state[1024], f[128], b[128], favs[512];
+    state[0] = '\0';
+    favs[0] = '\0';
+
+    if (all) {
+        refFavorites(favs);
+    }
+
+    snprintf(state, 1023, STATUS, refStripStatus(f, &front), refStripStatus(b, &back),
+             masterName, IPAddress(masterIp).toString().c_str(),
+             "false", "true", "true", "false", "false",
+             lampName, favs, (unsigned long) (sleepTime ? (sleepTime - millis()) / 1000 : 0));
+    size_t n = strlen(state);
+    memcpy(out, state, n + 1);
+    return n;
+}
+
+// --- The writer, producing the same fields ---
+
+void stripStatus(JsonWriter *w, Strip *s) {
+    jsonObjectBegin(w, s->name);
+    jsonBool(w, "on", s->on);
+    jsonColor(w, "rgb", s->color);
+    jsonUInt(w, "brightness", s->brightness);
+    jsonString(w, "effect", s->pattern ? s->pattern->name : "solid");
+    jsonObjectEnd(w);
+}
+
+void favorites(JsonWriter *w) {
+    jsonObjectBegin(w, "favs");
+    int i = 0;
+    while (strcmp(patterns[i].name, "test")) {
+        if (patterns[i].favorite) {
+            jsonUInt(w, patterns[i].name, 1);
+        }
+        i++;
+    }
+    jsonObjectEnd(w);
+}
+
+size_t __attribute__((noinline)) writerState(boolean all) {
+    JsonWriter w;
+    jsonBegin(&w, NULL, false);
+    jsonObjectBegin(&w, NULL);
+    stripStatus(&w, &front);
+    stripStatus(&w, &back);
+    jsonString(&w, "master", masterName);
+    jsonIp(&w, "masterIp", masterIp);
+    jsonBool(&w, "isMaster", false);
+    jsonBool(&w, "hasPotentialMaster", true);
+    jsonBool(&w, "syncWithMaster", true);
+    jsonBool(&w, "buddyAvailable", false);
+    jsonBool(&w, "buddySilent", false);
+    jsonString(&w, "name", lampName);
+    if (all) {
+        favorites(&w);
+    }
+    jsonUInt(&w, "sleep", sleepTime ? (sleepTime - millis()) / 1000 : 0);
+    jsonString(&w, "version", SW_VERSION);
+    jsonObjectEnd(&w);
+    jsonEnd(&w);
+    return w.len;
+}
+
+// Drops blanks outside strings, so that "a": 1 and "a":1 compare equal.
+std::string compact(const char *s) {
+    std::string out;
+    bool quoted = false;
+    for (; *s; s++) {
+        if (*s == '"') {
+            quoted = !quoted;
+        }
+        if (quoted || *s != ' ') {
+            out += *s;
+        }
+    }
+    return out;
+}
+
+int failures = 0;
+
+void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+template<typename F>
+double nsPerCall(F f, int n) {
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) {
+        f(i);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+}
+
+int main() {
+    front.name = "front";
+    back.name = "back";
+    char ref[1024];
+    volatile size_t sink = 0;
+
+    for (int i = 0; i < 2000; i++) {
+        front.on = random8() & 1;
+        back.on = random8() & 1;
+        front.color = CRGB(random8(), random8(), random8());
+        back.color = CRGB(random8(), random8(), random8());
+        front.brightness = random8();
+        back.brightness = random8();
+        front.pattern = random8() & 1 ? &patterns[random8(ARRAY_SIZE(patterns))] : NULL;
+        back.pattern = &patterns[random8(ARRAY_SIZE(patterns))];
+        masterIp = random16() | (uint32_t) random16() << 16;
+        sleepTime = random8() & 1 ? millis() + random16() * 1000 : 0;
+        bool all = i & 1;
+
+        refState(ref, all);
+        writerState(all);
+        if (compact(ref) != compact(jsonBuf)) {
+            printf("reference: %s\nwriter:    %s\n", ref, jsonBuf);
+            check(false, "writer output differs from the snprintf chain");
+            break;
+        }
+    }
+
+    strcpy(lampName, "say \"hi\" \\o/");
+    writerState(false);
+    check(strstr(jsonBuf, "\"name\":\"say \\\"hi\\\" \\\\o/\"") != NULL, "quotes and backslashes are escaped");
+    strcpy(lampName, "bedroom");
+
+    for (int all = 0; all < 2; all++) {
+        double tr = nsPerCall([&](int i) { sink += refState(ref, all); }, 200000);
+        double tw = nsPerCall([&](int i) { sink += writerState(all); }, 200000);
+        printf("state%s: snprintf %5.0f ns  writer %5.0f ns  %zu bytes\n",
+               all ? " with favorites" : "", tr, tw, writerState(all));
+    }
+
+    printf(failures ? "%d failures\n" : "ok\n", failures);
+    return failures != 0;
+}
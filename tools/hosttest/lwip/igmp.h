@@ -0,0 +1,25 @@
+// Host stand-in for the lwIP IGMP calls that recovery.h makes.
+//
+// Deliberately without an include guard: recovery.h includes it inside each
+// lamp's namespace, so every lamp gets its own group membership record.
+
+typedef struct {
+    uint32_t addr;
+} ip4_addr_t;
+
+#define IP4_ADDR_ANY4   NULL
+#define ERR_OK          0
+
+uint32_t igmpGroup = 0;
+uint32_t igmpJoins = 0;
+
+int igmp_joingroup(const ip4_addr_t *ifaddr, const ip4_addr_t *groupaddr) {
+    igmpGroup = groupaddr->addr;
+    igmpJoins++;
+    return ERR_OK;
+}
+
+int igmp_leavegroup(const ip4_addr_t *ifaddr, const ip4_addr_t *groupaddr) {
+    igmpGroup = 0;
+    return ERR_OK;
+}
@@ -0,0 +1,745 @@
+// Host checks and benchmarks for the pattern kernels.
+//
+// Each optimized kernel is run side by side with the code it replaced,
+// transcribed below from before the change, on strips of several lengths
+// over a run of frames on the virtual clock. Unless noted otherwise the
+// pixels must match byte for byte on every frame; then both are timed.
+// From the top of the repository:
+//
+//     g++ -std=gnu++17 -O2 -Wall -Wno-unused-variable -Wno-unused-function -o /tmp/patterntest tools/hosttest/patterntest.cpp && /tmp/patterntest
+//
+// Add -DTWINKLE_CLOCK_CACHE=1 to check the twinkle clock table as well, and
+// -fsanitize=address,undefined to catch renderers that index past the end of
+// their strip's buffers.
+// Host timings only show the relative gain; the ESP8266 has no data cache,
+// no FPU and a slower multiplier, so its numbers differ.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include "sketch.h"
+#include "../../pixelops.h"
+#include "../../simple.h"
+#include "../../noisefield.h"
+#include "../../fire.h"
+#include "../../noise.h"
+#include "../../plasma.h"
+#include "../../blendwave.h"
+#include "../../dotBeat.h"
+#include "../../pixels.h"
+#include "../../ripple.h"
+#include "../../matrix.h"
+#include "../../pixel.h"
+#include "../../onesine.h"
+#include "../../rainbowg.h"
+#include "../../besin.h"
+#include "../../fillnoise.h"
+#include "../../plasmasr.h"
+#include "../../rainbowbit.h"
+#include "../../firesr.h"
+#include "../../splitfiresr.h"
+#include "../../pacifica.h"
+#include "../../twinklefox.h"
+#include "../../fireworks.h"
+#include "../../murica.h"
+#include "../../geometry.h"
+#include "../../patterns2d.h"
+#include "../../program.h"
+
+int failures = 0;
+
+void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static const uint16_t lengths[] = {60, 300, 1000};
+
+// Runs both renderers on their own strip for a number of frames, advancing
+// the virtual clock between frames, and compares the pixels after each one.
+bool sameFrames(std::function<void(Strip *)> ref, std::function<void(Strip *)> opt,
+                uint16_t n, int frames, uint32_t step) {
+    Strip *a = newStrip(n, NULL);
+    Strip *b = newStrip(n, NULL);
+    uint32_t start = hostMillis;
+    bool same = true;
+    for (int f = 0; f < frames && same; f++) {
+        ref(a);
+        opt(b);
+        same = !memcmp(a->leds, b->leds, n * sizeof(CRGB));
+        if (!same) {
+            for (int i = 0; i < n; i++) {
+                if (a->leds[i] != b->leds[i]) {
+                    printf("  frame %d pixel %d: %02X%02X%02X != %02X%02X%02X\n", f, i,
+                           a->leds[i].r, a->leds[i].g, a->leds[i].b, b->leds[i].r, b->leds[i].g, b->leds[i].b);
+                    break;
+                }
+            }
+        }
+        hostMillis += step;
+    }
+    hostMillis = start;
+    deleteStrip(a);
+    deleteStrip(b);
+    return same;
+}
+
+// Microseconds per frame for a renderer on a strip of n pixels, best of three runs.
+double usPerFrame(std::function<void(Strip *)> render, uint16_t n, int frames) {
+    Strip *s = newStrip(n, NULL);
+    uint32_t start = hostMillis;
+    double best = 1e9;
+    for (int run = 0; run < 3; run++) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++) {
+            render(s);
+            hostMillis += 11;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::micro>(t1 - t0).count() / frames);
+    }
+    hostMillis = start;
+    deleteStrip(s);
+    return best;
+}
+
+void compareAndTime(const char *name, std::function<void(Strip *)> ref, std::function<void(Strip *)> opt,
+                    int frames, uint32_t step) {
+    for (uint16_t n : lengths) {
+        char what[64];
+        snprintf(what, sizeof(what), "%s matches at %d pixels", name, n);
+        check(sameFrames(ref, opt, n, frames, step), what);
+        int timed = 1000000 / n;
+        double tr = usPerFrame(ref, n, timed);
+        double to = usPerFrame(opt, n, timed);
+        printf("%-12s %4d px: before %7.1f us  after %7.1f us  (%.2fx)\n", name, n, tr, to, tr / to);
+    }
+}
+
+// --- twinklefox: drawTwinkles as it was before the clock table ---
+
+namespace ref {
+
+CRGB computeOneTwinkle(Strip *s, uint32_t ms, uint8_t salt) {
+    uint16_t ticks = ms >> (8 - TWINKLE_SPEED);
+    uint8_t fastcycle8 = ticks;
+    uint16_t slowcycle16 = (ticks >> 8) + salt;
+    slowcycle16 += sin8(slowcycle16);
+    slowcycle16 = (slowcycle16 * 2053) + 1384;
+    uint8_t slowcycle8 = (slowcycle16 & 0xFF) + (slowcycle16 >> 8);
+
+    uint8_t bright = 0;
+    if (((slowcycle8 & 0x0E) / 2) < TWINKLE_DENSITY) {
+        bright = attackDecayWave8(fastcycle8);
+    }
+
+    uint8_t hue = slowcycle8 - salt;
+    CRGB c;
+    if (bright > 0) {
+        c = ColorFromPalette(s->currentPalette, hue, bright, NOBLEND);
+        if (COOL_LIKE_INCANDESCENT == 1) {
+            coolLikeIncandescent(c, fastcycle8);
+        }
+    } else {
+        c = CRGB::Black;
+    }
+    return c;
+}
+
+void drawTwinkles(Strip *s) {
+    uint16_t PRNG16 = 11337;
+    uint32_t clock32 = millis();
+    CRGB bg = gBackgroundColor;
+    uint8_t backgroundBrightness = bg.getAverageLight();
+
+    for (int i = 0; i < s->count; i++) {
+        CRGB &pixel = s->leds[i];
+        PRNG16 = (uint16_t)(PRNG16 * 2053) + 1384;
+        uint16_t myclockoffset16 = PRNG16;
+        PRNG16 = (uint16_t)(PRNG16 * 2053) + 1384;
+        uint8_t myspeedmultiplierQ5_3 = ((((PRNG16 & 0xFF) >> 4) + (PRNG16 & 0x0F)) & 0x0F) + 0x08;
+        uint32_t myclock30 = (uint32_t)((clock32 * myspeedmultiplierQ5_3) >> 3) + myclockoffset16;
+        uint8_t myunique8 = PRNG16 >> 8;
+
+        CRGB c = computeOneTwinkle(s, myclock30, myunique8);
+
+        uint8_t cbright = c.getAverageLight();
+        int16_t deltabright = cbright - backgroundBrightness;
+        if (deltabright >= 32 || (!bg)) {
+            pixel = blend(pixel, c, 32);
+        } else if (deltabright > 0) {
+            pixel = blend(bg, c, deltabright * 8);
+        } else {
+            pixel = blend(pixel, bg, 32);
+        }
+    }
+}
+
+}
+
+// Steps through the festive palettes, one every half second of virtual time.
+void festivePalette(Strip *s) {
+    s->currentPalette = *FestivePaletteList[millis() / 500 % ARRAY_SIZE(FestivePaletteList)];
+}
+
+void checkTwinkles() {
+    compareAndTime("twinkles",
+                   [](Strip *s) { festivePalette(s); ref::drawTwinkles(s); },
+                   [](Strip *s) { festivePalette(s); drawTwinkles(s); }, 400, 13);
+}
+
+// --- pacifica: the four layers, whitecaps and deepening as separate passes ---
+
+namespace ref {
+
+void pacifica_one_layer(Strip *s, CRGBPalette16 &p, uint16_t cistart, uint16_t wavescale, uint8_t bri, uint16_t ioff) {
+    uint16_t ci = cistart;
+    uint16_t waveangle = ioff;
+    uint16_t wavescale_half = (wavescale / 2) + 20;
+    for (uint16_t i = 0; i < s->count; i++) {
+        waveangle += 250;
+        uint16_t s16 = sin16(waveangle) + 32768;
+        uint16_t cs = scale16(s16, wavescale_half) + wavescale_half;
+        ci += cs;
+        uint16_t sindex16 = sin16(ci) + 32768;
+        uint8_t sindex8 = scale16(sindex16, 240);
+        CRGB c = ColorFromPalette(p, sindex8, bri, LINEARBLEND);
+        s->leds[i] += c;
+    }
+}
+
+void pacifica_add_whitecaps(Strip *s) {
+    uint8_t basethreshold = beatsin8(9, 55, 65);
+    uint8_t wave = beat8(7);
+
+    for (uint16_t i = 0; i < s->count; i++) {
+        uint8_t threshold = scale8(sin8(wave), 20) + basethreshold;
+        wave += 7;
+        uint8_t l = s->leds[i].getAverageLight();
+        if (l > threshold) {
+            uint8_t overage = l - threshold;
+            uint8_t overage2 = qadd8(overage, overage);
+            s->leds[i] += CRGB(overage, overage2, qadd8(overage2, overage2));
+        }
+    }
+}
+
+void pacifica_deepen_colors(Strip *s) {
+    for (uint16_t i = 0; i < s->count; i++) {
+        s->leds[i].blue = scale8(s->leds[i].blue, 145);
+        s->leds[i].green = scale8(s->leds[i].green, 200);
+        s->leds[i] |= CRGB(2, 5, 7);
+    }
+}
+
+void pacifica(Strip *s) {
+    static uint16_t sCIStart1, sCIStart2, sCIStart3, sCIStart4;
+    static uint32_t sLastms = 0;
+    uint32_t ms = GET_MILLIS();
+    uint32_t deltams = ms - sLastms;
+    sLastms = ms;
+    uint16_t speedfactor1 = beatsin16(3, 179, 269);
+    uint16_t speedfactor2 = beatsin16(4, 179, 269);
+    uint32_t deltams1 = (deltams * speedfactor1) / 256;
+    uint32_t deltams2 = (deltams * speedfactor2) / 256;
+    uint32_t deltams21 = (deltams1 + deltams2) / 2;
+    sCIStart1 += (deltams1 * beatsin88(1011, 10, 13));
+    sCIStart2 -= (deltams21 * beatsin88(777, 8, 11));
+    sCIStart3 -= (deltams1 * beatsin88(501, 5, 7));
+    sCIStart4 -= (deltams2 * beatsin88(257, 4, 6));
+
+    fill_solid(s->leds, s->count, CRGB(2, 6, 10));
+
+    pacifica_one_layer(s, pacifica_palette_1, sCIStart1, beatsin16(3, 11 * 256, 14 * 256), beatsin8(10, 70, 130),
+                       0 - beat16(301));
+    pacifica_one_layer(s, pacifica_palette_2, sCIStart2, beatsin16(4, 6 * 256, 9 * 256), beatsin8(17, 40, 80),
+                       beat16(401));
+    pacifica_one_layer(s, pacifica_palette_3, sCIStart3, 6 * 256, beatsin8(9, 10, 38), 0 - beat16(503));
+    pacifica_one_layer(s, pacifica_palette_3, sCIStart4, 5 * 256, beatsin8(8, 10, 28), beat16(601));
+
+    pacifica_add_whitecaps(s);
+    pacifica_deepen_colors(s);
+}
+
+}
+
+void checkPacifica() {
+    compareAndTime("pacifica", ref::pacifica, pacifica, 2000, 17);
+}
+
+// --- fillNoise8: one call per strip instead of inoise8(x, y) per pixel ---
+
+void checkNoise() {
+    static uint8_t expected[1000];
+    static uint8_t actual[1000];
+    bool same = true;
+    for (int run = 0; run < 2000 && same; run++) {
+        uint16_t n = 1 + random16(1000);
+        uint16_t x = random16(), y = random16();
+        int16_t dx = random16(), dy = random16();
+        if (run & 1) {
+            // The steps the patterns use: small, often equal on both axes.
+            dx = random8(64);
+            dy = run & 2 ? dx : random8(64);
+        }
+        for (uint16_t i = 0; i < n; i++) {
+            expected[i] = inoise8(x + i * dx, y + i * dy);
+        }
+        fillNoise8(actual, n, x, dx, y, dy);
+        same = !memcmp(expected, actual, n);
+    }
+    check(same, "fillNoise8 matches inoise8");
+
+    // The noise pattern's own walk: SCALE apart along the strip, drifting each frame.
+    volatile uint8_t sink = 0;
+    for (uint16_t n : lengths) {
+        int frames = 1000000 / n;
+        double best[2] = {1e9, 1e9};
+        for (int pass = 0; pass < 6; pass++) {
+            uint16_t dist = 0;
+            auto t0 = std::chrono::steady_clock::now();
+            for (int f = 0; f < frames; f++, dist += 3) {
+                if (pass & 1) {
+                    fillNoise8(actual, n, 0, SCALE, dist, SCALE);
+                } else {
+                    for (uint16_t i = 0; i < n; i++) {
+                        actual[i] = inoise8(i * SCALE, dist + i * SCALE);
+                    }
+                }
+                sink += actual[n - 1];
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            best[pass & 1] = std::min(best[pass & 1], std::chrono::duration<double, std::micro>(t1 - t0).count() / frames);
+        }
+        printf("%-12s %4d px: before %7.1f us  after %7.1f us  (%.2fx)\n", "fillNoise8", n, best[0], best[1], best[0] / best[1]);
+    }
+}
+
+// --- fire: the heat engine against the step that fire() and firesr() used to run ---
+
+namespace ref {
+
+// One step of the old fire(); cooling takes random8(0, lim) unless told to use the engine's source.
+void fireStep(Strip *s, bool engineRandom) {
+    for (int i = 0; i < s->count; i++) {
+        uint8_t lim = ((COOLING * 10) / s->count) + 2;
+        s->data[i] = qsub8(s->data[i], engineRandom ? fireRandom8(lim) : random8(0, lim));
+    }
+    for (int k = s->count - 1; k >= 2; k--) {
+        s->data[k] = (s->data[k - 1] + s->data[k - 2] + s->data[k - 2]) / 3;
+    }
+    if (random8() < SPARKING) {
+        int y = random8(7);
+        s->data[y] = qadd8(s->data[y], random8(160, 255));
+    }
+    for (int j = 0; j < s->count; j++) {
+        s->leds[j] = HeatColor(s->data[j]);
+    }
+}
+
+}
+
+uint32_t averageLight(Strip *s) {
+    uint32_t sum = 0;
+    for (int i = 0; i < s->count; i++) {
+        sum += s->leds[i].getAverageLight();
+    }
+    return sum / s->count;
+}
+
+void checkFire() {
+    setupHeatPalette();
+    bool same = true;
+    for (int i = 0; i < 256; i++) {
+        same = same && heatPalette[i] == HeatColor(i);
+    }
+    check(same, "heat palette matches HeatColor");
+
+    // With the same random source for cooling, the engine is the old step exactly. Each
+    // side keeps its own FastLED PRNG state, and the old step's cooling source is seeded
+    // the way the engine seeds it.
+    static uint16_t seeds[2];
+    auto swapSeed = [](int side) {
+        std::swap(rand16seed, seeds[side]);
+    };
+    auto before = [&](Strip *s, bool engineRandom) {
+        swapSeed(0);
+        if (engineRandom) {
+            fireSeed = random16() | 1;
+        }
+        ref::fireStep(s, engineRandom);
+        swapSeed(0);
+    };
+    auto after = [&](Strip *s) {
+        swapSeed(1);
+        fireEngine(s, COOLING, SPARKING, FIRE_LINEAR, 1);
+        swapSeed(1);
+    };
+
+    for (uint16_t n : lengths) {
+        seeds[0] = seeds[1] = 1337;
+        char what[64];
+        snprintf(what, sizeof(what), "fire matches at %d pixels", n);
+        check(sameFrames([&](Strip *s) { before(s, true); }, after, n, 2000, 10), what);
+
+        // With its own cheaper source the flames differ pixel by pixel, but not in how much
+        // of the strip they light.
+        Strip *a = newStrip(n, NULL);
+        Strip *b = newStrip(n, NULL);
+        uint64_t la = 0, lb = 0;
+        for (int f = 0; f < 20000; f++) {
+            before(a, false);
+            after(b);
+            la += averageLight(a);
+            lb += averageLight(b);
+        }
+        check(lb * 10 > la * 9 && lb * 10 < la * 11, "fire lights the strip as much as before");
+        deleteStrip(a);
+        deleteStrip(b);
+
+        int timed = 1000000 / n;
+        double tr = usPerFrame([&](Strip *s) { before(s, false); }, n, timed);
+        double to = usPerFrame(after, n, timed);
+        printf("%-12s %4d px: before %7.1f us  after %7.1f us  (%.2fx), average light %.1f -> %.1f\n",
+               "fire", n, tr, to, tr / to, la / 20000.0, lb / 20000.0);
+    }
+}
+
+// --- 2D patterns: geometry tables against coordinates worked out per pixel ---
+
+namespace ref {
+
+// What a pattern would have to do without the tables: undo the serpentine layout,
+// then take the polar coordinates with float trig, for every pixel of every frame.
+void matrixXY(uint16_t i, uint8_t w, uint8_t h, uint8_t *x, uint8_t *y) {
+    uint16_t row = i / w;
+    uint16_t col = row & 1 ? w - 1 - i % w : i % w;
+    *x = col * 255 / (w - 1);
+    *y = min(row, (uint16_t) (h - 1)) * 255 / (h - 1);
+}
+
+void matrixPolar(uint8_t x, uint8_t y, uint8_t *angle, uint8_t *radius) {
+    float dx = x - 127.5f;
+    float dy = y - 127.5f;
+    *angle = (uint8_t) (int) (atan2f(dy, dx) * 128 / PI);
+    *radius = (uint8_t) (hypotf(dx, dy) * 255 / hypotf(127.5f, 127.5f));
+}
+
+void noise2d(Strip *s) {
+    static uint16_t z = 0;
+    Geometry *g = s->geometry;
+    nblendPaletteTowardPalette(s->currentPalette, s->targetPalette, min(255, 48 * dueSteps(&s->t3, 10)));
+    for (uint16_t i = 0; i < s->count; i++) {
+        uint8_t x, y;
+        matrixXY(i, g->width, g->height, &x, &y);
+        uint8_t index = inoise8(x * NOISE2D_SCALE, y * NOISE2D_SCALE, z);
+        s->leds[i] = ColorFromPalette(s->currentPalette, index, 255, s->currentBlending);
+    }
+    z += frameDelta(s, beatsin8(10, 4, 12));
+}
+
+void plasma2d(Strip *s) {
+    Geometry *g = s->geometry;
+    uint8_t thisPhase = beatsin8(6, 0, 255);
+    uint8_t thatPhase = beatsin8(7, 0, 255);
+    uint8_t cutoff = beatsin8(7, 0, 96);
+    for (uint16_t i = 0; i < s->count; i++) {
+        uint8_t x, y, angle, radius;
+        matrixXY(i, g->width, g->height, &x, &y);
+        matrixPolar(x, y, &angle, &radius);
+        uint8_t colorIndex = cubicwave8(x + y / 2 + thisPhase) / 2 + cos8(angle + radius / 2 + thatPhase) / 2;
+        uint8_t thisBright = qsuba(colorIndex, cutoff);
+        s->leds[i] = ColorFromPalette(s->currentPalette, colorIndex, thisBright, LINEARBLEND);
+    }
+}
+
+void fire2d(Strip *s) {
+    Geometry *g = s->geometry;
+    EVERY_X_MILLIS(s->t2, 10)
+        setupHeatPalette();
+        fireSeed = random16() | 1;
+        uint16_t w = g->width, h = g->height;
+        uint8_t coolMax = min(255, ((COOLING * 10) / h) + 2);
+        for (uint16_t col = 0; col < w; col++) {
+            byte *heat = s->data + col * h;
+            fireColumn(heat, h, coolMax, SPARKING);
+            for (uint16_t row = 0; row < h; row++) {
+                s->leds[row * w + (row & 1 ? w - 1 - col : col)] = heatPalette[heat[row]];
+            }
+        }
+    }
+}
+
+}
+
+// Gives the strip a width x height serpentine matrix layout through its geometry file.
+void matrixGeometry(Strip *s, int width, int height) {
+    if (!s->geometry->x) {
+        char path[32];
+        snprintf(path, sizeof(path), GEOMETRY, s->name);
+        File f = SPIFFS.open(path, "w");
+        f.printf("matrix %d %d\n", width, height);
+        f.close();
+        loadGeometry(s);
+    }
+}
+
+// Runs a renderer with its own FastLED PRNG state, so that two renderers drawing
+// random numbers alternately each see the sequence they would see alone.
+void withSeed(uint16_t &seed, Renderer render, Strip *s) {
+    std::swap(rand16seed, seed);
+    render(s);
+    std::swap(rand16seed, seed);
+}
+
+void check2d() {
+    static const struct {
+        const char *name;
+        Renderer before, after;
+    } patterns[] = {
+            {"noise2d", ref::noise2d, noise2d},
+            {"plasma2d", ref::plasma2d, plasma2d},
+            {"fire2d", ref::fire2d, fire2d},
+    };
+    Strip *probe = newStrip(32 * 32, NULL);
+    matrixGeometry(probe, 32, 32);
+    bool same = probe->geometry->kind == MATRIX_GEOMETRY;
+    for (uint16_t i = 0; i < probe->count && same; i++) {
+        uint8_t x, y, angle, radius;
+        ref::matrixXY(i, 32, 32, &x, &y);
+        ref::matrixPolar(x, y, &angle, &radius);
+        Geometry *g = probe->geometry;
+        same = g->x[i] == x && g->y[i] == y && g->angle[i] == angle && g->radius[i] == radius;
+    }
+    check(same, "32x32 matrix tables match the per-pixel coordinates");
+    deleteStrip(probe);
+
+    for (auto &p : patterns) {
+        static uint16_t seeds[2];
+        seeds[0] = seeds[1] = 1337;
+        Renderer before = p.before, after = p.after;
+        auto a = [before](Strip *s) {
+            matrixGeometry(s, 32, 32);
+            withSeed(seeds[0], before, s);
+        };
+        auto b = [after](Strip *s) {
+            matrixGeometry(s, 32, 32);
+            withSeed(seeds[1], after, s);
+        };
+        char what[64];
+        snprintf(what, sizeof(what), "%s matches on a 32x32 matrix", p.name);
+        check(sameFrames(a, b, 32 * 32, 1000, 11), what);
+        double tr = usPerFrame(a, 32 * 32, 1000);
+        double to = usPerFrame(b, 32 * 32, 1000);
+        printf("%-12s 32x32: before %7.1f us  after %7.1f us  (%.2fx)\n", p.name, tr, to, tr / to);
+    }
+}
+
+// --- time scaling: fixed point fades against powf, dueSteps against EVERY_X_MILLIS ---
+
+namespace ref {
+
+// What scaledFade() used to take with powf().
+uint32_t fadeKeep(uint16_t scale, uint8_t amount) {
+    return (uint32_t) (powf(1.0f - amount / 256.0f, scale / 256.0f) * 65536.0f);
+}
+
+}
+
+void checkTimeScaling() {
+    // Every amount, at every scale up to FRAME_SCALE_MAX, within 1/2048 of powf.
+    int32_t worst = 0;
+    for (uint16_t scale = 0; scale <= FRAME_SCALE_MAX; scale++) {
+        for (int amount = 1; amount < 256; amount++) {
+            worst = max(worst, abs((int32_t) fadeKeep(scale, amount) - (int32_t) ref::fadeKeep(scale, amount)));
+        }
+    }
+    check(worst <= 32, "fadeKeep matches powf");
+
+    volatile uint32_t sink = 0;
+    double us[2];
+    for (int side = 0; side < 2; side++) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (uint16_t scale = 0; scale < 4096; scale++) {
+            sink += side ? fadeKeep(scale, scale * 7) : ref::fadeKeep(scale, scale * 7);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        us[side] = std::chrono::duration<double, std::micro>(t1 - t0).count() / 4096;
+    }
+    printf("%-12s powf %.3f us  fixed point %.3f us, worst error %d of 65536\n", "fadeKeep", us[0], us[1], worst);
+
+    // dueSteps counts the firings of EVERY_X_MILLIS with the same period, however rarely it is called.
+    uint32_t start = hostMillis;
+    for (uint32_t period : {10, 20, 200}) {
+        for (uint32_t every : {1, 7, 21, 50}) {
+            uint32_t te = 0, tb = 0, fired = 0, due = 0;
+            for (hostMillis = start; hostMillis < start + 5000; hostMillis++) {
+                EVERY_X_MILLIS(te, period)
+                    fired++;
+                }
+                if (hostMillis % every == 0) {
+                    due += dueSteps(&tb, period);
+                }
+            }
+            char what[64];
+            snprintf(what, sizeof(what), "dueSteps(%u) called every %u ms keeps pace", period, every);
+            check(due + 1 >= fired && due <= fired + 1, what);
+        }
+    }
+    hostMillis = start;
+}
+
+// --- user programs: the bytecode VM against the same pattern written in C ---
+
+namespace ref {
+
+CRGB rainbow(Strip *s, uint16_t i, uint16_t t) {
+    return CHSV(i * 8 + (t >> 3), 255, 255);
+}
+
+CRGB noise(Strip *s, uint16_t i, uint16_t t) {
+    return ColorFromPalette(s->currentPalette, inoise8(i * 32, t >> 2), 255, s->currentBlending);
+}
+
+CRGB plasma(Strip *s, uint16_t i, uint16_t t) {
+    uint8_t v = qadd8(sin8(i * 4 + (t >> 4)), cos8(i * 7 - (t >> 3)));
+    return CHSV(v, 255, v);
+}
+
+CRGB sines(Strip *s, uint16_t i, uint16_t t) {
+    uint16_t v = i;
+    for (int k = 0; k < 60; k++) {
+        v = sin8(v);
+    }
+    return CRGB(v, v, v);
+}
+
+}
+
+void checkPrograms() {
+    static const uint8_t rainbow[] = {VM_I, VM_K8, 8, VM_MUL, VM_T, VM_SHR, 3, VM_ADD, VM_K8, 255, VM_DUP, VM_HSV};
+    static const uint8_t noise[] = {VM_I, VM_K8, 32, VM_MUL, VM_T, VM_SHR, 2, VM_NOISE, VM_K8, 255, VM_PAL};
+    static const uint8_t plasma[] = {VM_I, VM_K8, 4, VM_MUL, VM_T, VM_SHR, 4, VM_ADD, VM_SIN8,
+                                     VM_I, VM_K8, 7, VM_MUL, VM_T, VM_SHR, 3, VM_SUB, VM_COS8,
+                                     VM_QADD, VM_K8, 255, VM_OVER, VM_HSV};
+    // Long enough that a 300 pixel strip no longer fits in one render's step budget.
+    static uint8_t sines[64];
+    sines[0] = VM_I;
+    memset(sines + 1, VM_SIN8, 60);
+    sines[61] = VM_DUP;
+    sines[62] = VM_DUP;
+    sines[63] = VM_RGB;
+    static const struct {
+        const char *name;
+        const uint8_t *code;
+        uint8_t len;
+        CRGB (*native)(Strip *, uint16_t, uint16_t);
+    } programs[] = {
+            {"rainbow", rainbow, sizeof(rainbow), ref::rainbow},
+            {"noise", noise, sizeof(noise), ref::noise},
+            {"plasma", plasma, sizeof(plasma), ref::plasma},
+            {"sines", sines, sizeof(sines), ref::sines},
+    };
+
+    static Pattern user = {.name = "user1", .renderer = userProgram, .huePause = 20, .renderPause = 20};
+    const uint16_t n = 300;
+    const double frameUs = 1000000.0 / 60;
+    printf("%-12s %4s %6s %9s %9s %8s %10s %12s\n", "program", "px", "steps", "vm us", "C us", "ns/step",
+           "px/render", "60 fps frame");
+    for (auto &p : programs) {
+        const char *error = installProgram(0, p.code, p.len, false);
+        check(!error, "program installs");
+        if (error) {
+            printf("  %s: %s\n", p.name, error);
+            continue;
+        }
+        uint8_t steps = activeProgram(0)->steps;
+        uint16_t slice = min((uint32_t) n, max((uint32_t) 1, (uint32_t) PROGRAM_BUDGET / steps));
+        auto vm = [&](Strip *s) {
+            s->pattern = &user;
+            userProgram(s);
+        };
+        auto native = [&](Strip *s) {
+            uint16_t t = millis();
+            for (uint16_t i = 0; i < s->count; i++) {
+                s->leds[i] = p.native(s, i, t);
+            }
+        };
+
+        // Programs that cover the strip in one render must match the C version on every frame.
+        // Longer ones go on where the last render stopped.
+        if (slice == n) {
+            char what[64];
+            snprintf(what, sizeof(what), "program %s matches its C version", p.name);
+            check(sameFrames(native, vm, n, 200, 17), what);
+        } else {
+            Strip *s = newStrip(n, &user);
+            userProgram(s);
+            bool first = s->t4 == slice;
+            userProgram(s);
+            check(first && s->t4 == (uint32_t) (2 * slice - n), "a sliced program continues where it stopped");
+            deleteStrip(s);
+        }
+        double us = usPerFrame(vm, n, 2000);
+        double nativeUs = usPerFrame(native, n, 2000);
+        printf("%-12s %4d %6d %9.1f %9.1f %8.2f %10d %11.1f%%\n", p.name, n, steps, us, nativeUs,
+               us * 1000 / (slice * steps), slice, us * 100 / frameUs);
+    }
+}
+
+// --- long strips: every 1D renderer at lengths past the old 8-bit limit ---
+
+void checkLongStrips() {
+    static const struct {
+        const char *name;
+        Renderer render;
+    } patterns[] = {
+            {"glitter", glitter}, {"confetti", confetti}, {"cycle", cycle}, {"rainbow", rainbow},
+            {"rainbowg", rainbowWithGlitter}, {"pride", pride}, {"sinelon", sinelon}, {"juggle", juggle},
+            {"bpm", bpm}, {"fire", fire}, {"mirrorfire", mirrorfire}, {"multifire", multifire},
+            {"noise", noise}, {"blendwave", blendwave}, {"dotbeat", dotBeat}, {"plasma", plasma},
+            {"gradient", gradient}, {"vibrancy", vibrancy}, {"pacifica", pacifica}, {"murica", murica},
+            {"embers", embers}, {"twinklefox", twinklefox}, {"fireworks", fireworks},
+            {"sr_pixel", pixel}, {"sr_pixels", pixels}, {"sr_ripple", ripple}, {"sr_matrix", matrixDown},
+            {"sr_onesine", onesine}, {"sr_fire", firesr}, {"sr_splitfire", splitfiresr},
+            {"sr_rainbowg", rainbowg}, {"sr_rainbowbit", rainbowbit}, {"sr_besin", besin},
+            {"sr_fillnoise", fillnoise}, {"sr_plasma", plasmasr},
+    };
+    static const uint16_t longLengths[] = {300, 1000, 2000};
+
+    printf("%-14s %9s %9s %9s  (us per frame)\n", "", "300 px", "1000 px", "2000 px");
+    for (auto &p : patterns) {
+        printf("%-14s", p.name);
+        for (uint16_t n : longLengths) {
+            Renderer render = p.render;
+            double us = usPerFrame([render](Strip *s) {
+                // A steady beat, so that the sound reactive patterns have something to show.
+                sampleavg = 64 + random8(128);
+                samplepeak = random8() < 32;
+                render(s);
+            }, n, 200000 / n);
+            printf(" %9.1f", us);
+        }
+        printf("\n");
+    }
+    sampleavg = samplepeak = 0;
+}
+
+int main() {
+    printf("TWINKLE_CLOCK_CACHE %d\n", TWINKLE_CLOCK_CACHE);
+    checkTwinkles();
+    checkPacifica();
+    checkNoise();
+    checkFire();
+    check2d();
+    checkTimeScaling();
+    checkPrograms();
+    checkLongStrips();
+
+    printf(failures ? "%d failures\n" : "ok\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,174 @@
+// Host check and benchmark for the bulk pixel kernels in pixelops.h.
+//
+// Every kernel is compared byte for byte with the FastLED scalar code it
+// replaces, over random lengths, alignments and amounts, then the blends are
+// timed against it. The scalar references below follow FastLED's C
+// implementations of scale8 and blend8. From the top of the repository:
+//
+//     g++ -std=gnu++17 -O2 -Wall -DFASTLED_SCALE8_FIXED=1 -DFASTLED_BLEND_FIXED=1 -o /tmp/pixeltest tools/hosttest/pixeltest.cpp && /tmp/pixeltest
+//
+// and again with either or both of the two variants set to 0.
+//
+// Host timings only show the relative gain; the ESP8266 has no data cache
+// and a slower multiplier, so its numbers differ.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using std::min;
+
+struct CRGB {
+    union {
+        struct {
+            uint8_t r, g, b;
+        };
+        uint8_t raw[3];
+    };
+};
+
+// FastLED's fill_solid, which the kernels fall back on.
+void fill_solid(CRGB *leds, int n, const CRGB &c) {
+    for (int i = 0; i < n; i++) {
+        leds[i] = c;
+    }
+}
+
+#include "../../pixelops.h"
+
+// FastLED scalar code.
+
+uint8_t refScale8(uint8_t i, uint8_t scale) {
+#if FASTLED_SCALE8_FIXED == 1
+    return ((uint16_t) i * (1 + (uint16_t) scale)) >> 8;
+#else
+    return ((uint16_t) i * (uint16_t) scale) >> 8;
+#endif
+}
+
+uint8_t refBlend8(uint8_t a, uint8_t b, uint8_t amountOfB) {
+#if defined(FASTLED_BLEND_FIXED) && FASTLED_BLEND_FIXED == 1
+    uint16_t partial = (a << 8) | b;
+    partial += b * amountOfB;
+    partial -= a * amountOfB;
+    return partial >> 8;
+#else
+    return refScale8(a, 255 - amountOfB) + refScale8(b, amountOfB);
+#endif
+}
+
+void refNblend(CRGB &existing, const CRGB &overlay, uint8_t amount) {
+    if (amount == 0) {
+        return;
+    }
+    if (amount == 255) {
+        existing = overlay;
+        return;
+    }
+    for (int c = 0; c < 3; c++) {
+        existing.raw[c] = refBlend8(existing.raw[c], overlay.raw[c], amount);
+    }
+}
+
+void refShift(CRGB *leds, uint16_t count, int n) {
+    if (n > 0) {
+        for (int i = count - 1; i >= n; i--) {
+            leds[i] = leds[i - n];
+        }
+    } else if (n < 0) {
+        for (int i = 0; i < count + n; i++) {
+            leds[i] = leds[i - n];
+        }
+    }
+}
+
+#define SLACK 8
+#define MAX_PIXELS 80
+
+uint8_t buf[3 * MAX_PIXELS + SLACK], ref[3 * MAX_PIXELS + SLACK], src[3 * MAX_PIXELS + SLACK];
+
+int check() {
+    const char *names[] = {"blend", "blendToward", "shift"};
+    for (int it = 0; it < 300000; it++) {
+        int op = it % 3;
+        int off = rand() % 4, so = rand() % 4;
+        uint16_t n = rand() % MAX_PIXELS;
+        // Bias amounts towards the special cases at both ends.
+        uint8_t amount = rand() % 8 == 0 ? (rand() & 1) * 255 : rand();
+        CRGB c;
+        c.r = rand();
+        c.g = rand();
+        c.b = rand();
+        for (size_t i = 0; i < sizeof(buf); i++) {
+            buf[i] = ref[i] = rand();
+            src[i] = rand();
+        }
+        CRGB *leds = (CRGB *) (buf + off), *expected = (CRGB *) (ref + off), *overlay = (CRGB *) (src + so);
+
+        switch (op) {
+            case 0:
+                blendPixels(leds, overlay, n, amount);
+                for (uint16_t i = 0; i < n; i++) {
+                    refNblend(expected[i], overlay[i], amount);
+                }
+                break;
+            case 1:
+                blendPixelsToward(leds, n, c, amount);
+                for (uint16_t i = 0; i < n; i++) {
+                    refNblend(expected[i], c, amount);
+                }
+                break;
+            case 2: {
+                int d = (int) (rand() % (2 * MAX_PIXELS + 1)) - MAX_PIXELS;
+                shiftPixels(leds, n, d);
+                if (abs(d) < n) {
+                    refShift(expected, n, d);
+                }
+                amount = d;
+                break;
+            }
+        }
+        if (memcmp(buf, ref, sizeof(buf))) {
+            printf("FAIL %s: offset %d, %d pixels, amount %d\n", names[op], off, n, amount);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+template<typename F>
+double nsPerPixel(F f) {
+    const int rounds = 20000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        f();
+        __asm__ __volatile__("" : : "r"(buf) : "memory");
+    }
+    std::chrono::duration<double, std::nano> t = std::chrono::steady_clock::now() - start;
+    return t.count() / rounds / MAX_PIXELS;
+}
+
+void bench() {
+    CRGB *leds = (CRGB *) buf, *overlay = (CRGB *) (src + 1);
+    CRGB c = {{{10, 200, 30}}};
+    printf("%-12s %8s %8s\n", "ns/pixel", "kernel", "scalar");
+    printf("%-12s %8.2f %8.2f\n", "blend",
+           nsPerPixel([&] { blendPixels(leds, overlay, MAX_PIXELS, 64); }),
+           nsPerPixel([&] { for (int i = 0; i < MAX_PIXELS; i++) refNblend(leds[i], overlay[i], 64); }));
+    printf("%-12s %8.2f %8.2f\n", "blendToward",
+           nsPerPixel([&] { blendPixelsToward(leds, MAX_PIXELS, c, 8); }),
+           nsPerPixel([&] { for (int i = 0; i < MAX_PIXELS; i++) refNblend(leds[i], c, 8); }));
+}
+
+int main() {
+    printf("FASTLED_SCALE8_FIXED %d, FASTLED_BLEND_FIXED %d\n", FASTLED_SCALE8_FIXED, FASTLED_BLEND_FIXED);
+    if (check()) {
+        return 1;
+    }
+    printf("bit-exact\n");
+    bench();
+    return 0;
+}
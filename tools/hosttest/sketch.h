@@ -0,0 +1,110 @@
+// Host stand-in for the part of LedLamp.ino that the pattern headers see: the
+// pattern and strip types, the sound sample globals and the timing macros.
+// The types mirror the sketch's and must be kept in step with it.
+
+#include "hoststubs.h"
+
+#define LED_COUNT               60
+#define MAX_LED_COUNT           2048
+
+#define EVERY_X_MILLIS(T, N)  if (T < millis()) { T = millis() + N;
+#define ARRAY_SIZE(A) (sizeof(A) / sizeof((A)[0]))
+
+typedef struct StripRec Strip;
+typedef struct OutputStageRec OutputStage;
+typedef struct CLEDController CLEDController;
+
+typedef void (*Renderer)(Strip *);
+
+typedef struct Pattern {
+    const char *name;
+    Renderer renderer;
+    int32_t huePause;
+    int32_t renderPause;
+    boolean soundReactive;
+    boolean favorite;
+    uint16_t cost;
+} Pattern;
+
+typedef enum {
+    NOT_RANDOM,
+    ALL,
+    FAVORITES,
+    SOUND_REACTIVE,
+    NOT_SOUND_REACTIVE
+} RandomMode;
+
+typedef enum {
+    LINEAR_GEOMETRY,
+    MATRIX_GEOMETRY,
+    RING_GEOMETRY,
+    POINTS_GEOMETRY
+} GeometryKind;
+
+typedef struct {
+    GeometryKind kind;
+    uint16_t width, height;
+    uint8_t *x, *y;
+    uint8_t *angle, *radius;
+    uint16_t *grid;
+} Geometry;
+
+struct StripRec {
+    const char *name;
+    bool on;
+    CRGB color;
+    uint8_t brightness;
+    CRGB *leds;
+    Pattern *pattern;
+    uint8_t hue;
+    uint16_t count;
+    CLEDController *ctl;
+    CRGBPalette16 currentPalette;
+    CRGBPalette16 targetPalette;
+    TBlendType currentBlending;
+    RandomMode randomMode;
+    uint32_t th, tb, tp, t0, t1, t2, t3, t4;
+    byte *data;
+    Geometry *geometry;
+    OutputStage *output;
+    uint32_t tr;
+    uint16_t dt;
+    uint16_t drift;
+    uint16_t offset;
+    uint16_t span;
+};
+
+HostFS SPIFFS;
+
+uint16_t sampleavg = 0;
+uint16_t samplepeak = 0;
+uint16_t oldsample = 0;
+
+// A strip of n pixels with its own pixel and heat buffers, laid out as a line.
+Strip *newStrip(uint16_t n, Pattern *pattern) {
+    Strip *s = new Strip();
+    s->name = "front";
+    s->on = true;
+    s->brightness = 255;
+    s->count = n;
+    s->leds = new CRGB[n]();
+    s->data = new byte[n]();
+    s->geometry = new Geometry();
+    s->pattern = pattern;
+    s->currentPalette = CRGBPalette16(PartyColors_p);
+    s->targetPalette = CRGBPalette16(PartyColors_p);
+    s->currentBlending = LINEARBLEND;
+    return s;
+}
+
+void deleteStrip(Strip *s) {
+    delete[] s->leds;
+    delete[] s->data;
+    free(s->geometry->x);
+    free(s->geometry->y);
+    free(s->geometry->angle);
+    free(s->geometry->radius);
+    free(s->geometry->grid);
+    delete s->geometry;
+    delete s;
+}
@@ -0,0 +1,249 @@
+// Host stress test for the SPSC queues in spsc.h and for frame pacing with
+// rendering split from networking.
+//
+// First a producer and a consumer thread hammer a queue with sequence
+// numbers and with render command sized payloads; every item must arrive
+// once, in order and untorn. Then a render thread shows pacifica frames on
+// a 60 fps deadline, taking commands from and handing frame reports to a
+// network thread that simulates bursts of slow WebSocket clients and
+// multicast traffic. The same load is also run interleaved in one thread,
+// the way loop() runs it on the ESP8266, for comparison. From the top of
+// the repository:
+//
+//     g++ -std=gnu++17 -O2 -Wall -Wno-unused-variable -pthread -o /tmp/spsctest tools/hosttest/spsctest.cpp && /tmp/spsctest
+//
+// The pacing figures need at least two cores; with fewer the threaded run
+// is only reported, not checked.
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "sketch.h"
+#include "../../spsc.h"
+#include "../../pacifica.h"
+
+using Clock = std::chrono::steady_clock;
+
+int failures = 0;
+
+void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// --- queue ---
+
+// As large as a render command with its palette; the checksum catches torn copies.
+typedef struct {
+    uint32_t seq;
+    uint8_t payload[56];
+    uint32_t sum;
+} Item;
+
+uint32_t itemSum(const Item &item) {
+    uint32_t sum = item.seq;
+    for (uint8_t b : item.payload) {
+        sum = sum * 31 + b;
+    }
+    return sum;
+}
+
+void checkQueue() {
+    const uint32_t count = 2000000;
+
+    SpscQueue<uint32_t, 16> numbers;
+    bool inOrder = true;
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < count; i++) {
+            while (!numbers.push(i)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    for (uint32_t expected = 0; expected < count;) {
+        uint32_t n;
+        if (numbers.pop(n)) {
+            inOrder = inOrder && n == expected;
+            expected++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    check(inOrder && !numbers.size(), "numbers arrive once and in order");
+
+    SpscQueue<Item, 4> items;
+    bool intact = true;
+    std::thread itemProducer([&] {
+        for (uint32_t i = 0; i < count / 5; i++) {
+            Item item;
+            item.seq = i;
+            for (uint8_t k = 0; k < sizeof(item.payload); k++) {
+                item.payload[k] = i * 7 + k;
+            }
+            item.sum = itemSum(item);
+            while (!items.push(item)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    for (uint32_t expected = 0; expected < count / 5;) {
+        Item item;
+        if (items.pop(item)) {
+            intact = intact && item.seq == expected && item.sum == itemSum(item);
+            expected++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    itemProducer.join();
+    check(intact, "render command sized items arrive whole");
+}
+
+// --- frame pacing ---
+
+#define FRAME_US    16667
+#define PIXELS      300
+#define RUN_FRAMES  600
+
+typedef struct {
+    CRGB color;
+    uint8_t brightness;
+} RenderCommand;
+
+typedef struct {
+    uint32_t frame;
+} FrameReport;
+
+// Simulated network pass: mostly quick, sometimes a slow client or a burst of packets.
+void networkPass(std::mt19937 &rng) {
+    uint32_t r = rng() % 100;
+    uint32_t us = r < 80 ? 200 : r < 95 ? 4000 : 25000;
+    auto until = Clock::now() + std::chrono::microseconds(us);
+    while (Clock::now() < until) {
+    }
+}
+
+void renderOne(Strip *s, RenderCommand *cmd) {
+    hostMillis = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+    pacifica(s);
+    nscale8(s->leds, s->count, cmd->brightness);
+}
+
+typedef struct {
+    double p50, p99, max;
+    int late;
+} Pacing;
+
+Pacing pacing(std::vector<double> &intervals) {
+    std::sort(intervals.begin(), intervals.end());
+    Pacing p;
+    p.p50 = intervals[intervals.size() / 2];
+    p.p99 = intervals[intervals.size() * 99 / 100];
+    p.max = intervals.back();
+    p.late = std::count_if(intervals.begin(), intervals.end(), [](double ms) { return ms > 1.5 * FRAME_US / 1000.0; });
+    return p;
+}
+
+void report(const char *name, Pacing p, uint32_t commands) {
+    printf("%-12s frame interval ms: p50 %5.1f  p99 %5.1f  max %5.1f  late %3d of %d, %u commands\n",
+           name, p.p50, p.p99, p.max, p.late, RUN_FRAMES, commands);
+}
+
+// Network and rendering take turns in one thread, as in loop() on the ESP8266.
+Pacing runInterleaved(uint32_t *applied) {
+    std::mt19937 rng(7);
+    Strip *s = newStrip(PIXELS, NULL);
+    RenderCommand cmd = {CRGB::White, 255};
+    std::vector<double> intervals;
+    auto next = Clock::now();
+    auto last = next;
+    *applied = 0;
+    for (int f = 0; f <= RUN_FRAMES; f++) {
+        while (Clock::now() < next) {
+            networkPass(rng);
+            cmd.brightness = rng();
+            (*applied)++;
+        }
+        auto now = Clock::now();
+        if (f) {
+            intervals.push_back(std::chrono::duration<double, std::milli>(now - last).count());
+        }
+        last = now;
+        renderOne(s, &cmd);
+        next += std::chrono::microseconds(FRAME_US);
+    }
+    deleteStrip(s);
+    return pacing(intervals);
+}
+
+// Rendering in its own thread, fed through one queue and reporting through another.
+Pacing runThreaded(uint32_t *applied, uint32_t *reported) {
+    SpscQueue<RenderCommand, 4> commands;
+    SpscQueue<FrameReport, 16> reports;
+    std::atomic<bool> done{false};
+    *reported = 0;
+
+    std::thread network([&] {
+        std::mt19937 rng(7);
+        while (!done.load()) {
+            networkPass(rng);
+            RenderCommand cmd = {CRGB::White, (uint8_t) rng()};
+            commands.push(cmd);
+            FrameReport r;
+            while (reports.pop(r)) {
+                (*reported)++;
+            }
+        }
+    });
+
+    Strip *s = newStrip(PIXELS, NULL);
+    RenderCommand cmd = {CRGB::White, 255};
+    std::vector<double> intervals;
+    auto next = Clock::now();
+    auto last = next;
+    *applied = 0;
+    for (int f = 0; f <= RUN_FRAMES; f++) {
+        std::this_thread::sleep_until(next);
+        auto now = Clock::now();
+        if (f) {
+            intervals.push_back(std::chrono::duration<double, std::milli>(now - last).count());
+        }
+        last = now;
+        while (commands.pop(cmd)) {
+            (*applied)++;
+        }
+        renderOne(s, &cmd);
+        reports.push(FrameReport{(uint32_t) f});
+        next += std::chrono::microseconds(FRAME_US);
+    }
+    done = true;
+    network.join();
+    deleteStrip(s);
+    return pacing(intervals);
+}
+
+int main() {
+    checkQueue();
+
+    uint32_t applied, reported;
+    Pacing inline_ = runInterleaved(&applied);
+    report("interleaved", inline_, applied);
+    Pacing threaded = runThreaded(&applied, &reported);
+    report("threaded", threaded, applied);
+
+    if (std::thread::hardware_concurrency() >= 2) {
+        check(threaded.late <= RUN_FRAMES / 100, "rendering keeps its pace under network load");
+        check(reported >= RUN_FRAMES * 9 / 10, "frame reports reach the network side");
+    } else {
+        printf("single core host: pacing not checked\n");
+    }
+
+    printf(failures ? "%d failures\n" : "ok\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Load test for a lamp's batched /api/state endpoint.
+
+Posts random multi-property updates for both strips for a while, from one
+or more clients, and reports requests/sec and latency percentiles. Each
+response carries the lamp's governor state, so the report also shows how
+busy rendering was and whether the governor had to step in, i.e. whether
+the lamp kept its frame rate under the load:
+
+    tools/loadtest.py lamp.local [seconds] [clients]
+
+ESP8266WebServer serves one connection at a time, so more than one client
+mostly measures queueing.
+"""
+
+import http.client
+import json
+import random
+import sys
+import threading
+import time
+
+EFFECTS = ['fire', 'plasma', 'gradient', 'pacifica', 'rainbow', 'noise', 'twinklefox', 'solid']
+
+
+def update():
+    body = {}
+    for strip in ('front', 'back'):
+        props = {}
+        if random.random() < 0.7:
+            props['brightness'] = random.randint(1, 255)
+        if random.random() < 0.5:
+            props['rgb'] = '#%06X' % random.randint(0, 0xFFFFFF)
+        if random.random() < 0.3:
+            props['effect'] = random.choice(EFFECTS)
+        body[strip] = props
+    return json.dumps(body)
+
+
+def client(host, until, results):
+    conn = http.client.HTTPConnection(host, timeout=5)
+    while time.monotonic() < until:
+        started = time.monotonic()
+        try:
+            conn.request('POST', '/api/state', update(), {'Content-Type': 'application/json'})
+            response = conn.getresponse()
+            payload = response.read()
+            elapsed = time.monotonic() - started
+            state = json.loads(payload) if response.status == 200 else None
+            results.append((elapsed, response.status, state.get('governor') if state else None))
+        except (OSError, http.client.HTTPException, ValueError):
+            results.append((time.monotonic() - started, 0, None))
+            conn.close()
+            conn = http.client.HTTPConnection(host, timeout=5)
+    conn.close()
+
+
+def percentile(values, p):
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__.strip())
+        sys.exit(2)
+    host = sys.argv[1]
+    seconds = float(sys.argv[2]) if len(sys.argv) > 2 else 30
+    clients = int(sys.argv[3]) if len(sys.argv) > 3 else 1
+
+    results = []
+    until = time.monotonic() + seconds
+    threads = [threading.Thread(target=client, args=(host, until, results)) for _ in range(clients)]
+    started = time.monotonic()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.monotonic() - started
+
+    ok = sorted(r[0] * 1000 for r in results if r[1] == 200)
+    failed = len(results) - len(ok)
+    if not ok:
+        print('no successful requests (%d failed)' % failed)
+        sys.exit(1)
+    governors = [r[2] for r in results if r[2]]
+    print('%d requests in %.1f s from %d client(s): %.1f req/s, %d failed'
+          % (len(results), elapsed, clients, len(ok) / elapsed, failed))
+    print('latency ms: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f'
+          % (percentile(ok, 50), percentile(ok, 90), percentile(ok, 99), ok[-1]))
+    if governors:
+        levels = sorted(set(g['level'] for g in governors))
+        print('render load: max %d%%, governor levels seen: %s'
+              % (max(g['renderLoad'] for g in governors), ', '.join(levels)))
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -252,6 +252,54 @@ const TProgmemRGBPalette16 *EmbersPaletteList[] = {
 #define EVERY_X_SECS(T, N)  if (T < millis()) { T = millis() + N*1000;
 #define EVERY_X_MILLIS(T, N)  if (T < millis()) { T = millis() + N;
 
+// If TWINKLE_CLOCK_CACHE is set to 1, the per-pixel clock parameters
+// that drawTwinkles would otherwise re-derive from the PRNG16 stream on
+// every frame are generated once into a small table (4 bytes per pixel,
+// for the first LED_COUNT pixels). Pixels past the end of the table fall
+// back to the PRNG16 stream, so the output is identical either way.
+// Off by default: the two multiplies it saves per pixel did not show up
+// in host timings (tools/hosttest/patterntest.cpp), and the table costs
+// 240 bytes of RAM.
+#ifndef TWINKLE_CLOCK_CACHE
+#define TWINKLE_CLOCK_CACHE 0
+#endif
+
+// Per-pixel 'clock' parameters: offset, speed (in 8ths) and salt.
+typedef struct {
+    uint16_t offset;
+    uint8_t speed;
+    uint8_t salt;
+} TwinkleClock;
+
+// Draws the next pixel's clock parameters from the PRNG16 stream.
+inline void nextTwinkleClock(uint16_t &prng, TwinkleClock &tc) {
+    prng = (uint16_t)(prng * 2053) + 1384; // next 'random' number
+    tc.offset = prng; // use that number as clock offset
+    prng = (uint16_t)(prng * 2053) + 1384; // next 'random' number
+    // use that number as clock speed adjustment factor (in 8ths, from 8/8ths to 23/8ths)
+    tc.speed = ((((prng & 0xFF) >> 4) + (prng & 0x0F)) & 0x0F) + 0x08;
+    tc.salt = prng >> 8; // get 'salt' value for this pixel
+}
+
+#if TWINKLE_CLOCK_CACHE
+static TwinkleClock twinkleClocks[LED_COUNT];
+static uint16_t twinkleClocksTail;
+static bool twinkleClocksReady = false;
+
+// Fills the clock table once; remembers where the PRNG16 stream left off.
+void setupTwinkleClocks() {
+    if (twinkleClocksReady) {
+        return;
+    }
+    uint16_t prng = 11337;
+    for (int i = 0; i < LED_COUNT; i++) {
+        nextTwinkleClock(prng, twinkleClocks[i]);
+    }
+    twinkleClocksTail = prng;
+    twinkleClocksReady = true;
+}
+#endif
+
 //  This function takes a time in pseudo-milliseconds,
 //  figures out brightness = f( time ), and also hue = f( time )
 //  The 'low digits' of the millisecond time are used as
@@ -261,7 +309,7 @@ const TProgmemRGBPalette16 *EmbersPaletteList[] = {
 //  of one cycle of the brightness wave function.
 //  The 'high digits' are also used to determine whether this pixel
 //  should light at all during this cycle, based on the TWINKLE_DENSITY.
-CRGB computeOneTwinkle(Strip *s, uint32_t ms, uint8_t salt) {
+inline CRGB computeOneTwinkle(const CRGBPalette16 &pal, uint32_t ms, uint8_t salt) {
     uint16_t ticks = ms >> (8 - TWINKLE_SPEED);
     uint8_t fastcycle8 = ticks;
     uint16_t slowcycle16 = (ticks >> 8) + salt;
@@ -269,21 +317,19 @@ CRGB computeOneTwinkle(Strip *s, uint32_t ms, uint8_t salt) {
     slowcycle16 = (slowcycle16 * 2053) + 1384;
     uint8_t slowcycle8 = (slowcycle16 & 0xFF) + (slowcycle16 >> 8);
 
-    uint8_t bright = 0;
-    if (((slowcycle8 & 0x0E) / 2) < TWINKLE_DENSITY) {
-        bright = attackDecayWave8(fastcycle8);
+    // Most pixels are dark most of the time, so skip the palette lookup early.
+    if (((slowcycle8 & 0x0E) / 2) >= TWINKLE_DENSITY) {
+        return CRGB::Black;
     }
-
-    uint8_t hue = slowcycle8 - salt;
-    CRGB c;
-    if (bright > 0) {
-        c = ColorFromPalette(s->currentPalette, hue, bright, NOBLEND);
-        if (COOL_LIKE_INCANDESCENT == 1) {
-            coolLikeIncandescent(c, fastcycle8);
-        }
-    } else {
-        c = CRGB::Black;
+    uint8_t bright = attackDecayWave8(fastcycle8);
+    if (!bright) {
+        return CRGB::Black;
     }
+
+    CRGB c = ColorFromPalette(pal, slowcycle8 - salt, bright, NOBLEND);
+#if COOL_LIKE_INCANDESCENT == 1
+    coolLikeIncandescent(c, fastcycle8);
+#endif
     return c;
 }
 
@@ -298,6 +344,12 @@ void drawTwinkles(Strip *s) {
     // this function is called, so that the sequence of 'random'
     // numbers that it generates is (paradoxically) stable.
     uint16_t PRNG16 = 11337;
+    int cached = 0;
+#if TWINKLE_CLOCK_CACHE
+    setupTwinkleClocks();
+    PRNG16 = twinkleClocksTail;
+    cached = s->count < LED_COUNT ? s->count : LED_COUNT;
+#endif
 
     uint32_t clock32 = millis();
 
@@ -322,25 +374,36 @@ void drawTwinkles(Strip *s) {
     }
 
     uint8_t backgroundBrightness = bg.getAverageLight();
+    bool blackBackground = !bg;
 
     for (int i = 0; i < s->count; i++) {
         CRGB &pixel = s->leds[i];
-        PRNG16 = (uint16_t)(PRNG16 * 2053) + 1384; // next 'random' number
-        uint16_t myclockoffset16 = PRNG16; // use that number as clock offset
-        PRNG16 = (uint16_t)(PRNG16 * 2053) + 1384; // next 'random' number
-        // use that number as clock speed adjustment factor (in 8ths, from 8/8ths to 23/8ths)
-        uint8_t myspeedmultiplierQ5_3 = ((((PRNG16 & 0xFF) >> 4) + (PRNG16 & 0x0F)) & 0x0F) + 0x08;
-        uint32_t myclock30 = (uint32_t)((clock32 * myspeedmultiplierQ5_3) >> 3) + myclockoffset16;
-        uint8_t myunique8 = PRNG16 >> 8; // get 'salt' value for this pixel
+        TwinkleClock tc;
+#if TWINKLE_CLOCK_CACHE
+        if (i < cached) {
+            tc = twinkleClocks[i];
+        } else {
+            nextTwinkleClock(PRNG16, tc);
+        }
+#else
+        nextTwinkleClock(PRNG16, tc);
+#endif
+        uint32_t myclock30 = (uint32_t)((clock32 * tc.speed) >> 3) + tc.offset;
 
         // We now have the adjusted 'clock' for this pixel, now we call
         // the function that computes what color the pixel should be based
         // on the "brightness = f( time )" idea.
-        CRGB c = computeOneTwinkle(s, myclock30, myunique8);
+        CRGB c = computeOneTwinkle(s->currentPalette, myclock30, tc.salt);
+
+        // With a black background every twinkle is 'brighter', so skip the comparison.
+        if (blackBackground) {
+            pixel = blend(pixel, c, 32);
+            continue;
+        }
 
         uint8_t cbright = c.getAverageLight();
         int16_t deltabright = cbright - backgroundBrightness;
-        if (deltabright >= 32 || (!bg)) {
+        if (deltabright >= 32) {
             // If the new pixel is significantly brighter than the background color,
             // use the new color.
             pixel = blend(pixel, c, 32);